@@ -11,100 +11,27 @@ function humanReadableTimeDiff(diff = 0) {
     ).join(' ');
 }
 
-function createTag(name, attributes = {}, innerText = "")
+// NOTE: The events are rendered by the server. The page only keeps
+// the countdowns ticking and marks the events that have already started.
+function updateCountdowns()
 {
-    let tag = document.createElement(name);
-    for (let [key, value] of Object.entries(attributes)) {
-        tag.setAttribute(key, value);
+    let now = Math.floor(Date.now() / 1000);
+    for (let countdown of document.querySelectorAll(".countdown[data-id]")) {
+        let diff = parseInt(countdown.dataset.id) - now;
+
+        if (diff >= 0) {
+            countdown.innerText = `Starts in ${humanReadableTimeDiff(diff)}`;
+        } else {
+            countdown.innerText = `Ended ${humanReadableTimeDiff(diff)} ago`;
+            countdown.closest(".event").classList.add("past");
+        }
     }
-    tag.innerText = innerText;
-    return tag;
-}
-
-function createTimestamp(json)
-{
-    let timestamp = createTag("div", {"class": "timestamp"});
-    timestamp.innerHTML = `<a href="#_${json["id"]}">${json["id"]}</a>`;
-    return timestamp;
-}
-
-function createTitle(json)
-{
-    let title = createTag("h1");
-    title.innerHTML = `<a href="${json["url"]}">${json["title"]}</a>`;
-    return title;
-}
-
-function timeDiffOfEvent(event)
-{
-    return parseInt(event["id"]) - Math.floor(Date.now() / 1000);
-}
-
-function createCountdown(event)
-{
-    let countdown = createTag("div", {"class": "countdown"});
-    let diff = timeDiffOfEvent(event);
-
-    if (diff >= 0) {
-        countdown.innerHTML = `Starts in ${humanReadableTimeDiff(diff)}`;
-    } else {
-        countdown.innerHTML = `Ended ${humanReadableTimeDiff(diff)} ago`;
-    }
-
-    return countdown;
-}
-
-function createChannel(json) {
-    let channel = createTag("div", {"class": "channel"});
-    channel.innerHTML = `<a href="${json["channel"]}">${json["channel"]}</a>`;
-    return channel;
-}
-
-function createDescription(json) {
-    let desc = createTag("div", {"class": "description markdown"});
-    desc.innerHTML = json["description"];
-    return desc;
-}
-
-function createDayOff() {
-    let dayOff = createTag("div", {"class": "event"});
-    dayOff.appendChild(createTag("h1", {}, "Day off"));
-    return dayOff;
-}
-
-function createEvent(event) {
-    if (event) {
-        let eventTag = createTag("div", {
-            "class": timeDiffOfEvent(event) < 0 ? "event past" : "event",
-            "id": "_" + event["id"]
-        });
-
-        // TODO(#63): the frontend does not display a couple of past events like the legacy app
-        // TODO(#64): the frontend does not display the current event with embeded twitch stream
-        eventTag.appendChild(createTimestamp(event));
-        eventTag.appendChild(createTitle(event));
-        eventTag.appendChild(createCountdown(event));
-        eventTag.appendChild(createChannel(event));
-        // TODO(#65): markdown in the description is not renderered;
-        eventTag.appendChild(createDescription(event));
-
-        return eventTag;
-    }
-
-    return createDayOff();
 }
 
+// TODO(#63): the frontend does not display a couple of past events like the legacy app
+// TODO(#64): the frontend does not display the current event with embeded twitch stream
+// TODO(#65): markdown in the description is not renderered;
 (() => {
-    let app = document.querySelector("#app");
-    fetch("/api/period_streams")
-        .then(res => res.json())
-        .then(json => {
-            for (let event in json) {
-                app.appendChild(createEvent(json[event]));
-            }
-        })
-        .catch(err => {
-            app.innerText = "Bruh";
-            console.error(err);
-        });
+    updateCountdowns();
+    setInterval(updateCountdowns, 1000);
 })();
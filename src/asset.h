@@ -0,0 +1,62 @@
+#ifndef ASSET_H_
+#define ASSET_H_
+
+#include <stdint.h>
+
+#include "s.h"
+
+// NOTE: Assets are generated by ./bake out of the public/ folder at
+// compile time (see src/bake.c). The content lives in the .rodata of
+// the executable, so serving an asset never touches the filesystem.
+
+typedef struct {
+    String path;
+    String content;
+    const char *mime;
+    String etag;
+    // NOTE: prebuilt Content-Type and ETag header lines
+    String headers;
+} Asset;
+
+typedef struct {
+    const Asset *assets;
+    size_t assets_count;
+    const int *slots;
+    size_t slots_count;
+    uint32_t seed;
+} Asset_Table;
+
+// NOTE: FNV-1a seeded with an arbitrary value. ./bake searches for the
+// seed that maps every path of the table to a distinct slot, so the
+// lookup is a single hash, a single index and a single string_equal.
+static inline
+uint32_t asset_hash(String path, uint32_t seed)
+{
+    uint32_t hash = 2166136261u ^ seed;
+    for (size_t i = 0; i < path.len; ++i) {
+        hash ^= (uint8_t) path.data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static inline
+const Asset *asset_table_lookup(const Asset_Table *table, String path)
+{
+    assert(table);
+    assert((table->slots_count & (table->slots_count - 1)) == 0);
+
+    const int slot = table->slots[asset_hash(path, table->seed) & (table->slots_count - 1)];
+    if (slot < 0) {
+        return NULL;
+    }
+
+    const Asset *asset = &table->assets[slot];
+    if (!string_equal(asset->path, path)) {
+        return NULL;
+    }
+
+    return asset;
+}
+
+#endif  // ASSET_H_
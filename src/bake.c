@@ -0,0 +1,279 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <fnmatch.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "s.h"
+#include "asset.h"
+
+#define BAKED_FILES_CAPACITY 256
+#define BAKED_PATH_CAPACITY 1024
+#define SEED_ATTEMPTS 100000
+
+typedef struct {
+    char path[BAKED_PATH_CAPACITY];
+    String content;
+    const char *mime;
+    uint64_t etag;
+} Baked_File;
+
+Baked_File baked_files[BAKED_FILES_CAPACITY];
+size_t baked_files_count = 0;
+
+String file_as_content(const char *filepath) {
+    assert(filepath);
+
+    FILE *f = fopen(filepath, "rb");
+    assert(f);
+
+    fseek(f, 0, SEEK_END);
+    long m = ftell(f);
+    assert(m >= 0);
+    fseek(f, 0, SEEK_SET);
+    char *buffer = calloc(1, sizeof(char) * (size_t) m + 1);
+    assert(buffer);
+
+    size_t n = fread(buffer, 1, (size_t) m, f);
+    assert(n == (size_t) m);
+
+    fclose(f);
+    return string(n, buffer);
+}
+
+const char *mime_of_file_path(const char *file_path)
+{
+    static const char *mimes[][2] = {
+        {"*.html", "text/html"},
+        {"*.css",  "text/css"},
+        {"*.js",   "text/javascript"},
+        {"*.json", "application/json"},
+        {"*.png",  "image/png"},
+        {"*.svg",  "image/svg+xml"},
+        {"*.ico",  "image/x-icon"},
+    };
+    static const size_t mimes_count = sizeof(mimes) / sizeof(mimes[0]);
+
+    for (size_t i = 0; i < mimes_count; ++i) {
+        if (fnmatch(mimes[i][0], file_path, 0) == 0) {
+            return mimes[i][1];
+        }
+    }
+
+    return "text/plain";
+}
+
+uint64_t etag_of_content(String content)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < content.len; ++i) {
+        hash ^= (uint8_t) content.data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+void scan_folder(const char *folder, const char *prefix)
+{
+    DIR *dir = opendir(folder);
+    if (dir == NULL) {
+        fprintf(stderr, "Could not open folder `%s'\n", folder);
+        exit(1);
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+
+        char filepath[BAKED_PATH_CAPACITY];
+        snprintf(filepath, sizeof(filepath), "%s/%s", folder, entry->d_name);
+
+        char path[BAKED_PATH_CAPACITY];
+        snprintf(path, sizeof(path), "%s%s", prefix, entry->d_name);
+
+        struct stat file_stat;
+        if (stat(filepath, &file_stat) < 0) {
+            fprintf(stderr, "Could not stat file `%s'\n", filepath);
+            exit(1);
+        }
+
+        if (S_ISDIR(file_stat.st_mode)) {
+            char subprefix[BAKED_PATH_CAPACITY];
+            int n = snprintf(subprefix, sizeof(subprefix), "%s/", path);
+            if (n < 0 || (size_t) n >= sizeof(subprefix)) {
+                fprintf(stderr, "Path `%s' is too long\n", filepath);
+                exit(1);
+            }
+            scan_folder(filepath, subprefix);
+        } else if (S_ISREG(file_stat.st_mode)) {
+            assert(baked_files_count < BAKED_FILES_CAPACITY);
+            Baked_File *file = &baked_files[baked_files_count++];
+            memcpy(file->path, path, sizeof(path));
+            file->content = file_as_content(filepath);
+            file->mime = mime_of_file_path(path);
+            file->etag = etag_of_content(file->content);
+        }
+    }
+
+    closedir(dir);
+}
+
+int compare_baked_files(const void *a, const void *b)
+{
+    return strcmp(((const Baked_File *) a)->path, ((const Baked_File *) b)->path);
+}
+
+// NOTE: Brute force search for a seed that puts every path into a
+// separate slot. The slot table grows until such a seed exists, which
+// for a handful of files happens on the first or second size.
+int find_perfect_seed(int *slots, size_t slots_count, uint32_t *seed)
+{
+    for (uint32_t attempt = 0; attempt < SEED_ATTEMPTS; ++attempt) {
+        for (size_t i = 0; i < slots_count; ++i) {
+            slots[i] = -1;
+        }
+
+        int collision = 0;
+        for (size_t i = 0; i < baked_files_count && !collision; ++i) {
+            uint32_t slot = asset_hash(cstr_as_string(baked_files[i].path), attempt) & (slots_count - 1);
+            if (slots[slot] >= 0) {
+                collision = 1;
+            } else {
+                slots[slot] = (int) i;
+            }
+        }
+
+        if (!collision) {
+            *seed = attempt;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+void compile_byte_array(size_t index, String s) {
+    printf("static const uint8_t public_asset_%zu[] = {", index);
+    for (size_t i = 0; i < s.len; ++i) {
+        if (i % 16 == 0) {
+            printf("\n   ");
+        }
+        printf(" 0x%02x,", (uint8_t) s.data[i]);
+    }
+    // NOTE: empty initializer lists are not allowed in C11
+    printf("%s\n};\n\n", s.len == 0 ? " 0x00" : "");
+}
+
+// NOTE: the paths come from the file system, so they may have quotes,
+// backslashes or anything else in them. Everything besides the bytes
+// that are safe in a C string literal goes as \xNN.
+void print_c_string_literal(const char *s)
+{
+    putchar('"');
+    int after_escape = 0;
+    for (; *s; ++s) {
+        const char c = *s;
+        const int safe = ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') ||
+            ('0' <= c && c <= '9') || (c != '\0' && strchr(" !#$%&()*+,-./:;<=>@[]^_{|}~", c));
+        if (!safe) {
+            printf("\\x%02x", (uint8_t) c);
+            after_escape = 1;
+            continue;
+        }
+        // NOTE: \x takes every hex digit that follows it
+        if (after_escape && isxdigit((uint8_t) c)) {
+            printf("\"\"");
+        }
+        putchar(c);
+        after_escape = 0;
+    }
+    putchar('"');
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: ./bake <folder>\n");
+        return 1;
+    }
+
+    scan_folder(argv[1], "");
+    if (baked_files_count == 0) {
+        fprintf(stderr, "There are no files in `%s'\n", argv[1]);
+        return 1;
+    }
+
+    qsort(baked_files, baked_files_count, sizeof(baked_files[0]), compare_baked_files);
+
+    size_t slots_count = 1;
+    while (slots_count < baked_files_count) {
+        slots_count *= 2;
+    }
+
+    int *slots = NULL;
+    uint32_t seed = 0;
+    for (;;) {
+        slots = realloc(slots, sizeof(slots[0]) * slots_count);
+        assert(slots);
+        if (find_perfect_seed(slots, slots_count, &seed)) {
+            break;
+        }
+        slots_count *= 2;
+    }
+
+    printf("// Generated by ./bake %s. DO NOT EDIT!\n\n", argv[1]);
+
+    for (size_t i = 0; i < baked_files_count; ++i) {
+        compile_byte_array(i, baked_files[i].content);
+    }
+
+    printf("static const Asset public_assets_array[] = {\n");
+    for (size_t i = 0; i < baked_files_count; ++i) {
+        printf("    {\n");
+        printf("        .path = { .len = %zu, .data = ", strlen(baked_files[i].path));
+        print_c_string_literal(baked_files[i].path);
+        printf(" },\n");
+        printf("        .content = { .len = %zu, .data = (const char *) public_asset_%zu },\n",
+               baked_files[i].content.len, i);
+        printf("        .mime = ");
+        print_c_string_literal(baked_files[i].mime);
+        printf(",\n");
+        printf("        .etag = { .len = 18, .data = \"\\\"%016llx\\\"\" },\n",
+               (unsigned long long) baked_files[i].etag);
+
+        char headers[BAKED_PATH_CAPACITY];
+        int n = snprintf(headers, sizeof(headers), "Content-Type: %s\r\nETag: \"%016llx\"\r\n",
+                         baked_files[i].mime, (unsigned long long) baked_files[i].etag);
+        assert(n > 0 && (size_t) n < sizeof(headers));
+        printf("        .headers = { .len = %d, .data = ", n);
+        print_c_string_literal(headers);
+        printf(" },\n");
+        printf("    },\n");
+    }
+    printf("};\n\n");
+
+    printf("static const int public_assets_slots[] = {");
+    for (size_t i = 0; i < slots_count; ++i) {
+        printf("%s%d", i == 0 ? "" : ", ", slots[i]);
+    }
+    printf("};\n\n");
+
+    printf("static const Asset_Table public_assets = {\n");
+    printf("    .assets = public_assets_array,\n");
+    printf("    .assets_count = %zu,\n", baked_files_count);
+    printf("    .slots = public_assets_slots,\n");
+    printf("    .slots_count = %zu,\n", slots_count);
+    printf("    .seed = %uu,\n", seed);
+    printf("};\n");
+
+    free(slots);
+
+    return 0;
+}
@@ -0,0 +1,178 @@
+#ifndef BUFFER_H_
+#define BUFFER_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include "memory.h"
+#include "s.h"
+
+#define BUFFER_INITIAL_CAPACITY 256
+
+// NOTE: An output buffer that grows inside of a Memory arena. When the
+// buffer is the last allocation of the arena it is extended in place,
+// otherwise it is moved to a fresh chunk of twice the size.
+typedef struct {
+    Memory *memory;
+    size_t capacity;
+    size_t size;
+    char *data;
+} Buffer;
+
+static inline
+Buffer buffer_of_memory(Memory *memory)
+{
+    assert(memory);
+    return (Buffer) { .memory = memory };
+}
+
+static inline
+void buffer_reserve(Buffer *buffer, size_t n)
+{
+    assert(buffer);
+    assert(buffer->memory);
+
+    if (buffer->size + n <= buffer->capacity) {
+        return;
+    }
+
+    size_t capacity = buffer->capacity ? buffer->capacity : BUFFER_INITIAL_CAPACITY;
+    while (capacity < buffer->size + n) {
+        capacity *= 2;
+    }
+
+    Memory *memory = buffer->memory;
+    if (buffer->data != NULL &&
+        (uint8_t *) buffer->data + buffer->capacity == memory->buffer + memory->size &&
+        memory->size + (capacity - buffer->capacity) <= memory->capacity) {
+        memory->size += capacity - buffer->capacity;
+    } else {
+        char *data = memory_alloc(memory, capacity);
+        if (buffer->size > 0) {
+            memcpy(data, buffer->data, buffer->size);
+        }
+        buffer->data = data;
+    }
+
+    buffer->capacity = capacity;
+}
+
+static inline
+void buffer_append(Buffer *buffer, const void *data, size_t size)
+{
+    buffer_reserve(buffer, size);
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+}
+
+static inline
+void buffer_append_char(Buffer *buffer, char c)
+{
+    buffer_reserve(buffer, 1);
+    buffer->data[buffer->size++] = c;
+}
+
+static inline
+void buffer_append_string(Buffer *buffer, String s)
+{
+    buffer_append(buffer, s.data, s.len);
+}
+
+static inline
+void buffer_append_cstr(Buffer *buffer, const char *cstr)
+{
+    buffer_append(buffer, cstr, strlen(cstr));
+}
+
+#define U64_DIGITS_CAPACITY 20
+
+// NOTE: the two digits of every number below 100, so the numbers are
+// converted two digits per division instead of one
+static const char digit_pairs[200] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+// NOTE: writes the decimal digits of x into the beginning of out and
+// returns their amount
+static inline
+size_t u64_to_digits(char out[U64_DIGITS_CAPACITY], uint64_t x)
+{
+    char digits[U64_DIGITS_CAPACITY];
+    char *p = digits + U64_DIGITS_CAPACITY;
+
+    while (x >= 100) {
+        const size_t i = (size_t) (x % 100) * 2;
+        x /= 100;
+        p -= 2;
+        memcpy(p, digit_pairs + i, 2);
+    }
+
+    if (x >= 10) {
+        p -= 2;
+        memcpy(p, digit_pairs + x * 2, 2);
+    } else {
+        *--p = (char) ('0' + x);
+    }
+
+    const size_t n = (size_t) (digits + U64_DIGITS_CAPACITY - p);
+    memcpy(out, p, n);
+    return n;
+}
+
+static inline
+void buffer_append_u64(Buffer *buffer, uint64_t x)
+{
+    buffer_reserve(buffer, U64_DIGITS_CAPACITY);
+    buffer->size += u64_to_digits(buffer->data + buffer->size, x);
+}
+
+static inline
+void buffer_append_i64(Buffer *buffer, int64_t x)
+{
+    if (x < 0) {
+        buffer_append_char(buffer, '-');
+        buffer_append_u64(buffer, (uint64_t) 0 - (uint64_t) x);
+    } else {
+        buffer_append_u64(buffer, (uint64_t) x);
+    }
+}
+
+static inline
+String buffer_as_string(Buffer buffer)
+{
+    return string(buffer.size, buffer.data);
+}
+
+static inline
+void buffer_clean(Buffer *buffer)
+{
+    assert(buffer);
+    buffer->size = 0;
+}
+
+// NOTE: gives the unused capacity back to the arena when the buffer is
+// its last allocation. For the buffers that are done growing and stay
+// around as long as the arena does.
+static inline
+void buffer_shrink(Buffer *buffer)
+{
+    assert(buffer);
+    assert(buffer->memory);
+
+    Memory *memory = buffer->memory;
+    if (buffer->data != NULL &&
+        (uint8_t *) buffer->data + buffer->capacity == memory->buffer + memory->size) {
+        memory->size -= buffer->capacity - buffer->size;
+        buffer->capacity = buffer->size;
+    }
+}
+
+#endif  // BUFFER_H_
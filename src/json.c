@@ -1,88 +1,128 @@
 #define _POSIX_C_SOURCE 200809L
 
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include "json.h"
 #include "utf8.h"
 
-Json_Value json_null = { .type = JSON_NULL };
-Json_Value json_true = { .type = JSON_BOOLEAN, .boolean = 1 };
-Json_Value json_false = { .type = JSON_BOOLEAN, .boolean = 0 };
+Json_Value json_null = { .bits = JSON_NULL };
+Json_Value json_true = { .bits = JSON_BOOLEAN, .boolean = 1 };
+Json_Value json_false = { .bits = JSON_BOOLEAN, .boolean = 0 };
+
+static inline
+Json_Value json_value(Json_Type type, uint64_t flags, size_t size)
+{
+    return (Json_Value) { .bits = ((uint64_t) size << JSON_SIZE_SHIFT) | flags | type };
+}
 
 Json_Value json_string(String string)
 {
-    return (Json_Value) {
-        .type = JSON_STRING,
-        .string = string
-    };
+    Json_Value value = json_value(JSON_STRING, 0, string.len);
+    value.data = string.data;
+    return value;
+}
+
+Json_Value json_integer(int64_t integer)
+{
+    Json_Value value = json_value(JSON_NUMBER, 0, 0);
+    value.integer = integer;
+    return value;
 }
 
 static
-Json_Result parse_json_value_impl(Memory *memory, String source, int level);
+Json_Value json_number_literal(String literal)
+{
+    Json_Value value = json_value(JSON_NUMBER, JSON_NUMBER_LITERAL, literal.len);
+    value.data = literal.data;
+    return value;
+}
 
-int json_isspace(char c)
+static
+int json_is_number_literal(Json_Value value)
 {
-    return c == 0x20 || c == 0x0A || c == 0x0D || c == 0x09;
+    return json_type(value) == JSON_NUMBER && (value.bits & JSON_NUMBER_LITERAL);
 }
 
-String json_trim_begin(String s)
+Json_Value json_array(const Json_Value *elements, size_t count)
 {
-    while (s.len && json_isspace(*s.data)) {
-        s.data++;
-        s.len--;
-    }
-    return s;
+    Json_Value value = json_value(JSON_ARRAY, 0, count);
+    value.elements = elements;
+    return value;
 }
 
-void json_array_push(Memory *memory, Json_Array *array, Json_Value value)
+Json_Value json_object(const Json_Member *members, size_t count)
 {
-    assert(memory);
-    assert(array);
+    Json_Value value = json_value(JSON_OBJECT, 0, count);
+    value.members = members;
+    return value;
+}
 
-    if (array->begin == NULL) {
-        assert(array->end == NULL);
-        array->begin = memory_alloc_aligned(memory, sizeof(Json_Array_Page), alignof(Json_Array_Page));
-        array->end = array->begin;
-        memset(array->begin, 0, sizeof(Json_Array_Page));
-    }
+// NOTE: Scratch space of the parser. The elements of the arrays and the
+// members of the objects that are still being parsed are pushed here,
+// and moved to the arena in one piece once the closing bracket is
+// found. That way every container ends up contiguous without knowing
+// its size in advance.
+typedef struct {
+    Memory *memory;
+    char *stack;
+    size_t stack_size;
+    size_t stack_capacity;
+} Json_Parser;
 
-    if (array->end->size >= JSON_ARRAY_PAGE_CAPACITY) {
-        Json_Array_Page *next = memory_alloc_aligned(memory, sizeof(Json_Array_Page), alignof(Json_Array_Page));
-        memset(next, 0, sizeof(Json_Array_Page));
-        array->end->next = next;
-        array->end = next;
-    }
+#define JSON_PARSER_STACK_INITIAL_CAPACITY (4 * 1024)
 
-    assert(array->end->size < JSON_ARRAY_PAGE_CAPACITY);
+static
+void json_parser_push(Json_Parser *parser, const void *data, size_t size)
+{
+    assert(parser);
+
+    if (parser->stack_size + size > parser->stack_capacity) {
+        size_t capacity = parser->stack_capacity
+            ? parser->stack_capacity
+            : JSON_PARSER_STACK_INITIAL_CAPACITY;
+        while (capacity < parser->stack_size + size) {
+            capacity *= 2;
+        }
+        parser->stack = realloc(parser->stack, capacity);
+        assert(parser->stack);
+        parser->stack_capacity = capacity;
+    }
 
-    array->end->elements[array->end->size++] = value;
+    memcpy(parser->stack + parser->stack_size, data, size);
+    parser->stack_size += size;
 }
 
-void json_object_push(Memory *memory, Json_Object *object, String key, Json_Value value)
+// NOTE: moves everything pushed since base into the arena
+static
+void *json_parser_pop(Json_Parser *parser, size_t base, size_t alignment)
 {
-    assert(memory);
-    assert(object);
+    assert(parser);
+    assert(base <= parser->stack_size);
 
-    if (object->begin == NULL) {
-        assert(object->end == NULL);
-        object->begin = memory_alloc_aligned(memory, sizeof(Json_Object_Page), alignof(Json_Object_Page));
-        object->end = object->begin;
-        memset(object->begin, 0, sizeof(Json_Object_Page));
-    }
+    const size_t size = parser->stack_size - base;
+    void *result = memory_alloc_aligned(parser->memory, size, alignment);
+    memcpy(result, parser->stack + base, size);
+    parser->stack_size = base;
+    return result;
+}
 
-    if (object->end->size >= JSON_OBJECT_PAGE_CAPACITY) {
-        Json_Object_Page *next = memory_alloc_aligned(memory, sizeof(Json_Object_Page), alignof(Json_Object_Page));
-        memset(next, 0, sizeof(Json_Object_Page));
-        object->end->next = next;
-        object->end = next;
-    }
+static
+Json_Result parse_json_value_impl(Json_Parser *parser, String source, int level);
 
-    assert(object->end->size < JSON_OBJECT_PAGE_CAPACITY);
+int json_isspace(char c)
+{
+    return c == 0x20 || c == 0x0A || c == 0x0D || c == 0x09;
+}
 
-    object->end->elements[object->end->size].key = key;
-    object->end->elements[object->end->size].value = value;
-    object->end->size += 1;
+String json_trim_begin(String s)
+{
+    while (s.len && json_isspace(*s.data)) {
+        s.data++;
+        s.len--;
+    }
+    return s;
 }
 
 int64_t stoi64(String integer)
@@ -111,27 +151,53 @@ int64_t stoi64(String integer)
     return result * sign;
 }
 
-int64_t json_number_to_integer(Json_Number number)
+int64_t json_as_integer(Json_Value value)
 {
-    int64_t exponent = stoi64(number.exponent);
-    int64_t result = stoi64(number.integer);
+    assert(json_type(value) == JSON_NUMBER);
+
+    if (!json_is_number_literal(value)) {
+        return value.integer;
+    }
+
+    // NOTE: the literal went through parse_json_number, so it is
+    // <integer>[.<fraction>][(e|E)<exponent>]
+    String literal = string(json_size(value), value.data);
+    String integer = literal;
+    integer.len = string_find_any(literal, SLT(".eE"));
+    chop(&literal, integer.len);
 
-    if (exponent > 0) {
+    String fraction = {0};
+    if (literal.len && *literal.data == '.') {
+        chop(&literal, 1);
+        fraction = literal;
+        fraction.len = string_find_any(literal, SLT("eE"));
+        chop(&literal, fraction.len);
+    }
+
+    String exponent = {0};
+    if (literal.len) {
+        exponent = drop(literal, 1);
+    }
+
+    int64_t e = stoi64(exponent);
+    int64_t result = stoi64(integer);
+
+    if (e > 0) {
         int64_t sign = result >= 0 ? 1 : -1;
 
-        for (; exponent > 0; exponent -= 1) {
+        for (; e > 0; e -= 1) {
             int64_t x = 0;
 
-            if (number.fraction.len) {
-                x = *number.fraction.data - '0';
-                chop(&number.fraction, 1);
+            if (fraction.len) {
+                x = *fraction.data - '0';
+                chop(&fraction, 1);
             }
 
             result = result * 10 + sign * x;
         }
     }
 
-    for (; exponent < 0 && result; exponent += 1) {
+    for (; e < 0 && result; e += 1) {
         result /= 10;
     }
 
@@ -230,15 +296,21 @@ static Json_Result parse_json_number(String source)
         }
     }
 
+    const String literal = string((size_t) (source.data - integer.data), integer.data);
+
+    // NOTE: the integers that surely fit into int64_t are stored as
+    // is. -0 stays a literal, so it is printed back with its sign.
+    const size_t digits = integer.len - (*integer.data == '-');
+    if (exponent.data == NULL && fraction.data == NULL && digits <= 18
+        && !string_equal(integer, SLT("-0"))) {
+        return (Json_Result) {
+            .value = json_integer(stoi64(integer)),
+            .rest = source
+        };
+    }
+
     return (Json_Result) {
-        .value = {
-            .type = JSON_NUMBER,
-            .number = {
-                .integer = integer,
-                .fraction = fraction,
-                .exponent = exponent
-            }
-        },
+        .value = json_number_literal(literal),
         .rest = source
     };
 }
@@ -260,18 +332,24 @@ static Json_Result parse_json_string_literal(String source)
         .len = 0
     };
 
-    while (source.len && *source.data != '"') {
-        if (*source.data == '\\') {
-            s.len++;
-            chop(&source, 1);
+    while (source.len) {
+        const size_t n = string_find_any(source, SLT("\"\\"));
+        s.len += n;
+        chop(&source, n);
 
-            if (source.len == 0) {
-                return (Json_Result) {
-                    .is_error = 1,
-                    .rest = source,
-                    .message = "Unfinished escape sequence",
-                };
-            }
+        if (source.len == 0 || *source.data == '"') {
+            break;
+        }
+
+        s.len++;
+        chop(&source, 1);
+
+        if (source.len == 0) {
+            return (Json_Result) {
+                .is_error = 1,
+                .rest = source,
+                .message = "Unfinished escape sequence",
+            };
         }
 
         s.len++;
@@ -289,10 +367,7 @@ static Json_Result parse_json_string_literal(String source)
     chop(&source, 1);
 
     return (Json_Result) {
-        .value = {
-            .type = JSON_STRING,
-            .string = s
-        },
+        .value = json_string(s),
         .rest = source
     };
 }
@@ -346,13 +421,7 @@ static Json_Result parse_escape_sequence(Memory *memory, String source)
         if (unescape_map[i][0] == *source.data) {
             return (Json_Result) {
                 .rest = drop(source, 1),
-                .value = {
-                    .type = JSON_STRING,
-                    .string = {
-                        .len = 1,
-                        .data = &unescape_map[i][1]
-                    }
-                }
+                .value = json_string(string(1, &unescape_map[i][1]))
             };
         }
     }
@@ -440,36 +509,94 @@ static Json_Result parse_escape_sequence(Memory *memory, String source)
         rune = 0x10000 + (((rune - 0xD800) << 10) |(surrogate - 0xDC00));
     }
 
-    if (rune > 0x10FFFF) {
+    // NOTE: a low surrogate without the high one has no UTF-8 encoding
+    if (rune > 0x10FFFF || (0xDC00 <= rune && rune <= 0xDFFF)) {
         rune = 0xFFFD;
     }
 
     Utf8_Chunk utf8_chunk = utf8_encode_rune(rune);
     assert(utf8_chunk.size > 0);
 
+    // NOTE: there is no memory when the string is only validated
+    if (memory == NULL) {
+        return (Json_Result) {
+            .value = json_string(string(utf8_chunk.size, NULL)),
+            .rest = source
+        };
+    }
+
     char *data = memory_alloc(memory, utf8_chunk.size);
     memcpy(data, utf8_chunk.buffer, utf8_chunk.size);
 
     return (Json_Result){
-        .value = {
-            .type = JSON_STRING,
-            .string = {
-                .len = utf8_chunk.size,
-                .data = data
-            }
-        },
+        .value = json_string(string(utf8_chunk.size, data)),
         .rest = source
     };
 }
 
+// NOTE: Returns the index of the first backslash or non-ASCII byte of
+// `s` or `s.len` if there is none. The plain ASCII strings are the
+// common case, so they cost the same as looking for the backslash alone.
+static inline
+size_t json_find_escape_or_non_ascii(String s)
+{
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128i backslash = _mm_set1_epi8('\\');
+    for (; i + 16 <= s.len; i += 16) {
+        const __m128i chunk = _mm_loadu_si128((const __m128i *) (s.data + i));
+        const int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, backslash), chunk));
+        if (mask) {
+            return i + (size_t) __builtin_ctz((unsigned) mask);
+        }
+    }
+#endif
+
+    for (; i < s.len; ++i) {
+        if (s.data[i] == '\\' || (unsigned char) s.data[i] >= 0x80) {
+            return i;
+        }
+    }
+
+    return s.len;
+}
+
+// NOTE: parses the run of the string literal content up to the next
+// escape sequence and checks that it is valid UTF-8. The escape
+// sequences are plain ASCII and what they decode to is always valid, so
+// the runs are the only place an invalid byte can hide.
+static
+Json_Result parse_json_string_run(String source)
+{
+    size_t n = json_find_escape_or_non_ascii(source);
+    if (n < source.len && source.data[n] != '\\') {
+        const String rest = drop(source, n);
+        const size_t run = string_find_char(rest, '\\');
+        const size_t valid = utf8_validate(rest.data, run);
+        if (valid < run) {
+            return (Json_Result) {
+                .is_error = 1,
+                .rest = drop(rest, valid),
+                .message = "Invalid UTF-8",
+            };
+        }
+        n += run;
+    }
+
+    return (Json_Result) {
+        .value = json_null,
+        .rest = drop(source, n)
+    };
+}
+
 static Json_Result parse_json_string(Memory *memory, String source)
 {
     Json_Result result = parse_json_string_literal(source);
     if (result.is_error) return result;
-    assert(result.value.type == JSON_STRING);
 
-    const size_t buffer_capacity = result.value.string.len;
-    source = result.value.string;
+    source = json_as_string(result.value);
+    const size_t buffer_capacity = source.len;
     String rest = result.rest;
 
     char *buffer = memory_alloc(memory, buffer_capacity);
@@ -479,37 +606,32 @@ static Json_Result parse_json_string(Memory *memory, String source)
         if (*source.data == '\\') {
             result = parse_escape_sequence(memory, source);
             if (result.is_error) return result;
-            assert(result.value.type == JSON_STRING);
-            assert(buffer_size + result.value.string.len <= buffer_capacity);
-            memcpy(buffer + buffer_size,
-                   result.value.string.data,
-                   result.value.string.len);
-            buffer_size += result.value.string.len;
+            const String unescaped = json_as_string(result.value);
+            assert(buffer_size + unescaped.len <= buffer_capacity);
+            memcpy(buffer + buffer_size, unescaped.data, unescaped.len);
+            buffer_size += unescaped.len;
 
             source = result.rest;
         } else {
-            // TODO(#37): json parser is not aware of the input encoding
-            assert(buffer_size < buffer_capacity);
-            buffer[buffer_size++] = *source.data;
-            chop(&source, 1);
+            result = parse_json_string_run(source);
+            if (result.is_error) return result;
+            const size_t n = (size_t) (result.rest.data - source.data);
+            assert(buffer_size + n <= buffer_capacity);
+            memcpy(buffer + buffer_size, source.data, n);
+            buffer_size += n;
+            chop(&source, n);
         }
     }
 
     return (Json_Result) {
-        .value = {
-            .type = JSON_STRING,
-            .string = {
-                .data = buffer,
-                .len = buffer_size
-            },
-        },
+        .value = json_string(string(buffer_size, buffer)),
         .rest = rest
     };
 }
 
-static Json_Result parse_json_array(Memory *memory, String source, int level)
+static Json_Result parse_json_array(Json_Parser *parser, String source, int level)
 {
-    assert(memory);
+    assert(parser);
 
     if(source.len == 0 || *source.data != '[') {
         return (Json_Result) {
@@ -531,20 +653,22 @@ static Json_Result parse_json_array(Memory *memory, String source, int level)
         };
     } else if(*source.data == ']') {
         return (Json_Result) {
-            .value = { .type = JSON_ARRAY },
+            .value = json_array(NULL, 0),
             .rest = drop(source, 1)
         };
     }
 
-    Json_Array array = {0};
+    const size_t base = parser->stack_size;
+    size_t count = 0;
 
     while(source.len > 0) {
-        Json_Result item_result = parse_json_value_impl(memory, source, level + 1);
+        Json_Result item_result = parse_json_value_impl(parser, source, level + 1);
         if(item_result.is_error) {
             return item_result;
         }
 
-        json_array_push(memory, &array, item_result.value);
+        json_parser_push(parser, &item_result.value, sizeof(item_result.value));
+        count += 1;
 
         source = json_trim_begin(item_result.rest);
 
@@ -557,11 +681,9 @@ static Json_Result parse_json_array(Memory *memory, String source, int level)
         }
 
         if (*source.data == ']') {
+            const Json_Value *elements = json_parser_pop(parser, base, alignof(Json_Value));
             return (Json_Result) {
-                .value = {
-                    .type = JSON_ARRAY,
-                    .array = array
-                },
+                .value = json_array(elements, count),
                 .rest = drop(source, 1)
             };
         }
@@ -584,9 +706,9 @@ static Json_Result parse_json_array(Memory *memory, String source, int level)
     };
 }
 
-static Json_Result parse_json_object(Memory *memory, String source, int level)
+static Json_Result parse_json_object(Json_Parser *parser, String source, int level)
 {
-    assert(memory);
+    assert(parser);
 
     if (source.len == 0 || *source.data != '{') {
         return (Json_Result) {
@@ -608,17 +730,18 @@ static Json_Result parse_json_object(Memory *memory, String source, int level)
         };
     } else if (*source.data == '}') {
         return (Json_Result) {
-            .value = { .type = JSON_OBJECT },
+            .value = json_object(NULL, 0),
             .rest = drop(source, 1)
         };
     }
 
-    Json_Object object = {0};
+    const size_t base = parser->stack_size;
+    size_t count = 0;
 
     while (source.len > 0) {
         source = json_trim_begin(source);
 
-        Json_Result key_result = parse_json_string(memory, source);
+        Json_Result key_result = parse_json_string(parser->memory, source);
         if (key_result.is_error) {
             return key_result;
         }
@@ -634,14 +757,18 @@ static Json_Result parse_json_object(Memory *memory, String source, int level)
 
         chop(&source, 1);
 
-        Json_Result value_result = parse_json_value_impl(memory, source, level + 1);
+        Json_Result value_result = parse_json_value_impl(parser, source, level + 1);
         if (value_result.is_error) {
             return value_result;
         }
         source = json_trim_begin(value_result.rest);
 
-        assert(key_result.value.type == JSON_STRING);
-        json_object_push(memory, &object, key_result.value.string, value_result.value);
+        const Json_Member member = {
+            .key = json_as_string(key_result.value),
+            .value = value_result.value,
+        };
+        json_parser_push(parser, &member, sizeof(member));
+        count += 1;
 
         if (source.len == 0) {
             return (Json_Result) {
@@ -652,11 +779,9 @@ static Json_Result parse_json_object(Memory *memory, String source, int level)
         }
 
         if (*source.data == '}') {
+            const Json_Member *members = json_parser_pop(parser, base, alignof(Json_Member));
             return (Json_Result) {
-                .value = {
-                    .type = JSON_OBJECT,
-                    .object = object
-                },
+                .value = json_object(members, count),
                 .rest = drop(source, 1)
             };
         }
@@ -680,7 +805,7 @@ static Json_Result parse_json_object(Memory *memory, String source, int level)
 }
 
 static
-Json_Result parse_json_value_impl(Memory *memory, String source, int level)
+Json_Result parse_json_value_impl(Json_Parser *parser, String source, int level)
 {
     if (level >= JSON_DEPTH_MAX_LIMIT) {
         return (Json_Result) {
@@ -704,9 +829,9 @@ Json_Result parse_json_value_impl(Memory *memory, String source, int level)
     case 'n': return parse_token(source, SLT("null"), json_null, "Expected `null`");
     case 't': return parse_token(source, SLT("true"), json_true, "Expected `true`");
     case 'f': return parse_token(source, SLT("false"), json_false, "Expected `false`");
-    case '"': return parse_json_string(memory, source);
-    case '[': return parse_json_array(memory, source, level);
-    case '{': return parse_json_object(memory, source, level);
+    case '"': return parse_json_string(parser->memory, source);
+    case '[': return parse_json_array(parser, source, level);
+    case '{': return parse_json_object(parser, source, level);
     }
 
     return parse_json_number(source);
@@ -714,7 +839,433 @@ Json_Result parse_json_value_impl(Memory *memory, String source, int level)
 
 Json_Result parse_json_value(Memory *memory, String source)
 {
-    return parse_json_value_impl(memory, source, 0);
+    assert(memory);
+
+    Json_Parser parser = { .memory = memory };
+    Json_Result result = parse_json_value_impl(&parser, source, 0);
+    free(parser.stack);
+    return result;
+}
+
+static
+Json_Result json_tape_error(String source, size_t offset, const char *message)
+{
+    return (Json_Result) {
+        .is_error = 1,
+        .rest = drop(source, offset),
+        .message = message
+    };
+}
+
+typedef enum {
+    JSON_CHAR_SCALAR = 0,
+    JSON_CHAR_SPACE,
+    JSON_CHAR_STRUCTURAL,
+    JSON_CHAR_QUOTE,
+} Json_Char_Class;
+
+// NOTE: the scalars (numbers and literals) are everything up to the next
+// byte that is not JSON_CHAR_SCALAR
+static const uint8_t json_char_classes[256] = {
+    [' '] = JSON_CHAR_SPACE,
+    ['\t'] = JSON_CHAR_SPACE,
+    ['\n'] = JSON_CHAR_SPACE,
+    ['\r'] = JSON_CHAR_SPACE,
+    ['{'] = JSON_CHAR_STRUCTURAL,
+    ['}'] = JSON_CHAR_STRUCTURAL,
+    ['['] = JSON_CHAR_STRUCTURAL,
+    [']'] = JSON_CHAR_STRUCTURAL,
+    [':'] = JSON_CHAR_STRUCTURAL,
+    [','] = JSON_CHAR_STRUCTURAL,
+    ['"'] = JSON_CHAR_QUOTE,
+};
+
+static inline
+Json_Char_Class json_char_class(char c)
+{
+    return (Json_Char_Class) json_char_classes[(uint8_t) c];
+}
+
+Json_Result json_tape_index(Memory *memory, String source, Json_Tape *tape)
+{
+    assert(memory);
+    assert(tape);
+
+    if (source.len > UINT32_MAX) {
+        return json_tape_error(source, 0, "The input is too big for the tape");
+    }
+
+    // NOTE: nothing else is allocated while indexing, so the tape takes
+    // whatever is left in the arena and gives back the rest at the end
+    Json_Tape_Entry *entries = memory_alloc_aligned(memory, 0, alignof(Json_Tape_Entry));
+    const size_t capacity = (memory->capacity - memory->size) / sizeof(Json_Tape_Entry);
+    size_t count = 0;
+
+    size_t open[JSON_DEPTH_MAX_LIMIT];
+    size_t depth = 0;
+
+    const char *data = source.data;
+    size_t i = 0;
+    while (i < source.len) {
+        const Json_Char_Class class = json_char_class(data[i]);
+        if (class == JSON_CHAR_SPACE) {
+            i += 1;
+            continue;
+        }
+
+        if (count >= capacity) {
+            return json_tape_error(source, i, "Out of memory for the tape");
+        }
+        Json_Tape_Entry *entry = &entries[count];
+        entry->offset = (uint32_t) i;
+        entry->match = 0;
+
+        switch (class) {
+        case JSON_CHAR_STRUCTURAL: {
+            const char c = data[i];
+            if (c == '{' || c == '[') {
+                if (depth >= JSON_DEPTH_MAX_LIMIT) {
+                    return json_tape_error(source, i, "Reach the max limit of depth");
+                }
+                open[depth++] = count;
+            } else if (c == '}' || c == ']') {
+                if (depth == 0 || data[entries[open[depth - 1]].offset] != (c == '}' ? '{' : '[')) {
+                    return json_tape_error(source, i, c == '}' ? "Unexpected '}'" : "Unexpected ']'");
+                }
+                entries[open[--depth]].match = (uint32_t) count;
+            }
+            i += 1;
+        } break;
+
+        case JSON_CHAR_QUOTE: {
+            const size_t begin = i;
+            i += 1;
+            for (;;) {
+                i += string_find_any(drop(source, i), SLT("\"\\"));
+                if (i >= source.len) {
+                    return json_tape_error(source, source.len, "Expected '\"'");
+                }
+                if (data[i] == '"') {
+                    i += 1;
+                    break;
+                }
+                // NOTE: whatever is escaped is skipped, the escape
+                // sequences are checked by json_tape_validate()
+                i += 2;
+            }
+            if (i > source.len) {
+                return json_tape_error(source, source.len, "Unfinished escape sequence");
+            }
+            entry->length = (uint32_t) (i - begin);
+        } break;
+
+        case JSON_CHAR_SCALAR: {
+            const size_t begin = i;
+            i += 1;
+            while (i < source.len && json_char_class(data[i]) == JSON_CHAR_SCALAR) {
+                i += 1;
+            }
+            entry->length = (uint32_t) (i - begin);
+        } break;
+
+        case JSON_CHAR_SPACE: {
+            assert(0 && "unreachable");
+        } break;
+        }
+
+        count += 1;
+    }
+
+    if (depth > 0) {
+        return json_tape_error(source, source.len, data[entries[open[depth - 1]].offset] == '{'
+                               ? "Expected '}'"
+                               : "Expected ']'");
+    }
+
+    memory->size += count * sizeof(Json_Tape_Entry);
+
+    *tape = (Json_Tape) {
+        .source = source,
+        .entries = entries,
+        .count = count
+    };
+
+    return (Json_Result) { .value = json_null, .rest = drop(source, source.len) };
+}
+
+// NOTE: checks the encoding and the escape sequences of the string
+// token without decoding it
+static
+Json_Result validate_json_string(String token)
+{
+    assert(token.len >= 2);
+    String s = string(token.len - 2, token.data + 1);
+    for (;;) {
+        Json_Result run = parse_json_string_run(s);
+        if (run.is_error) return run;
+        s = run.rest;
+        if (s.len == 0) break;
+
+        Json_Result escape = parse_escape_sequence(NULL, s);
+        if (escape.is_error) return escape;
+        s = escape.rest;
+    }
+
+    return (Json_Result) { .value = json_null, .rest = drop(token, token.len) };
+}
+
+static inline
+int json_isdigit(char c)
+{
+    return '0' <= c && c <= '9';
+}
+
+// NOTE: the same grammar parse_json_number() accepts, in one pass over
+// the token
+static
+Json_Result validate_json_number(String token)
+{
+    const char *s = token.data;
+    const size_t n = token.len;
+    size_t i = 0;
+
+    if (i < n && s[i] == '-') i += 1;
+    if (i < n && s[i] == '0') {
+        i += 1;
+    } else if (i < n && json_isdigit(s[i])) {
+        while (i < n && json_isdigit(s[i])) i += 1;
+    } else {
+        goto error;
+    }
+
+    if (i < n && s[i] == '.') {
+        i += 1;
+        if (!(i < n && json_isdigit(s[i]))) goto error;
+        while (i < n && json_isdigit(s[i])) i += 1;
+    }
+
+    if (i < n && (s[i] == 'e' || s[i] == 'E')) {
+        i += 1;
+        if (i < n && (s[i] == '-' || s[i] == '+')) i += 1;
+        if (!(i < n && json_isdigit(s[i]))) goto error;
+        while (i < n && json_isdigit(s[i])) i += 1;
+    }
+
+    if (i == n) {
+        return (Json_Result) { .value = json_null, .rest = drop(token, n) };
+    }
+
+error:
+    return (Json_Result) {
+        .is_error = 1,
+        .rest = drop(token, i),
+        .message = "Incorrect number literal"
+    };
+}
+
+static
+Json_Result validate_json_scalar(String token)
+{
+    switch (*token.data) {
+    case '"': return validate_json_string(token);
+    case 'n': return parse_token(token, SLT("null"), json_null, "Expected `null`");
+    case 't': return parse_token(token, SLT("true"), json_true, "Expected `true`");
+    case 'f': return parse_token(token, SLT("false"), json_false, "Expected `false`");
+    }
+    return validate_json_number(token);
+}
+
+typedef enum {
+    JSON_EXPECT_VALUE = 0,
+    JSON_EXPECT_VALUE_OR_END,
+    JSON_EXPECT_KEY,
+    JSON_EXPECT_KEY_OR_END,
+    JSON_EXPECT_COLON,
+    JSON_EXPECT_COMMA_OR_END,
+    JSON_EXPECT_NOTHING,
+} Json_Expect;
+
+Json_Result json_tape_validate(const Json_Tape *tape)
+{
+    assert(tape);
+
+    const String source = tape->source;
+    // NOTE: json_tape_index() made sure the brackets are matched and
+    // nested no deeper than the limit, so only the kind of the current
+    // container is needed
+    char open[JSON_DEPTH_MAX_LIMIT];
+    size_t depth = 0;
+    Json_Expect expect = JSON_EXPECT_VALUE;
+
+    for (size_t i = 0; i < tape->count; ++i) {
+        const size_t offset = tape->entries[i].offset;
+        const char c = source.data[offset];
+
+        if (expect == JSON_EXPECT_NOTHING) {
+            return json_tape_error(source, offset, "Unexpected input after the value");
+        }
+
+        if ((c == ']' && expect == JSON_EXPECT_VALUE_OR_END)
+            || (c == '}' && expect == JSON_EXPECT_KEY_OR_END)
+            || ((c == ']' || c == '}') && expect == JSON_EXPECT_COMMA_OR_END)) {
+            assert(depth > 0);
+            depth -= 1;
+            expect = depth > 0 ? JSON_EXPECT_COMMA_OR_END : JSON_EXPECT_NOTHING;
+            continue;
+        }
+
+        switch (expect) {
+        case JSON_EXPECT_VALUE:
+        case JSON_EXPECT_VALUE_OR_END: {
+            // NOTE: the same limit parse_json_value() puts on any value
+            if (depth >= JSON_DEPTH_MAX_LIMIT) {
+                return json_tape_error(source, offset, "Reach the max limit of depth");
+            }
+
+            if (c == '{' || c == '[') {
+                open[depth++] = c;
+                expect = c == '{' ? JSON_EXPECT_KEY_OR_END : JSON_EXPECT_VALUE_OR_END;
+                continue;
+            }
+
+            if (c == ',' || c == ':' || c == '}' || c == ']') {
+                return json_tape_error(source, offset, "Expected a value");
+            }
+
+            const String token = string(tape->entries[i].length, source.data + offset);
+            Json_Result result = validate_json_scalar(token);
+            if (result.is_error) return result;
+            // NOTE: the scalar must take the whole token, so `nullptr`
+            // does not pass for a value
+            if (result.rest.len > 0) {
+                return json_tape_error(source, (size_t) (result.rest.data - source.data),
+                                       "Unexpected input after the value");
+            }
+            expect = depth > 0 ? JSON_EXPECT_COMMA_OR_END : JSON_EXPECT_NOTHING;
+        } break;
+
+        case JSON_EXPECT_KEY:
+        case JSON_EXPECT_KEY_OR_END: {
+            if (c != '"') {
+                return json_tape_error(source, offset, "Expected '\"'");
+            }
+            const String token = string(tape->entries[i].length, source.data + offset);
+            Json_Result result = validate_json_string(token);
+            if (result.is_error) return result;
+            expect = JSON_EXPECT_COLON;
+        } break;
+
+        case JSON_EXPECT_COLON: {
+            if (c != ':') {
+                return json_tape_error(source, offset, "Expected ':'");
+            }
+            expect = JSON_EXPECT_VALUE;
+        } break;
+
+        case JSON_EXPECT_COMMA_OR_END: {
+            if (c != ',') {
+                return json_tape_error(source, offset, open[depth - 1] == '{'
+                                       ? "Expected '}' or ','"
+                                       : "Expected ']' or ','");
+            }
+            expect = open[depth - 1] == '{' ? JSON_EXPECT_KEY : JSON_EXPECT_VALUE;
+        } break;
+
+        case JSON_EXPECT_NOTHING: {
+            assert(0 && "unreachable");
+        } break;
+        }
+    }
+
+    if (expect != JSON_EXPECT_NOTHING) {
+        return json_tape_error(source, source.len, "EOF");
+    }
+
+    return (Json_Result) { .value = json_null, .rest = drop(source, source.len) };
+}
+
+static
+char json_tape_char(const Json_Tape *tape, size_t index)
+{
+    assert(index < tape->count);
+    return tape->source.data[tape->entries[index].offset];
+}
+
+// NOTE: the index of the entry right after the value at index
+static
+size_t json_tape_skip(const Json_Tape *tape, size_t index)
+{
+    const char c = json_tape_char(tape, index);
+    if (c == '{' || c == '[') {
+        return tape->entries[index].match + 1;
+    }
+    return index + 1;
+}
+
+Json_Type json_ondemand_type(Json_Cursor cursor)
+{
+    switch (json_tape_char(cursor.tape, cursor.index)) {
+    case 'n': return JSON_NULL;
+    case 't':
+    case 'f': return JSON_BOOLEAN;
+    case '"': return JSON_STRING;
+    case '[': return JSON_ARRAY;
+    case '{': return JSON_OBJECT;
+    default: return JSON_NUMBER;
+    }
+}
+
+int json_ondemand_find_field(Json_Cursor object, String key, Json_Cursor *value)
+{
+    assert(value);
+    assert(json_ondemand_type(object) == JSON_OBJECT);
+
+    const Json_Tape *tape = object.tape;
+    const size_t end = tape->entries[object.index].match;
+
+    // NOTE: every member is `"key" : value` followed by `,` or `}`
+    for (size_t i = object.index + 1; i < end; i = json_tape_skip(tape, i + 2) + 1) {
+        const Json_Tape_Entry entry = tape->entries[i];
+        if (string_equal(string(entry.length - 2, tape->source.data + entry.offset + 1), key)) {
+            *value = (Json_Cursor) { .tape = tape, .index = i + 2 };
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int json_ondemand_first(Json_Cursor array, Json_Cursor *element)
+{
+    assert(element);
+    assert(json_ondemand_type(array) == JSON_ARRAY);
+
+    if (array.index + 1 == array.tape->entries[array.index].match) {
+        return 0;
+    }
+
+    *element = (Json_Cursor) { .tape = array.tape, .index = array.index + 1 };
+    return 1;
+}
+
+int json_ondemand_next(Json_Cursor *element)
+{
+    assert(element);
+
+    const size_t next = json_tape_skip(element->tape, element->index);
+    if (json_tape_char(element->tape, next) != ',') {
+        return 0;
+    }
+
+    element->index = next + 1;
+    return 1;
+}
+
+Json_Result json_ondemand_value(Memory *memory, Json_Cursor cursor)
+{
+    assert(memory);
+    assert(cursor.index < cursor.tape->count);
+    return parse_json_value(memory, drop(cursor.tape->source, cursor.tape->entries[cursor.index].offset));
 }
 
 static
@@ -734,135 +1285,165 @@ void print_json_boolean(FILE *stream, int boolean)
 }
 
 static
-void print_json_number(FILE *stream, Json_Number number)
+void print_json_number(FILE *stream, Json_Value number)
 {
-    fwrite(number.integer.data, 1, number.integer.len, stream);
-
-    if (number.fraction.len > 0) {
-        fputc('.', stream);
-        fwrite(number.fraction.data, 1, number.fraction.len, stream);
+    if (json_is_number_literal(number)) {
+        fwrite(number.data, 1, json_size(number), stream);
+    } else {
+        fprintf(stream, "%" PRId64, number.integer);
     }
+}
 
-    if (number.exponent.len > 0) {
-        fputc('e', stream);
-        fwrite(number.exponent.data, 1, number.exponent.len, stream);
+// NOTE: what the ASCII bytes turn into inside of a JSON string. NULL
+// for the ones that go as they are. Only the short escapes JSON has are
+// used, the rest of the control characters (and DEL) go as \u00XX.
+static const char *const json_escapes[0x80] = {
+    "\\u0000", "\\u0001", "\\u0002", "\\u0003", "\\u0004", "\\u0005", "\\u0006", "\\u0007",
+    "\\b",     "\\t",     "\\n",     "\\u000b", "\\f",     "\\r",     "\\u000e", "\\u000f",
+    "\\u0010", "\\u0011", "\\u0012", "\\u0013", "\\u0014", "\\u0015", "\\u0016", "\\u0017",
+    "\\u0018", "\\u0019", "\\u001a", "\\u001b", "\\u001c", "\\u001d", "\\u001e", "\\u001f",
+    ['"'] = "\\\"",
+    ['\\'] = "\\\\",
+    [0x7f] = "\\u007f",
+};
+
+typedef void (*Json_Write)(void *output, const char *data, size_t size);
+
+// NOTE: the parsed strings are valid UTF-8, but the ones built by hand
+// may be anything. Every byte that is not a part of a valid sequence is
+// printed as U+FFFD, so the output is always valid. The runs of bytes
+// that need no escaping are written at once.
+static
+void json_escape_string(String string, Json_Write write_output, void *output)
+{
+    const char *p = string.data;
+    size_t run = 0;
+    size_t i = 0;
+
+    write_output(output, "\"", 1);
+    while (i < string.len) {
+        const unsigned char ch = (unsigned char) p[i];
+        const char *escape = NULL;
+        size_t size = 1;
+
+        if (ch < 0x80) {
+            escape = json_escapes[ch];
+        } else if ((size = utf8_decode(p + i, string.len - i).size) == 0) {
+            escape = "\\ufffd";
+            size = 1;
+        }
+
+        if (escape == NULL) {
+            i += size;
+            continue;
+        }
+
+        write_output(output, p + run, i - run);
+        // NOTE: the escapes are either \x or \uXXXX
+        write_output(output, escape, escape[1] == 'u' ? 6 : 2);
+        i += size;
+        run = i;
     }
+    write_output(output, p + run, i - run);
+    write_output(output, "\"", 1);
 }
 
 static
-int json_get_utf8_char_len(unsigned char ch) {
-    if ((ch & 0x80) == 0) return 1;
-    switch (ch & 0xf0) {
-        case 0xf0:
-            return 4;
-        case 0xe0:
-            return 3;
-        default:
-            return 2;
-    }
+void json_write_stream(void *output, const char *data, size_t size)
+{
+    fwrite(data, 1, size, (FILE *) output);
 }
 
 static
-void print_json_string(FILE *stream, String string)
+void json_write_fd(void *output, const char *data, size_t size)
 {
-    const char *hex_digits = "0123456789abcdef";
-    const char *specials = "btnvfr";
-    const char *p = string.data;
+    write(*(const int *) output, data, size);
+}
 
-    fputc('"', stream);
-    size_t cl;
-    for (size_t i = 0; i < string.len; i++) {
-        unsigned char ch = ((unsigned char *) p)[i];
-        if (ch == '"' || ch == '\\') {
-            fwrite("\\", 1, 1, stream);
-            fwrite(p + i, 1, 1, stream);
-        } else if (ch >= '\b' && ch <= '\r') {
-            fwrite("\\", 1, 1, stream);
-            fwrite(&specials[ch - '\b'], 1, 1, stream);
-        } else if (isprint(ch)) {
-            fwrite(p + i, 1, 1, stream);
-        } else if ((cl = json_get_utf8_char_len(ch)) == 1) {
-            fwrite("\\u00", 1, 4, stream);
-            fwrite(&hex_digits[(ch >> 4) % 0xf], 1, 1, stream);
-            fwrite(&hex_digits[ch % 0xf], 1, 1, stream);
-        } else {
-            fwrite(p + i, 1, cl, stream);
-            i += cl - 1;
-        }
-    }
-    fputc('"', stream);
+static
+void json_write_buffer(void *output, const char *data, size_t size)
+{
+    buffer_append((Buffer *) output, data, size);
 }
 
 static
-void print_json_array(FILE *stream, Json_Array array)
+void print_json_string(FILE *stream, String string)
+{
+    json_escape_string(string, json_write_stream, stream);
+}
+
+static
+void print_json_array(FILE *stream, Json_Value array)
 {
     fprintf(stream, "[");
-    int t = 0;
-    for (Json_Array_Page *page = array.begin; page != NULL; page = page->next) {
-        for (size_t i = 0; i < page->size; ++i) {
-            if (t) {
-                printf(",");
-            } else {
-                t = 1;
-            }
-            print_json_value(stream, page->elements[i]);
+    const size_t n = json_array_size(array);
+    for (size_t i = 0; i < n; ++i) {
+        if (i > 0) {
+            fputc(',', stream);
         }
+        print_json_value(stream, array.elements[i]);
     }
     fprintf(stream, "]");
 }
 
-void print_json_object(FILE *stream, Json_Object object)
+static
+void print_json_object(FILE *stream, Json_Value object)
 {
     fprintf(stream, "{");
-    int t = 0;
-    for (Json_Object_Page *page = object.begin; page != NULL; page = page->next) {
-        for (size_t i = 0; i < page->size; ++i) {
-            if (t) {
-                printf(",");
-            } else {
-                t = 1;
-            }
-            print_json_string(stream, page->elements[i].key);
-            fprintf(stream, ":");
-            print_json_value(stream, page->elements[i].value);
+    const size_t n = json_object_size(object);
+    for (size_t i = 0; i < n; ++i) {
+        if (i > 0) {
+            fputc(',', stream);
         }
+        print_json_string(stream, object.members[i].key);
+        fprintf(stream, ":");
+        print_json_value(stream, object.members[i].value);
     }
     fprintf(stream, "}");
 }
 
 void print_json_value(FILE *stream, Json_Value value)
 {
-    switch (value.type) {
+    switch (json_type(value)) {
     case JSON_NULL: {
         print_json_null(stream);
     } break;
     case JSON_BOOLEAN: {
-        print_json_boolean(stream, value.boolean);
+        print_json_boolean(stream, json_as_boolean(value));
     } break;
     case JSON_NUMBER: {
-        print_json_number(stream, value.number);
+        print_json_number(stream, value);
     } break;
     case JSON_STRING: {
-        print_json_string(stream, value.string);
+        print_json_string(stream, json_as_string(value));
     } break;
     case JSON_ARRAY: {
-        print_json_array(stream, value.array);
+        print_json_array(stream, value);
     } break;
     case JSON_OBJECT: {
-        print_json_object(stream, value.object);
+        print_json_object(stream, value);
     } break;
     }
 }
 
 void print_json_error(FILE *stream, Json_Result result,
                       String source, const char *prefix)
+{
+    print_json_error_at(stream, result, source, prefix, 1);
+}
+
+void print_json_error_at(FILE *stream, Json_Result result,
+                         String source, const char *prefix, size_t first_line)
 {
     assert(stream);
     assert(source.data <= result.rest.data);
 
     size_t n = result.rest.data - source.data;
 
-    for (size_t line_number = 1; source.len; ++line_number) {
+    // NOTE: the error may be at the very end, in the empty line after
+    // the final newline or in an empty source, so that line is looked
+    // at too. rest is never past the end of source, the loop ends there.
+    for (size_t line_number = first_line;; ++line_number) {
         String line = chop_line(&source);
 
         if (n <= line.len) {
@@ -889,109 +1470,240 @@ void print_json_error(FILE *stream, Json_Result result,
 }
 
 static
-void print_json_number_fd(int fd, Json_Number number)
+void print_json_number_fd(int fd, Json_Value number)
 {
-    write(fd, number.integer.data, number.integer.len);
-
-    if (number.fraction.len > 0) {
-        write(fd, ".", 1);
-        write(fd, number.fraction.data, number.fraction.len);
-    }
-
-    if (number.exponent.len > 0) {
-        write(fd, "e", 1);
-        write(fd, number.exponent.data, number.exponent.len);
+    if (json_is_number_literal(number)) {
+        write(fd, number.data, json_size(number));
+    } else {
+        dprintf(fd, "%" PRId64, number.integer);
     }
 }
 
 static
 void print_json_string_fd(int fd, String string)
 {
-    const char *hex_digits = "0123456789abcdef";
-    const char *specials = "btnvfr";
-    const char *p = string.data;
-
-    write(fd, "\"", 1);
-    size_t cl;
-    for (size_t i = 0; i < string.len; i++) {
-        unsigned char ch = ((unsigned char *) p)[i];
-        if (ch == '"' || ch == '\\') {
-            write(fd, "\\", 1);
-            write(fd, p + i, 1);
-        } else if (ch >= '\b' && ch <= '\r') {
-            write(fd, "\\", 1);
-            write(fd, &specials[ch - '\b'], 1);
-        } else if (isprint(ch)) {
-            write(fd, p + i, 1);
-        } else if ((cl = json_get_utf8_char_len(ch)) == 1) {
-            write(fd, "\\u00", 4);
-            write(fd, &hex_digits[(ch >> 4) % 0xf], 1);
-            write(fd, &hex_digits[ch % 0xf], 1);
-        } else {
-            write(fd, p + i, cl);
-            i += cl - 1;
-        }
-    }
-    write(fd, "\"", 1);
+    json_escape_string(string, json_write_fd, &fd);
 }
 
 static
-void print_json_array_fd(int fd, Json_Array array)
+void print_json_array_fd(int fd, Json_Value array)
 {
     dprintf(fd, "[");
-    int t = 0;
-    for (Json_Array_Page *page = array.begin; page != NULL; page = page->next) {
-        for (size_t i = 0; i < page->size; ++i) {
-            if (t) {
-                dprintf(fd, ",");
-            } else {
-                t = 1;
-            }
-            print_json_value_fd(fd, page->elements[i]);
+    const size_t n = json_array_size(array);
+    for (size_t i = 0; i < n; ++i) {
+        if (i > 0) {
+            dprintf(fd, ",");
         }
+        print_json_value_fd(fd, array.elements[i]);
     }
     dprintf(fd, "]");
 }
 
-void print_json_object_fd(int fd, Json_Object object)
+static
+void print_json_object_fd(int fd, Json_Value object)
 {
     dprintf(fd, "{");
-    int t = 0;
-    for (Json_Object_Page *page = object.begin; page != NULL; page = page->next) {
-        for (size_t i = 0; i < page->size; ++i) {
-            if (t) {
-                dprintf(fd, ",");
-            } else {
-                t = 1;
-            }
-            print_json_string_fd(fd, page->elements[i].key);
-            dprintf(fd, ":");
-            print_json_value_fd(fd, page->elements[i].value);
+    const size_t n = json_object_size(object);
+    for (size_t i = 0; i < n; ++i) {
+        if (i > 0) {
+            dprintf(fd, ",");
         }
+        print_json_string_fd(fd, object.members[i].key);
+        dprintf(fd, ":");
+        print_json_value_fd(fd, object.members[i].value);
     }
     dprintf(fd, "}");
 }
 
 void print_json_value_fd(int fd, Json_Value value)
 {
-    switch (value.type) {
+    switch (json_type(value)) {
     case JSON_NULL: {
         dprintf(fd, "null");
     } break;
     case JSON_BOOLEAN: {
-        dprintf(fd, value.boolean ? "true" : "false");
+        dprintf(fd, json_as_boolean(value) ? "true" : "false");
     } break;
     case JSON_NUMBER: {
-        print_json_number_fd(fd, value.number);
+        print_json_number_fd(fd, value);
     } break;
     case JSON_STRING: {
-        print_json_string_fd(fd, value.string);
+        print_json_string_fd(fd, json_as_string(value));
     } break;
     case JSON_ARRAY: {
-        print_json_array_fd(fd, value.array);
+        print_json_array_fd(fd, value);
     } break;
     case JSON_OBJECT: {
-        print_json_object_fd(fd, value.object);
+        print_json_object_fd(fd, value);
     } break;
     }
 }
+
+static
+void print_json_number_buffer(Buffer *buffer, Json_Value number)
+{
+    if (json_is_number_literal(number)) {
+        buffer_append(buffer, number.data, json_size(number));
+    } else {
+        buffer_append_i64(buffer, number.integer);
+    }
+}
+
+void print_json_string_buffer(Buffer *buffer, String string)
+{
+    json_escape_string(string, json_write_buffer, buffer);
+}
+
+static
+void print_json_array_buffer(Buffer *buffer, Json_Value array)
+{
+    buffer_append_char(buffer, '[');
+    const size_t n = json_array_size(array);
+    for (size_t i = 0; i < n; ++i) {
+        if (i > 0) {
+            buffer_append_char(buffer, ',');
+        }
+        print_json_value_buffer(buffer, array.elements[i]);
+    }
+    buffer_append_char(buffer, ']');
+}
+
+static
+void print_json_object_buffer(Buffer *buffer, Json_Value object)
+{
+    buffer_append_char(buffer, '{');
+    const size_t n = json_object_size(object);
+    for (size_t i = 0; i < n; ++i) {
+        if (i > 0) {
+            buffer_append_char(buffer, ',');
+        }
+        print_json_string_buffer(buffer, object.members[i].key);
+        buffer_append_char(buffer, ':');
+        print_json_value_buffer(buffer, object.members[i].value);
+    }
+    buffer_append_char(buffer, '}');
+}
+
+void print_json_value_buffer(Buffer *buffer, Json_Value value)
+{
+    switch (json_type(value)) {
+    case JSON_NULL: {
+        buffer_append_string(buffer, SLT("null"));
+    } break;
+    case JSON_BOOLEAN: {
+        buffer_append_string(buffer, json_as_boolean(value) ? SLT("true") : SLT("false"));
+    } break;
+    case JSON_NUMBER: {
+        print_json_number_buffer(buffer, value);
+    } break;
+    case JSON_STRING: {
+        print_json_string_buffer(buffer, json_as_string(value));
+    } break;
+    case JSON_ARRAY: {
+        print_json_array_buffer(buffer, value);
+    } break;
+    case JSON_OBJECT: {
+        print_json_object_buffer(buffer, value);
+    } break;
+    }
+}
+
+void json_writer_element(Json_Writer *writer)
+{
+    assert(writer);
+
+    if (writer->after_key) {
+        writer->after_key = 0;
+        return;
+    }
+
+    if (writer->depth > 0) {
+        const uint64_t bit = 1ull << (writer->depth - 1);
+        if (writer->nonempty & bit) {
+            buffer_append_char(writer->buffer, ',');
+        } else {
+            writer->nonempty |= bit;
+        }
+    }
+}
+
+static
+void json_writer_begin(Json_Writer *writer, char bracket)
+{
+    json_writer_element(writer);
+    assert(writer->depth < JSON_WRITER_DEPTH_MAX);
+    writer->depth += 1;
+    writer->nonempty &= ~(1ull << (writer->depth - 1));
+    buffer_append_char(writer->buffer, bracket);
+}
+
+static
+void json_writer_end(Json_Writer *writer, char bracket)
+{
+    assert(writer);
+    assert(writer->depth > 0);
+    assert(!writer->after_key);
+    writer->depth -= 1;
+    buffer_append_char(writer->buffer, bracket);
+}
+
+void json_begin_object(Json_Writer *writer)
+{
+    json_writer_begin(writer, '{');
+}
+
+void json_end_object(Json_Writer *writer)
+{
+    json_writer_end(writer, '}');
+}
+
+void json_begin_array(Json_Writer *writer)
+{
+    json_writer_begin(writer, '[');
+}
+
+void json_end_array(Json_Writer *writer)
+{
+    json_writer_end(writer, ']');
+}
+
+void json_key(Json_Writer *writer, String key)
+{
+    assert(writer);
+    assert(writer->depth > 0);
+    assert(!writer->after_key);
+    json_writer_element(writer);
+    print_json_string_buffer(writer->buffer, key);
+    buffer_append_char(writer->buffer, ':');
+    writer->after_key = 1;
+}
+
+void json_write_null(Json_Writer *writer)
+{
+    json_writer_element(writer);
+    buffer_append_string(writer->buffer, SLT("null"));
+}
+
+void json_write_boolean(Json_Writer *writer, int boolean)
+{
+    json_writer_element(writer);
+    buffer_append_string(writer->buffer, boolean ? SLT("true") : SLT("false"));
+}
+
+void json_write_int(Json_Writer *writer, int64_t x)
+{
+    json_writer_element(writer);
+    buffer_append_i64(writer->buffer, x);
+}
+
+void json_write_string(Json_Writer *writer, String string)
+{
+    json_writer_element(writer);
+    print_json_string_buffer(writer->buffer, string);
+}
+
+void json_write_value(Json_Writer *writer, Json_Value value)
+{
+    json_writer_element(writer);
+    print_json_value_buffer(writer->buffer, value);
+}
@@ -1,11 +1,14 @@
 #ifndef JSON_H_
 #define JSON_H_
 
+#include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 
 #include "s.h"
 #include "memory.h"
+#include "buffer.h"
 
 #define JSON_DEPTH_MAX_LIMIT 100
 
@@ -34,65 +37,109 @@ const char *json_type_as_cstr(Json_Type type)
 }
 
 typedef struct Json_Value Json_Value;
+typedef struct Json_Member Json_Member;
 
-#define JSON_ARRAY_PAGE_CAPACITY 128
+// NOTE: A JSON value takes 16 bytes. The first 8 pack the type in the
+// lowest bits and the size (length of a string, amount of elements or
+// members) in the rest of them. The second 8 are the payload:
+//
+//   - integers that fit into int64_t are stored as is, any other number
+//     keeps the text of its literal (a pointer into the source);
+//   - strings point to their unescaped bytes;
+//   - arrays and objects point to their elements/members laid out next
+//     to each other in the arena.
+//
+// The representation is private to json.c. Use the accessors below.
+struct Json_Value {
+    uint64_t bits;
+    union {
+        int boolean;
+        int64_t integer;
+        const char *data;
+        const Json_Value *elements;
+        const Json_Member *members;
+    };
+};
 
-typedef struct Json_Array_Page Json_Array_Page;
+struct Json_Member {
+    String key;
+    Json_Value value;
+};
 
-typedef struct {
-    Json_Array_Page *begin;
-    Json_Array_Page *end;
-} Json_Array;
+static_assert(sizeof(Json_Value) == 16, "Json_Value is supposed to be 16 bytes");
 
-void json_array_push(Memory *memory, Json_Array *array, Json_Value value);
+#define JSON_TYPE_BITS 3
+#define JSON_TYPE_MASK ((1 << JSON_TYPE_BITS) - 1)
+// NOTE: set for the numbers that are kept as the text of their literal
+#define JSON_NUMBER_LITERAL (1 << JSON_TYPE_BITS)
+#define JSON_SIZE_SHIFT (JSON_TYPE_BITS + 1)
 
-typedef struct Json_Object_Page Json_Object_Page;
+static inline
+Json_Type json_type(Json_Value value)
+{
+    return (Json_Type) (value.bits & JSON_TYPE_MASK);
+}
 
-typedef struct {
-    Json_Object_Page *begin;
-    Json_Object_Page *end;
-} Json_Object;
+static inline
+size_t json_size(Json_Value value)
+{
+    return (size_t) (value.bits >> JSON_SIZE_SHIFT);
+}
 
-typedef struct {
-    // TODO(#26): because of the use of String-s Json_Number can hold an incorrect value
-    //   But you can only get an incorrect Json_Number if you construct it yourself.
-    //   Anything coming from parse_json_value should be always a correct number.
-    String integer;
-    String fraction;
-    String exponent;
-} Json_Number;
+extern Json_Value json_null;
+extern Json_Value json_true;
+extern Json_Value json_false;
 
-int64_t json_number_to_integer(Json_Number number);
+Json_Value json_string(String string);
+Json_Value json_integer(int64_t integer);
+// NOTE: the elements and the members are not copied
+Json_Value json_array(const Json_Value *elements, size_t count);
+Json_Value json_object(const Json_Member *members, size_t count);
 
-struct Json_Value {
-    Json_Type type;
-    union
-    {
-        int boolean;
-        Json_Number number;
-        String string;
-        Json_Array array;
-        Json_Object object;
-    };
-};
+static inline
+int json_as_boolean(Json_Value value)
+{
+    assert(json_type(value) == JSON_BOOLEAN);
+    return value.boolean;
+}
 
-struct Json_Array_Page {
-    Json_Array_Page *next;
-    size_t size;
-    Json_Value elements[JSON_ARRAY_PAGE_CAPACITY];
-};
+static inline
+String json_as_string(Json_Value value)
+{
+    assert(json_type(value) == JSON_STRING);
+    return string(json_size(value), value.data);
+}
+
+// NOTE: the fraction of the number is dropped. A number that does not
+// fit into int64_t wraps around.
+int64_t json_as_integer(Json_Value value);
 
 static inline
-size_t json_array_size(Json_Array array)
+size_t json_array_size(Json_Value array)
 {
-    size_t size = 0;
-    for (Json_Array_Page *page = array.begin;
-         page != NULL;
-         page = page->next)
-    {
-        size += page->size;
-    }
-    return size;
+    assert(json_type(array) == JSON_ARRAY);
+    return json_size(array);
+}
+
+static inline
+Json_Value json_array_at(Json_Value array, size_t index)
+{
+    assert(index < json_array_size(array));
+    return array.elements[index];
+}
+
+static inline
+size_t json_object_size(Json_Value object)
+{
+    assert(json_type(object) == JSON_OBJECT);
+    return json_size(object);
+}
+
+static inline
+Json_Member json_object_at(Json_Value object, size_t index)
+{
+    assert(index < json_object_size(object));
+    return object.members[index];
 }
 
 typedef struct {
@@ -102,31 +149,137 @@ typedef struct {
     const char *message;
 } Json_Result;
 
+// NOTE: the string literals of the source must be valid UTF-8
+Json_Result parse_json_value(Memory *memory, String source);
+void print_json_error(FILE *stream, Json_Result result, String source, const char *prefix);
+// NOTE: same as print_json_error() for a source that starts at the
+// line first_line of a bigger file
+void print_json_error_at(FILE *stream, Json_Result result, String source, const char *prefix,
+                         size_t first_line);
+void print_json_value(FILE *stream, Json_Value value);
+void print_json_value_fd(int fd, Json_Value value);
+void print_json_value_buffer(Buffer *buffer, Json_Value value);
+void print_json_string_buffer(Buffer *buffer, String string);
+
+// NOTE: On-demand mode. Instead of building the whole tree up front
+// the document is indexed into a tape: one entry per token (brackets,
+// colons, commas and the first byte of every scalar), and every
+// opening bracket knows where its closing one is. Nothing is decoded
+// until it is asked for, and skipping a whole array or object is a
+// single jump:
+//
+//     Json_Tape tape;
+//     Json_Result result = json_tape_index(memory, source, &tape);
+//     if (!result.is_error) result = json_tape_validate(&tape);
+//     ...
+//     Json_Cursor name;
+//     if (json_ondemand_find_field(json_ondemand_root(&tape), SLT("name"), &name)) {
+//         Json_Result value = json_ondemand_value(memory, name);
+//     }
+//
+// The cursors trust the structure of the tape, so only navigate the
+// tapes that passed json_tape_validate().
+
 typedef struct {
-    String key;
-    Json_Value value;
-} Json_Object_Member;
+    uint32_t offset;
+    union {
+        // NOTE: for the opening brackets, the index of the matching
+        // closing one
+        uint32_t match;
+        // NOTE: for the scalars, the size of the token (with the quotes
+        // for the strings)
+        uint32_t length;
+    };
+} Json_Tape_Entry;
 
-#define JSON_OBJECT_PAGE_CAPACITY 128
+typedef struct {
+    String source;
+    const Json_Tape_Entry *entries;
+    size_t count;
+} Json_Tape;
 
-extern Json_Value json_null;
-extern Json_Value json_true;
-extern Json_Value json_false;
+// NOTE: the first stage. Finds the tokens and matches the brackets, but
+// does not check the grammar nor the scalars. The only thing it
+// allocates is the tape, 8 bytes per token.
+Json_Result json_tape_index(Memory *memory, String source, Json_Tape *tape);
+// NOTE: the second stage. Checks the tape against the JSON grammar and
+// the scalars against the same rules parse_json_value() uses, without
+// allocating anything.
+Json_Result json_tape_validate(const Json_Tape *tape);
 
-Json_Value json_string(String string);
+typedef struct {
+    const Json_Tape *tape;
+    size_t index;
+} Json_Cursor;
 
-struct Json_Object_Page {
-    Json_Object_Page *next;
-    size_t size;
-    Json_Object_Member elements[JSON_OBJECT_PAGE_CAPACITY];
-};
+static inline
+Json_Cursor json_ondemand_root(const Json_Tape *tape)
+{
+    assert(tape);
+    assert(tape->count > 0);
+    return (Json_Cursor) { .tape = tape, .index = 0 };
+}
 
-void json_object_push(Memory *memory, Json_Object *object, String key, Json_Value value);
+Json_Type json_ondemand_type(Json_Cursor cursor);
+// NOTE: the key is compared to the bytes of the source as they are,
+// the escape sequences of the keys are not decoded
+int json_ondemand_find_field(Json_Cursor object, String key, Json_Cursor *value);
+// NOTE: iterates the elements of an array:
+//
+//     Json_Cursor element;
+//     for (int ok = json_ondemand_first(array, &element); ok; ok = json_ondemand_next(&element)) {
+//         ...
+//     }
+int json_ondemand_first(Json_Cursor array, Json_Cursor *element);
+int json_ondemand_next(Json_Cursor *element);
+// NOTE: decodes the value under the cursor into a Json_Value
+Json_Result json_ondemand_value(Memory *memory, Json_Cursor cursor);
 
-// TODO(#40): parse_json_value is not aware of input encoding
-Json_Result parse_json_value(Memory *memory, String source);
-void print_json_error(FILE *stream, Json_Result result, String source, const char *prefix);
-void print_json_value(FILE *stream, Json_Value value);
-void print_json_value_fd(int fd, Json_Value value);
+// NOTE: Streaming JSON writer. Writes the values straight into the
+// buffer as they come, without building a Json_Value first. The
+// writer keeps track of the nesting and puts the commas and the colons
+// where they belong, so the caller only says what comes next:
+//
+//     Json_Writer writer = json_writer(buffer);
+//     json_begin_object(&writer);
+//     json_key(&writer, SLT("id"));
+//     json_write_int(&writer, 69);
+//     json_end_object(&writer);
+//
+// It does not allocate anything besides the buffer itself.
+
+#define JSON_WRITER_DEPTH_MAX 64
+
+typedef struct {
+    Buffer *buffer;
+    size_t depth;
+    // NOTE: bit i is set when the container at depth i already has an
+    // element, so the next one needs a comma
+    uint64_t nonempty;
+    int after_key;
+} Json_Writer;
+
+static inline
+Json_Writer json_writer(Buffer *buffer)
+{
+    assert(buffer);
+    return (Json_Writer) { .buffer = buffer };
+}
+
+void json_begin_object(Json_Writer *writer);
+void json_end_object(Json_Writer *writer);
+void json_begin_array(Json_Writer *writer);
+void json_end_array(Json_Writer *writer);
+void json_key(Json_Writer *writer, String key);
+void json_write_null(Json_Writer *writer);
+void json_write_boolean(Json_Writer *writer, int boolean);
+void json_write_int(Json_Writer *writer, int64_t x);
+void json_write_string(Json_Writer *writer, String string);
+// NOTE: writes an already built Json_Value as a single element
+void json_write_value(Json_Writer *writer, Json_Value value);
+// NOTE: puts the comma before the next element, if needed. Call it
+// before writing an already serialized value straight into
+// writer->buffer.
+void json_writer_element(Json_Writer *writer);
 
 #endif  // JSON_H_
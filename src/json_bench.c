@@ -0,0 +1,410 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "json.h"
+
+// NOTE: Microbenchmark of the JSON parser and printers. It generates a
+// bunch of synthetic corpora that stress different parts of json.c,
+// parses (also through the tape) and prints every one of them over and
+// over again and reports the throughput in MB of the corpus per second
+// together with the amount of arena memory the parsed value takes per
+// byte of the input.
+// Run it before and after touching json.c.
+
+#define CORPUS_MEMORY_CAPACITY (256 * MEGA)
+#define PARSE_MEMORY_CAPACITY (1024 * MEGA)
+#define PRINT_MEMORY_CAPACITY (256 * MEGA)
+
+#define BENCH_MIN_SECONDS 0.5
+#define BENCH_MAX_ITERATIONS 1000
+
+typedef struct {
+    const char *name;
+    String content;
+} Corpus;
+
+static
+double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+// NOTE: tiny deterministic PRNG, so the corpora are the same on every run
+static uint64_t random_state = 0x9E3779B97F4A7C15ull;
+
+static
+uint32_t random_u32(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return (uint32_t) random_state;
+}
+
+static
+void generate_deep_nesting(Buffer *buffer, size_t size)
+{
+    // NOTE: one level is reserved for the outer array
+    const size_t depth = JSON_DEPTH_MAX_LIMIT - 2;
+
+    buffer_append_char(buffer, '[');
+    for (int first = 1; buffer->size < size; first = 0) {
+        if (!first) buffer_append_char(buffer, ',');
+        for (size_t i = 0; i < depth; ++i) {
+            buffer_append_cstr(buffer, i % 2 ? "{\"k\":" : "[");
+        }
+        buffer_append_u64(buffer, random_u32() % 1000);
+        for (size_t i = depth; i > 0; --i) {
+            buffer_append_char(buffer, (i - 1) % 2 ? '}' : ']');
+        }
+    }
+    buffer_append_char(buffer, ']');
+}
+
+static
+void generate_long_strings(Buffer *buffer, size_t size)
+{
+    static const char *const pieces[] = {
+        "The quick brown fox jumps over the lazy dog. ",
+        "\\n", "\\t", "\\\"", "\\\\", "\\/", "\\r", "\\b", "\\f",
+        "\\u00e9", "\\u0442\\u0435\\u0441\\u0442", "\\uD83D\\uDE00",
+        "\xd0\xbf\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82 ",
+        "Lorem ipsum dolor sit amet, consectetur adipiscing elit. ",
+    };
+    const size_t pieces_count = sizeof(pieces) / sizeof(pieces[0]);
+
+    buffer_append_char(buffer, '[');
+    for (int first = 1; buffer->size < size; first = 0) {
+        if (!first) buffer_append_char(buffer, ',');
+        buffer_append_char(buffer, '"');
+        const size_t length = 1024 + random_u32() % (8 * 1024);
+        const size_t begin = buffer->size;
+        while (buffer->size - begin < length) {
+            // NOTE: mostly plain text with an escape here and there
+            const uint32_t r = random_u32();
+            buffer_append_cstr(buffer, pieces[r % 4 == 0 ? 1 + r / 4 % (pieces_count - 1) : 0]);
+        }
+        buffer_append_char(buffer, '"');
+    }
+    buffer_append_char(buffer, ']');
+}
+
+static
+void generate_numbers(Buffer *buffer, size_t size)
+{
+    buffer_append_char(buffer, '[');
+    for (int first = 1; buffer->size < size; first = 0) {
+        if (!first) buffer_append_char(buffer, ',');
+        const uint32_t r = random_u32();
+        switch (r % 4) {
+        case 0:
+            buffer_append_u64(buffer, r >> 8);
+            break;
+        case 1:
+            buffer_append_i64(buffer, -(int64_t) (r >> 4));
+            break;
+        case 2:
+            buffer_append_u64(buffer, r % 100000);
+            buffer_append_char(buffer, '.');
+            buffer_append_u64(buffer, random_u32());
+            break;
+        default:
+            buffer_append_char(buffer, '-');
+            buffer_append_u64(buffer, r % 10);
+            buffer_append_char(buffer, '.');
+            buffer_append_u64(buffer, random_u32() % 1000000);
+            buffer_append_cstr(buffer, r & 0x100 ? "e-" : "E+");
+            buffer_append_u64(buffer, r % 300);
+        }
+    }
+    buffer_append_char(buffer, ']');
+}
+
+static
+void generate_wide_objects(Buffer *buffer, size_t size)
+{
+    const size_t width = 1000;
+
+    buffer_append_char(buffer, '[');
+    for (int first = 1; buffer->size < size; first = 0) {
+        if (!first) buffer_append_char(buffer, ',');
+        buffer_append_char(buffer, '{');
+        for (size_t i = 0; i < width; ++i) {
+            if (i > 0) buffer_append_char(buffer, ',');
+            buffer_append_cstr(buffer, "\"field_");
+            buffer_append_u64(buffer, i);
+            buffer_append_cstr(buffer, "\":");
+            switch (random_u32() % 5) {
+            case 0: buffer_append_cstr(buffer, "null"); break;
+            case 1: buffer_append_cstr(buffer, "true"); break;
+            case 2: buffer_append_cstr(buffer, "false"); break;
+            case 3: buffer_append_u64(buffer, random_u32()); break;
+            default: buffer_append_cstr(buffer, "\"value\"");
+            }
+        }
+        buffer_append_char(buffer, '}');
+    }
+    buffer_append_char(buffer, ']');
+}
+
+// NOTE: the real schedule repeated until it gets to the requested size
+static
+int generate_schedule(Buffer *buffer, size_t size, const char *filepath)
+{
+    int fd = open(filepath, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "[WARN] Could not open %s: %s. Skipping the schedule corpus.\n",
+                filepath, strerror(errno));
+        return -1;
+    }
+
+    struct stat fd_stat;
+    if (fstat(fd, &fd_stat) < 0 || fd_stat.st_size == 0) {
+        close(fd);
+        return -1;
+    }
+
+    String schedule = string((size_t) fd_stat.st_size,
+                             mmap(NULL, (size_t) fd_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0));
+    close(fd);
+    if (schedule.data == MAP_FAILED) {
+        return -1;
+    }
+    schedule = trim(schedule);
+
+    buffer_append_char(buffer, '[');
+    for (int first = 1; buffer->size < size; first = 0) {
+        if (!first) buffer_append_char(buffer, ',');
+        buffer_append_string(buffer, schedule);
+    }
+    buffer_append_char(buffer, ']');
+
+    munmap((void *) schedule.data, (size_t) fd_stat.st_size);
+    return 0;
+}
+
+typedef struct {
+    double best;
+    size_t iterations;
+} Timing;
+
+#define BENCH(timing, ...)                                              \
+    do {                                                                \
+        (timing).best = 0.0;                                            \
+        (timing).iterations = 0;                                        \
+        double total__ = 0.0;                                           \
+        while ((timing).iterations < BENCH_MAX_ITERATIONS               \
+               && total__ < BENCH_MIN_SECONDS) {                        \
+            const double begin__ = now_seconds();                       \
+            __VA_ARGS__;                                                \
+            const double elapsed__ = now_seconds() - begin__;           \
+            if ((timing).iterations == 0 || elapsed__ < (timing).best) { \
+                (timing).best = elapsed__;                              \
+            }                                                           \
+            total__ += elapsed__;                                       \
+            (timing).iterations += 1;                                   \
+        }                                                               \
+    } while (0)
+
+static
+double mb_per_second(size_t bytes, Timing timing)
+{
+    return (double) bytes / (1000.0 * 1000.0) / timing.best;
+}
+
+static
+void bench_corpus(Corpus corpus, Memory *parse_memory, Memory *print_memory,
+                  FILE *null_stream, int null_fd)
+{
+    Json_Result result = {0};
+    Timing parse_timing;
+    BENCH(parse_timing, {
+        memory_clean(parse_memory);
+        result = parse_json_value(parse_memory, corpus.content);
+    });
+
+    if (result.is_error || trim_begin(result.rest).len > 0) {
+        print_json_error(stderr, result, corpus.content, corpus.name);
+        exit(1);
+    }
+    const size_t arena_used = parse_memory->size;
+
+    // NOTE: the on-demand mode: both stages, no values built. The parsed
+    // value is still needed, so the tape goes to the print memory.
+    Timing tape_timing;
+    BENCH(tape_timing, {
+        memory_clean(print_memory);
+        Json_Tape tape;
+        Json_Result tape_result = json_tape_index(print_memory, corpus.content, &tape);
+        if (!tape_result.is_error) {
+            tape_result = json_tape_validate(&tape);
+        }
+        if (tape_result.is_error) {
+            print_json_error(stderr, tape_result, corpus.content, corpus.name);
+            exit(1);
+        }
+    });
+
+    Buffer buffer = buffer_of_memory(print_memory);
+    Timing buffer_timing;
+    BENCH(buffer_timing, {
+        memory_clean(print_memory);
+        buffer = buffer_of_memory(print_memory);
+        print_json_value_buffer(&buffer, result.value);
+    });
+
+    // NOTE: whatever is printed must parse back into the same thing,
+    // otherwise the numbers above mean nothing
+    {
+        Memory check_memory = {
+            .capacity = PARSE_MEMORY_CAPACITY,
+            .buffer = malloc(PARSE_MEMORY_CAPACITY),
+        };
+        assert(check_memory.buffer);
+        Json_Result check = parse_json_value(&check_memory, buffer_as_string(buffer));
+        if (check.is_error) {
+            print_json_error(stderr, check, buffer_as_string(buffer), corpus.name);
+            exit(1);
+        }
+        Buffer again = buffer_of_memory(&check_memory);
+        print_json_value_buffer(&again, check.value);
+        if (again.size != buffer.size || memcmp(again.data, buffer.data, buffer.size) != 0) {
+            fprintf(stderr, "%s: printed JSON does not survive the round trip\n", corpus.name);
+            exit(1);
+        }
+        free(check_memory.buffer);
+    }
+
+    Timing stream_timing;
+    BENCH(stream_timing, {
+        print_json_value(null_stream, result.value);
+        fflush(null_stream);
+    });
+
+    Timing fd_timing;
+    BENCH(fd_timing, {
+        print_json_value_fd(null_fd, result.value);
+    });
+
+    printf("%-16s %10.2f %12.2f %10.2f %10.2f %10.2f %10.2f %12.2f\n",
+           corpus.name,
+           (double) corpus.content.len / (1000.0 * 1000.0),
+           mb_per_second(corpus.content.len, parse_timing),
+           mb_per_second(corpus.content.len, tape_timing),
+           mb_per_second(corpus.content.len, buffer_timing),
+           mb_per_second(corpus.content.len, stream_timing),
+           mb_per_second(corpus.content.len, fd_timing),
+           (double) arena_used / (double) corpus.content.len);
+    fflush(stdout);
+}
+
+static
+void usage(FILE *stream)
+{
+    fprintf(stream,
+            "json_bench [-s <megabytes>] [-f <schedule.json>] [corpus...]\n"
+            "    -s <megabytes>     approximate size of every corpus (default 4)\n"
+            "    -f <schedule.json> the file the schedule corpus is made of (default ./schedule.json)\n"
+            "    corpus             deep_nesting, long_strings, numbers, wide_objects, schedule (default all)\n");
+}
+
+int main(int argc, char *argv[])
+{
+    size_t size = 4 * 1000 * 1000;
+    const char *schedule_filepath = "./schedule.json";
+
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; ++arg) {
+        if (arg + 1 < argc && strcmp(argv[arg], "-s") == 0) {
+            size = (size_t) (strtod(argv[++arg], NULL) * 1000.0 * 1000.0);
+        } else if (arg + 1 < argc && strcmp(argv[arg], "-f") == 0) {
+            schedule_filepath = argv[++arg];
+        } else {
+            usage(stderr);
+            exit(1);
+        }
+    }
+
+    if (size == 0) {
+        usage(stderr);
+        exit(1);
+    }
+
+    Memory corpus_memory = {
+        .capacity = CORPUS_MEMORY_CAPACITY,
+        .buffer = malloc(CORPUS_MEMORY_CAPACITY),
+    };
+    Memory parse_memory = {
+        .capacity = PARSE_MEMORY_CAPACITY,
+        .buffer = malloc(PARSE_MEMORY_CAPACITY),
+    };
+    Memory print_memory = {
+        .capacity = PRINT_MEMORY_CAPACITY,
+        .buffer = malloc(PRINT_MEMORY_CAPACITY),
+    };
+    assert(corpus_memory.buffer);
+    assert(parse_memory.buffer);
+    assert(print_memory.buffer);
+
+    FILE *null_stream = fopen("/dev/null", "w");
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_stream == NULL || null_fd < 0) {
+        fprintf(stderr, "Could not open /dev/null: %s\n", strerror(errno));
+        exit(1);
+    }
+
+    const char *names[] = {"deep_nesting", "long_strings", "numbers", "wide_objects", "schedule"};
+    const size_t names_count = sizeof(names) / sizeof(names[0]);
+
+    printf("%-16s %10s %12s %10s %10s %10s %10s %12s\n",
+           "corpus", "size MB", "parse MB/s", "tape", "buffer", "FILE", "fd", "arena/byte");
+
+    for (size_t i = 0; i < names_count; ++i) {
+        if (arg < argc) {
+            int selected = 0;
+            for (int j = arg; j < argc; ++j) {
+                selected = selected || strcmp(argv[j], names[i]) == 0;
+            }
+            if (!selected) continue;
+        }
+
+        memory_clean(&corpus_memory);
+        Buffer buffer = buffer_of_memory(&corpus_memory);
+
+        switch (i) {
+        // NOTE: every nested array or object takes a whole page of the
+        // arena, so the deep nesting corpus is way smaller than the rest
+        // to fit into the PARSE_MEMORY_CAPACITY
+        case 0: generate_deep_nesting(&buffer, size / 64); break;
+        case 1: generate_long_strings(&buffer, size); break;
+        case 2: generate_numbers(&buffer, size); break;
+        case 3: generate_wide_objects(&buffer, size); break;
+        case 4: {
+            if (generate_schedule(&buffer, size, schedule_filepath) < 0) {
+                continue;
+            }
+        } break;
+        }
+
+        Corpus corpus = {
+            .name = names[i],
+            .content = buffer_as_string(buffer),
+        };
+        bench_corpus(corpus, &parse_memory, &print_memory, null_stream, null_fd);
+    }
+
+    return 0;
+}
@@ -1,6 +1,9 @@
+#define _DEFAULT_SOURCE
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 
 #include <sys/mman.h>
 #include <sys/types.h>
@@ -10,13 +13,25 @@
 
 #include "json.h"
 
-#define MEMORY_CAPACITY (10 * 1000 * 1000)
+// NOTE: Checks that a file is a valid JSON document. The document is
+// validated through the tape, so no values are built and the memory
+// is mostly the tape itself. When a path is given the value at the
+// path is printed:
+//
+//     json_check schedule.json projects 0 name
+//
+// With -l the file is JSON Lines instead: every line is a document of
+// its own. The file is split into a chunk per thread at the line
+// boundaries, every thread validates its lines in its own arena and
+// the errors are reported in the order of the lines.
 
-static uint8_t memory_buffer[MEMORY_CAPACITY];
-static Memory memory = {
-    .capacity = MEMORY_CAPACITY,
-    .buffer = memory_buffer,
-};
+// NOTE: the memory for the values printed at the path
+#define VALUE_MEMORY_CAPACITY (10 * 1000 * 1000)
+// NOTE: the arena of every thread in the JSON Lines mode. A line is
+// limited to a tape of that size, which is millions of tokens. The
+// pages that are not touched are never backed.
+#define LINE_MEMORY_CAPACITY (256 * MEGA)
+#define THREADS_CAPACITY 256
 
 String mmap_file_to_string(const char *filepath)
 {
@@ -27,19 +42,253 @@ String mmap_file_to_string(const char *filepath)
     int err = fstat(fd, &fd_stat);
     assert(err == 0);
 
+    // NOTE: mmap() of nothing fails, an empty file is just an empty
+    // string. It is an empty JSON Lines file or a JSON document with a
+    // parsing error.
+    if (fd_stat.st_size == 0) {
+        close(fd);
+        return SLT("");
+    }
+
     String result;
     result.len = fd_stat.st_size;
     result.data = mmap(NULL, result.len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
     assert(result.data != MAP_FAILED);
+    madvise((void *) result.data, result.len, MADV_SEQUENTIAL);
     close(fd);
 
     return result;
 }
 
+static
+int find_path(Json_Cursor *cursor, int path_count, char *path[])
+{
+    for (int i = 0; i < path_count; ++i) {
+        const Json_Type type = json_ondemand_type(*cursor);
+
+        if (type == JSON_OBJECT) {
+            if (!json_ondemand_find_field(*cursor, cstr_as_string(path[i]), cursor)) {
+                fprintf(stderr, "No field `%s'\n", path[i]);
+                return -1;
+            }
+        } else if (type == JSON_ARRAY) {
+            char *endptr = NULL;
+            unsigned long index = strtoul(path[i], &endptr, 10);
+            if (endptr == path[i] || *endptr != '\0') {
+                fprintf(stderr, "`%s' is not an index of an array\n", path[i]);
+                return -1;
+            }
+
+            int ok = json_ondemand_first(*cursor, cursor);
+            for (; ok && index > 0; --index) {
+                ok = json_ondemand_next(cursor);
+            }
+            if (!ok) {
+                fprintf(stderr, "No element %s\n", path[i]);
+                return -1;
+            }
+        } else {
+            fprintf(stderr, "Can't look up `%s' in %s\n", path[i], json_type_as_cstr(type));
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+typedef struct {
+    String line;
+    // NOTE: the line number relative to the beginning of the chunk
+    size_t line_number;
+    Json_Result result;
+} Line_Error;
+
+typedef struct {
+    pthread_t thread;
+    String chunk;
+    Memory memory;
+
+    size_t lines_count;
+    Line_Error *errors;
+    size_t errors_count;
+    size_t errors_capacity;
+} Chunk;
+
+static
+void chunk_push_error(Chunk *chunk, Line_Error error)
+{
+    if (chunk->errors_count >= chunk->errors_capacity) {
+        chunk->errors_capacity = chunk->errors_capacity ? chunk->errors_capacity * 2 : 64;
+        chunk->errors = realloc(chunk->errors, chunk->errors_capacity * sizeof(chunk->errors[0]));
+        assert(chunk->errors);
+    }
+    chunk->errors[chunk->errors_count++] = error;
+}
+
+static
+void *check_chunk(void *arg)
+{
+    Chunk *chunk = arg;
+    String input = chunk->chunk;
+
+    while (input.len > 0) {
+        String line = chop_line(&input);
+        chunk->lines_count += 1;
+
+        if (line.len > 0 && line.data[line.len - 1] == '\r') {
+            line.len -= 1;
+        }
+
+        // NOTE: the blank lines are skipped, the one after the final
+        // newline in particular
+        if (trim_begin(line).len == 0) {
+            continue;
+        }
+
+        memory_clean(&chunk->memory);
+        Json_Tape tape;
+        Json_Result result = json_tape_index(&chunk->memory, line, &tape);
+        if (!result.is_error) {
+            result = json_tape_validate(&tape);
+        }
+
+        if (result.is_error) {
+            chunk_push_error(chunk, (Line_Error) {
+                .line = line,
+                .line_number = chunk->lines_count,
+                .result = result,
+            });
+        }
+    }
+
+    return NULL;
+}
+
+static
+int check_json_lines(const char *filepath, String content, size_t threads_count)
+{
+    assert(0 < threads_count && threads_count <= THREADS_CAPACITY);
+
+    static Chunk chunks[THREADS_CAPACITY];
+
+    // NOTE: the chunks are cut at the first newline after an even split,
+    // so a chunk may end up empty on a file of few long lines
+    size_t begin = 0;
+    for (size_t i = 0; i < threads_count; ++i) {
+        size_t end = content.len * (i + 1) / threads_count;
+        if (end < begin) end = begin;
+        while (end < content.len && (end == 0 || content.data[end - 1] != '\n')) {
+            end += 1;
+        }
+
+        chunks[i].chunk = string(end - begin, content.data + begin);
+        chunks[i].memory = (Memory) {
+            .capacity = LINE_MEMORY_CAPACITY,
+            .buffer = malloc(LINE_MEMORY_CAPACITY),
+        };
+        assert(chunks[i].memory.buffer);
+
+        int err = pthread_create(&chunks[i].thread, NULL, check_chunk, &chunks[i]);
+        if (err != 0) {
+            fprintf(stderr, "Could not start a thread: %s\n", strerror(err));
+            exit(1);
+        }
+
+        begin = end;
+    }
+
+    size_t lines_before = 0;
+    size_t errors_count = 0;
+    for (size_t i = 0; i < threads_count; ++i) {
+        pthread_join(chunks[i].thread, NULL);
+
+        for (size_t j = 0; j < chunks[i].errors_count; ++j) {
+            const Line_Error *error = &chunks[i].errors[j];
+            print_json_error_at(stderr, error->result, error->line, filepath,
+                                lines_before + error->line_number);
+        }
+
+        lines_before += chunks[i].lines_count;
+        errors_count += chunks[i].errors_count;
+
+        free(chunks[i].errors);
+        free(chunks[i].memory.buffer);
+    }
+
+    return errors_count > 0;
+}
+
+static
+void usage(FILE *stream)
+{
+    fprintf(stream,
+            "json_check <file.json> [<field-or-index>...]\n"
+            "json_check -l [-j <threads>] <file.jsonl>\n");
+}
+
 int main(int argc, char *argv[])
 {
-    assert(argc >= 2);
-    String file_content = mmap_file_to_string(argv[1]);
-    Json_Result result = parse_json_value(&memory, file_content);
-    return result.is_error || trim_begin(result.rest).len > 0;
+    int json_lines = 0;
+    long threads_count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; ++arg) {
+        if (strcmp(argv[arg], "-l") == 0) {
+            json_lines = 1;
+        } else if (strcmp(argv[arg], "-j") == 0 && arg + 1 < argc) {
+            threads_count = strtol(argv[++arg], NULL, 10);
+        } else {
+            usage(stderr);
+            return 1;
+        }
+    }
+
+    if (arg >= argc || threads_count <= 0) {
+        usage(stderr);
+        return 1;
+    }
+
+    if (threads_count > THREADS_CAPACITY) {
+        threads_count = THREADS_CAPACITY;
+    }
+
+    const char *filepath = argv[arg++];
+    String file_content = mmap_file_to_string(filepath);
+
+    if (json_lines) {
+        return check_json_lines(filepath, file_content, (size_t) threads_count);
+    }
+
+    // NOTE: the tape takes 8 bytes per token and a token takes at least
+    // a byte. The pages that are not touched are never backed.
+    Memory memory = {
+        .capacity = (file_content.len + 1) * sizeof(Json_Tape_Entry) + VALUE_MEMORY_CAPACITY,
+    };
+    memory.buffer = malloc(memory.capacity);
+    assert(memory.buffer);
+
+    Json_Tape tape;
+    Json_Result result = json_tape_index(&memory, file_content, &tape);
+    if (!result.is_error) {
+        result = json_tape_validate(&tape);
+    }
+
+    if (result.is_error) {
+        print_json_error(stderr, result, file_content, filepath);
+        return 1;
+    }
+
+    if (arg < argc) {
+        Json_Cursor cursor = json_ondemand_root(&tape);
+        if (find_path(&cursor, argc - arg, argv + arg) < 0) {
+            return 1;
+        }
+
+        Json_Result value = json_ondemand_value(&memory, cursor);
+        assert(!value.is_error);
+        print_json_value(stdout, value.value);
+        fputc('\n', stdout);
+    }
+
+    return 0;
 }
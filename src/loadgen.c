@@ -0,0 +1,488 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// NOTE: A small HTTP/1.1 load generator for benchmarking skedudle. It
+// keeps a fixed amount of connections busy with one request in flight
+// per connection for the given duration, measures the latency of every
+// response and prints a JSON object per benchmarked path to stdout, so
+// the results can be collected and compared between the revisions. A
+// human readable summary goes to stderr.
+
+#define LOADGEN_HEAD_CAPACITY (8 * 1024)
+#define LOADGEN_READ_CAPACITY (64 * 1024)
+#define LOADGEN_CONNECT_ATTEMPTS 50
+#define LOADGEN_EVENTS_CAPACITY 256
+
+// NOTE: Log-linear histogram of the latencies in microseconds. Every
+// power of 2 is split into 32 buckets, so the error of any reported
+// percentile is under ~3% no matter the magnitude.
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_SUB (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_SIZE ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB)
+
+typedef struct {
+    uint64_t counts[HISTOGRAM_SIZE];
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+} Histogram;
+
+static
+size_t histogram_index(uint64_t value)
+{
+    if (value < HISTOGRAM_SUB) {
+        return value;
+    }
+
+    const size_t msb = 63 - (size_t) __builtin_clzll(value);
+    const size_t shift = msb - HISTOGRAM_SUB_BITS;
+    return (shift + 1) * HISTOGRAM_SUB + (size_t) ((value >> shift) - HISTOGRAM_SUB);
+}
+
+// NOTE: the highest value that falls into the bucket
+static
+uint64_t histogram_bucket_max(size_t index)
+{
+    if (index < HISTOGRAM_SUB) {
+        return index;
+    }
+
+    const size_t shift = index / HISTOGRAM_SUB - 1;
+    const uint64_t low = (uint64_t) (HISTOGRAM_SUB + index % HISTOGRAM_SUB) << shift;
+    return low + ((uint64_t) 1 << shift) - 1;
+}
+
+static
+void histogram_record(Histogram *histogram, uint64_t value)
+{
+    if (histogram->total == 0 || value < histogram->min) histogram->min = value;
+    if (value > histogram->max) histogram->max = value;
+    histogram->counts[histogram_index(value)] += 1;
+    histogram->total += 1;
+}
+
+static
+uint64_t histogram_percentile(const Histogram *histogram, double percentile)
+{
+    if (histogram->total == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t) (percentile / 100.0 * (double) histogram->total + 0.5);
+    if (rank == 0) rank = 1;
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HISTOGRAM_SIZE; ++i) {
+        seen += histogram->counts[i];
+        if (seen >= rank) {
+            const uint64_t result = histogram_bucket_max(i);
+            return result < histogram->max ? result : histogram->max;
+        }
+    }
+
+    return histogram->max;
+}
+
+typedef struct {
+    int fd;
+    uint64_t sent_at;
+
+    char head[LOADGEN_HEAD_CAPACITY];
+    size_t head_size;
+    int head_complete;
+    int status;
+    // NOTE: -1 when the response has no Content-Length and ends with
+    // the connection
+    long long body_remaining;
+} Connection;
+
+typedef struct {
+    struct sockaddr_in addr;
+    int epoll_fd;
+    int keep_alive;
+
+    char request[1024];
+    size_t request_size;
+
+    uint64_t responses;
+    uint64_t non_2xx;
+    uint64_t errors;
+    uint64_t bytes;
+    Histogram latency;
+} Loadgen;
+
+static
+uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static
+int write_all(int fd, const char *data, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        size -= (size_t) n;
+    }
+    return 0;
+}
+
+static
+int loadgen_connect(Loadgen *loadgen, Connection *connection, size_t index)
+{
+    // NOTE: the server may still be starting up, so the refused
+    // connections are retried for a little while
+    for (int attempt = 0; attempt < LOADGEN_CONNECT_ATTEMPTS; ++attempt) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) {
+            return -1;
+        }
+
+        if (connect(fd, (struct sockaddr *) &loadgen->addr, sizeof(loadgen->addr)) == 0) {
+            int option = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &option, sizeof(option));
+
+            struct epoll_event event = {
+                .events = EPOLLIN,
+                .data.u64 = index,
+            };
+            if (epoll_ctl(loadgen->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+                close(fd);
+                return -1;
+            }
+
+            connection->fd = fd;
+            return 0;
+        }
+
+        close(fd);
+        if (errno != ECONNREFUSED) {
+            return -1;
+        }
+        usleep(100 * 1000);
+    }
+
+    return -1;
+}
+
+static
+void loadgen_disconnect(Loadgen *loadgen, Connection *connection)
+{
+    epoll_ctl(loadgen->epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+    close(connection->fd);
+    connection->fd = -1;
+}
+
+static
+int loadgen_send(Loadgen *loadgen, Connection *connection)
+{
+    connection->head_size = 0;
+    connection->head_complete = 0;
+    connection->status = 0;
+    connection->body_remaining = -1;
+    connection->sent_at = now_ns();
+    return write_all(connection->fd, loadgen->request, loadgen->request_size);
+}
+
+// NOTE: parses the status line and Content-Length out of the complete
+// head. Returns the size of the head or 0 if it is not complete yet.
+static
+size_t connection_parse_head(Connection *connection)
+{
+    const char *end = memmem(connection->head, connection->head_size, "\r\n\r\n", 4);
+    if (end == NULL) {
+        return 0;
+    }
+    const size_t head_size = (size_t) (end - connection->head) + 4;
+
+    connection->status = 0;
+    if (connection->head_size > 12 && memcmp(connection->head, "HTTP/1.", 7) == 0) {
+        connection->status = atoi(connection->head + 9);
+    }
+
+    connection->body_remaining = -1;
+    const char *line = connection->head;
+    while (line < end) {
+        const char *eol = memmem(line, (size_t) (end - line) + 2, "\r\n", 2);
+        assert(eol);
+        const size_t field = sizeof("Content-Length:") - 1;
+        if ((size_t) (eol - line) > field && strncasecmp(line, "Content-Length:", field) == 0) {
+            connection->body_remaining = strtoll(line + field, NULL, 10);
+        }
+        line = eol + 2;
+    }
+
+    return head_size;
+}
+
+// NOTE: feeds the received bytes into the current response. Returns 1
+// when the response is complete.
+static
+int connection_receive(Connection *connection, const char *data, size_t size)
+{
+    if (!connection->head_complete) {
+        const size_t received = connection->head_size;
+        const size_t room = LOADGEN_HEAD_CAPACITY - connection->head_size;
+        const size_t n = size < room ? size : room;
+        memcpy(connection->head + connection->head_size, data, n);
+        connection->head_size += n;
+
+        const size_t head_size = connection_parse_head(connection);
+        if (head_size == 0) {
+            return 0;
+        }
+        connection->head_complete = 1;
+
+        // NOTE: whatever came after the head is the beginning of the body
+        size -= head_size - received;
+    }
+
+    if (connection->body_remaining >= 0) {
+        connection->body_remaining -= (long long) size;
+        return connection->body_remaining <= 0;
+    }
+
+    return 0;
+}
+
+static
+void loadgen_complete(Loadgen *loadgen, Connection *connection)
+{
+    const uint64_t latency_us = (now_ns() - connection->sent_at) / 1000;
+    histogram_record(&loadgen->latency, latency_us);
+    loadgen->responses += 1;
+    if (connection->status < 200 || connection->status >= 300) {
+        loadgen->non_2xx += 1;
+    }
+}
+
+static
+int loadgen_restart(Loadgen *loadgen, Connection *connections, size_t index)
+{
+    Connection *connection = &connections[index];
+    if (connection->fd >= 0) {
+        loadgen_disconnect(loadgen, connection);
+    }
+
+    if (loadgen_connect(loadgen, connection, index) < 0 || loadgen_send(loadgen, connection) < 0) {
+        fprintf(stderr, "Could not connect to the server: %s\n", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+static
+int loadgen_run(Loadgen *loadgen, Connection *connections, size_t connections_count, double duration)
+{
+    for (size_t i = 0; i < connections_count; ++i) {
+        connections[i].fd = -1;
+        if (loadgen_restart(loadgen, connections, i) < 0) {
+            return -1;
+        }
+    }
+
+    static char buffer[LOADGEN_READ_CAPACITY];
+    struct epoll_event events[LOADGEN_EVENTS_CAPACITY];
+
+    const uint64_t deadline = now_ns() + (uint64_t) (duration * 1e9);
+    while (now_ns() < deadline) {
+        int n = epoll_wait(loadgen->epoll_fd, events, LOADGEN_EVENTS_CAPACITY, 100);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            const size_t index = events[i].data.u64;
+            Connection *connection = &connections[index];
+
+            ssize_t size = read(connection->fd, buffer, sizeof(buffer));
+            if (size < 0 && errno == EAGAIN) {
+                continue;
+            }
+
+            if (size <= 0) {
+                // NOTE: the responses without Content-Length end here,
+                // anything else is a connection lost in the middle
+                if (size == 0 && connection->head_complete && connection->body_remaining < 0) {
+                    loadgen_complete(loadgen, connection);
+                } else {
+                    loadgen->errors += 1;
+                }
+
+                if (loadgen_restart(loadgen, connections, index) < 0) {
+                    return -1;
+                }
+                continue;
+            }
+
+            loadgen->bytes += (uint64_t) size;
+
+            if (connection_receive(connection, buffer, (size_t) size)) {
+                loadgen_complete(loadgen, connection);
+
+                int result = 0;
+                if (loadgen->keep_alive) {
+                    result = loadgen_send(loadgen, connection);
+                    if (result < 0) {
+                        loadgen->errors += 1;
+                        result = loadgen_restart(loadgen, connections, index);
+                    }
+                } else {
+                    result = loadgen_restart(loadgen, connections, index);
+                }
+
+                if (result < 0) {
+                    return -1;
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < connections_count; ++i) {
+        if (connections[i].fd >= 0) {
+            loadgen_disconnect(loadgen, &connections[i]);
+        }
+    }
+
+    return 0;
+}
+
+static
+void usage(FILE *stream)
+{
+    fprintf(stream,
+            "loadgen [options] <port> <path>...\n"
+            "    -a <address>      address of the server (default 127.0.0.1)\n"
+            "    -c <connections>  concurrent connections (default 64)\n"
+            "    -d <seconds>      duration of every path (default 5)\n"
+            "    -k                keep-alive connections (default)\n"
+            "    -C                a new connection for every request\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *addr = "127.0.0.1";
+    size_t connections_count = 64;
+    double duration = 5.0;
+    int keep_alive = 1;
+
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; ++arg) {
+        const char *flag = argv[arg];
+        if (strcmp(flag, "-k") == 0) {
+            keep_alive = 1;
+        } else if (strcmp(flag, "-C") == 0) {
+            keep_alive = 0;
+        } else if (arg + 1 < argc && strcmp(flag, "-a") == 0) {
+            addr = argv[++arg];
+        } else if (arg + 1 < argc && strcmp(flag, "-c") == 0) {
+            connections_count = strtoul(argv[++arg], NULL, 10);
+        } else if (arg + 1 < argc && strcmp(flag, "-d") == 0) {
+            duration = strtod(argv[++arg], NULL);
+        } else {
+            usage(stderr);
+            exit(1);
+        }
+    }
+
+    if (argc - arg < 2 || connections_count == 0 || duration <= 0.0) {
+        usage(stderr);
+        exit(1);
+    }
+
+    const char *port_cstr = argv[arg++];
+
+    Loadgen *loadgen = calloc(1, sizeof(Loadgen));
+    assert(loadgen);
+    loadgen->keep_alive = keep_alive;
+    loadgen->addr.sin_family = AF_INET;
+    loadgen->addr.sin_port = htons((uint16_t) strtoul(port_cstr, NULL, 10));
+    if (inet_pton(AF_INET, addr, &loadgen->addr.sin_addr) != 1) {
+        fprintf(stderr, "%s is not an IPv4 address\n", addr);
+        exit(1);
+    }
+
+    Connection *connections = calloc(connections_count, sizeof(Connection));
+    assert(connections);
+
+    for (; arg < argc; ++arg) {
+        const char *path = argv[arg];
+
+        loadgen->epoll_fd = epoll_create1(0);
+        if (loadgen->epoll_fd < 0) {
+            fprintf(stderr, "Could not create epoll: %s\n", strerror(errno));
+            exit(1);
+        }
+
+        int n = snprintf(loadgen->request, sizeof(loadgen->request),
+                         "GET %s HTTP/1.1\r\nHost: %s:%s\r\n%s\r\n",
+                         path, addr, port_cstr,
+                         keep_alive ? "" : "Connection: close\r\n");
+        assert(n > 0 && (size_t) n < sizeof(loadgen->request));
+        loadgen->request_size = (size_t) n;
+
+        loadgen->responses = 0;
+        loadgen->non_2xx = 0;
+        loadgen->errors = 0;
+        loadgen->bytes = 0;
+        memset(&loadgen->latency, 0, sizeof(loadgen->latency));
+
+        const uint64_t begin = now_ns();
+        if (loadgen_run(loadgen, connections, connections_count, duration) < 0) {
+            exit(1);
+        }
+        const double elapsed = (double) (now_ns() - begin) / 1e9;
+        close(loadgen->epoll_fd);
+
+        const Histogram *latency = &loadgen->latency;
+        const double rps = (double) loadgen->responses / elapsed;
+
+        printf("{\"path\":\"%s\",\"mode\":\"%s\",\"connections\":%zu,\"duration\":%.3f,"
+               "\"requests\":%" PRIu64 ",\"non_2xx\":%" PRIu64 ",\"errors\":%" PRIu64 ","
+               "\"bytes\":%" PRIu64 ",\"rps\":%.1f,"
+               "\"latency_us\":{\"min\":%" PRIu64 ",\"p50\":%" PRIu64 ",\"p99\":%" PRIu64 ","
+               "\"p999\":%" PRIu64 ",\"max\":%" PRIu64 "}}\n",
+               path, keep_alive ? "keep-alive" : "close", connections_count, elapsed,
+               loadgen->responses, loadgen->non_2xx, loadgen->errors, loadgen->bytes, rps,
+               latency->min,
+               histogram_percentile(latency, 50.0),
+               histogram_percentile(latency, 99.0),
+               histogram_percentile(latency, 99.9),
+               latency->max);
+        fflush(stdout);
+
+        fprintf(stderr, "%-24s %-10s %10.1f req/s  p50 %6" PRIu64 "us  p99 %6" PRIu64 "us  p999 %6" PRIu64 "us"
+                "  non-2xx %" PRIu64 "  errors %" PRIu64 "\n",
+                path, keep_alive ? "keep-alive" : "close", rps,
+                histogram_percentile(latency, 50.0),
+                histogram_percentile(latency, 99.0),
+                histogram_percentile(latency, 99.9),
+                loadgen->non_2xx, loadgen->errors);
+    }
+
+    return 0;
+}
@@ -0,0 +1,397 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdalign.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include <unistd.h>
+
+#include "log.h"
+
+#define LOG_RING_CAPACITY 4096
+#define LOG_TEXT_CAPACITY 200
+#define LOG_BATCH_CAPACITY (64 * 1024)
+// NOTE: how long the background thread sleeps when there is nothing
+// to write. Nobody wakes it up, so the producers never make a syscall.
+#define LOG_IDLE_SLEEP_MS 5
+
+static_assert((LOG_RING_CAPACITY & (LOG_RING_CAPACITY - 1)) == 0,
+              "The capacity of the ring must be a power of 2");
+
+typedef enum {
+    LOG_RECORD_MESSAGE = 0,
+    LOG_RECORD_ACCESS,
+} Log_Record_Kind;
+
+// NOTE: the fields are the raw values, the text is formatted only when
+// the record is written out. Strings that do not fit are truncated.
+typedef struct {
+    // NOTE: the slot is ready to be written when sequence == position
+    // and ready to be read when sequence == position + 1
+    size_t sequence;
+    Log_Record_Kind kind;
+    Log_Level level;
+    struct timespec time;
+
+    int code;
+    uint32_t method_len;
+    uint32_t text_len;
+    size_t body_size;
+    uint64_t duration_us;
+    char method[8];
+    char text[LOG_TEXT_CAPACITY];
+} Log_Record;
+
+// NOTE: bounded MPMC queue by Dmitry Vyukov, with a single consumer
+static struct {
+    Log_Record records[LOG_RING_CAPACITY];
+    // NOTE: the producers and the consumer never share a cache line
+    alignas(64) size_t enqueue_position;
+    alignas(64) size_t dequeue_position;
+    alignas(64) uint64_t dropped;
+} log_ring;
+
+Log_Level log_level = LOG_INFO;
+
+static pthread_t log_thread;
+static int log_running = 0;
+static int log_stopping = 0;
+
+static
+Log_Record *log_ring_acquire(void)
+{
+    size_t position = __atomic_load_n(&log_ring.enqueue_position, __ATOMIC_RELAXED);
+    for (;;) {
+        Log_Record *record = &log_ring.records[position & (LOG_RING_CAPACITY - 1)];
+        const size_t sequence = __atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE);
+        const intptr_t diff = (intptr_t) sequence - (intptr_t) position;
+
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&log_ring.enqueue_position, &position, position + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                return record;
+            }
+        } else if (diff < 0) {
+            // NOTE: the ring is full
+            __atomic_fetch_add(&log_ring.dropped, 1, __ATOMIC_RELAXED);
+            return NULL;
+        } else {
+            position = __atomic_load_n(&log_ring.enqueue_position, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static
+void log_ring_publish(Log_Record *record)
+{
+    __atomic_store_n(&record->sequence, record->sequence + 1, __ATOMIC_RELEASE);
+}
+
+static
+Log_Record *log_ring_peek(void)
+{
+    const size_t position = log_ring.dequeue_position;
+    Log_Record *record = &log_ring.records[position & (LOG_RING_CAPACITY - 1)];
+    if (__atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE) != position + 1) {
+        return NULL;
+    }
+    return record;
+}
+
+static
+void log_ring_release(Log_Record *record)
+{
+    const size_t position = log_ring.dequeue_position;
+    log_ring.dequeue_position = position + 1;
+    __atomic_store_n(&record->sequence, position + LOG_RING_CAPACITY, __ATOMIC_RELEASE);
+}
+
+static
+uint32_t log_copy(char *dst, size_t capacity, String src)
+{
+    const size_t n = src.len < capacity ? src.len : capacity;
+    memcpy(dst, src.data, n);
+    return (uint32_t) n;
+}
+
+void log_message(Log_Level level, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    log_messagev(level, format, args);
+    va_end(args);
+}
+
+void log_messagev(Log_Level level, const char *format, va_list args)
+{
+    if (!log_enabled(level)) {
+        return;
+    }
+
+    Log_Record *record = log_ring_acquire();
+    if (record == NULL) {
+        return;
+    }
+
+    record->kind = LOG_RECORD_MESSAGE;
+    record->level = level;
+    clock_gettime(CLOCK_REALTIME, &record->time);
+
+    int n = vsnprintf(record->text, sizeof(record->text), format, args);
+    if (n < 0) n = 0;
+    if ((size_t) n >= sizeof(record->text)) n = sizeof(record->text) - 1;
+    // NOTE: the messages are lines, the newline is added when written
+    while (n > 0 && record->text[n - 1] == '\n') n -= 1;
+    record->text_len = (uint32_t) n;
+
+    log_ring_publish(record);
+}
+
+void log_access(const Log_Access *access)
+{
+    assert(access);
+
+    if (!log_enabled(LOG_INFO)) {
+        return;
+    }
+
+    Log_Record *record = log_ring_acquire();
+    if (record == NULL) {
+        return;
+    }
+
+    record->kind = LOG_RECORD_ACCESS;
+    record->level = LOG_INFO;
+    clock_gettime(CLOCK_REALTIME, &record->time);
+    record->code = access->code;
+    record->body_size = access->body_size;
+    record->duration_us = access->duration_us;
+    record->method_len = log_copy(record->method, sizeof(record->method), access->method);
+    record->text_len = log_copy(record->text, sizeof(record->text), access->target);
+
+    log_ring_publish(record);
+}
+
+uint64_t log_dropped(void)
+{
+    return __atomic_load_n(&log_ring.dropped, __ATOMIC_RELAXED);
+}
+
+static const char *const log_level_names[LOG_OFF] = {
+    [LOG_DEBUG] = "DEBUG",
+    [LOG_INFO] = "INFO",
+    [LOG_WARN] = "WARN",
+    [LOG_ERROR] = "ERROR",
+};
+
+typedef struct {
+    int fd;
+    size_t size;
+    char data[LOG_BATCH_CAPACITY];
+} Log_Batch;
+
+static
+void log_batch_flush(Log_Batch *batch)
+{
+    size_t written = 0;
+    while (written < batch->size) {
+        ssize_t n = write(batch->fd, batch->data + written, batch->size - written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            // NOTE: there is nowhere to report it
+            break;
+        }
+        written += (size_t) n;
+    }
+    batch->size = 0;
+}
+
+static
+void log_batch_printf(Log_Batch *batch, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static
+void log_batch_printf(Log_Batch *batch, const char *format, ...)
+{
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        const size_t room = LOG_BATCH_CAPACITY - batch->size;
+
+        va_list args;
+        va_start(args, format);
+        int n = vsnprintf(batch->data + batch->size, room, format, args);
+        va_end(args);
+
+        if (n < 0) {
+            return;
+        }
+
+        if ((size_t) n < room) {
+            batch->size += (size_t) n;
+            return;
+        }
+
+        log_batch_flush(batch);
+    }
+}
+
+static
+void log_format_time(char out[32], struct timespec time)
+{
+    struct tm tm;
+    gmtime_r(&time.tv_sec, &tm);
+    size_t n = strftime(out, 32, "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(out + n, 32 - n, ".%03ldZ", time.tv_nsec / 1000000);
+}
+
+// NOTE: the target may contain anything the client sent, so quotes,
+// backslashes and control characters are escaped
+static
+void log_batch_quoted(Log_Batch *batch, const char *data, size_t size)
+{
+    if (LOG_BATCH_CAPACITY - batch->size < size * 4 + 3) {
+        log_batch_flush(batch);
+    }
+
+    char *out = batch->data + batch->size;
+    *out++ = '"';
+    for (size_t i = 0; i < size; ++i) {
+        const unsigned char c = (unsigned char) data[i];
+        if (c == '"' || c == '\\') {
+            *out++ = '\\';
+            *out++ = (char) c;
+        } else if (c < 0x20 || c == 0x7f) {
+            out += sprintf(out, "\\x%02x", c);
+        } else {
+            *out++ = (char) c;
+        }
+    }
+    *out++ = '"';
+    batch->size = (size_t) (out - batch->data);
+}
+
+static
+void log_format_record(Log_Batch *batch, const Log_Record *record)
+{
+    char time[32];
+    log_format_time(time, record->time);
+
+    switch (record->kind) {
+    case LOG_RECORD_MESSAGE: {
+        log_batch_printf(batch, "%s [%s] %.*s\n", time, log_level_names[record->level],
+                         (int) record->text_len, record->text);
+    } break;
+
+    case LOG_RECORD_ACCESS: {
+        log_batch_printf(batch, "%s [ACCESS] method=%.*s target=", time,
+                         (int) record->method_len, record->method);
+        log_batch_quoted(batch, record->text, record->text_len);
+        log_batch_printf(batch, " status=%d body_bytes=%zu duration_us=%" PRIu64 "\n",
+                         record->code, record->body_size, record->duration_us);
+    } break;
+    }
+}
+
+static
+void *log_thread_main(void *arg)
+{
+    (void) arg;
+
+    // NOTE: the warnings and the errors go to stderr, the rest to stdout
+    static Log_Batch out = { .fd = STDOUT_FILENO };
+    static Log_Batch err = { .fd = STDERR_FILENO };
+    uint64_t dropped_reported = 0;
+
+    for (;;) {
+        const int stopping = __atomic_load_n(&log_stopping, __ATOMIC_ACQUIRE);
+
+        size_t count = 0;
+        Log_Record *record;
+        while ((record = log_ring_peek()) != NULL) {
+            log_format_record(record->level >= LOG_WARN ? &err : &out, record);
+            log_ring_release(record);
+            count += 1;
+        }
+
+        const uint64_t dropped = log_dropped();
+        if (dropped != dropped_reported) {
+            log_batch_printf(&err, "[WARN] Log ring is full. Dropped %" PRIu64 " records so far.\n", dropped);
+            dropped_reported = dropped;
+        }
+
+        log_batch_flush(&out);
+        log_batch_flush(&err);
+
+        if (stopping) {
+            break;
+        }
+
+        if (count == 0) {
+            struct timespec idle = { .tv_nsec = LOG_IDLE_SLEEP_MS * 1000 * 1000 };
+            nanosleep(&idle, NULL);
+        }
+    }
+
+    return NULL;
+}
+
+static
+Log_Level log_level_from_env(void)
+{
+    const char *level = getenv("SKEDUDLE_LOG_LEVEL");
+    if (level == NULL) return LOG_INFO;
+    if (strcasecmp(level, "debug") == 0) return LOG_DEBUG;
+    if (strcasecmp(level, "info") == 0) return LOG_INFO;
+    if (strcasecmp(level, "warn") == 0) return LOG_WARN;
+    if (strcasecmp(level, "error") == 0) return LOG_ERROR;
+    if (strcasecmp(level, "off") == 0) return LOG_OFF;
+
+    fprintf(stderr, "[WARN] Unknown SKEDUDLE_LOG_LEVEL `%s'. Using info.\n", level);
+    return LOG_INFO;
+}
+
+int log_init(void)
+{
+    assert(!log_running);
+
+    log_level = log_level_from_env();
+
+    for (size_t i = 0; i < LOG_RING_CAPACITY; ++i) {
+        log_ring.records[i].sequence = i;
+    }
+
+    // NOTE: the signals are handled by the main thread only (e.g. SIGHUP
+    // through signalfd), so the background thread blocks all of them
+    sigset_t all;
+    sigset_t old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int err = pthread_create(&log_thread, NULL, log_thread_main, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+
+    log_running = 1;
+    atexit(log_shutdown);
+    return 0;
+}
+
+void log_shutdown(void)
+{
+    if (!log_running) {
+        return;
+    }
+
+    __atomic_store_n(&log_stopping, 1, __ATOMIC_RELEASE);
+    pthread_join(log_thread, NULL);
+    log_running = 0;
+}
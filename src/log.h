@@ -0,0 +1,59 @@
+#ifndef LOG_H_
+#define LOG_H_
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "s.h"
+
+// NOTE: Asynchronous logger. The threads that log never touch stdio or
+// the file descriptors: they put a fixed-size record into a lock-free
+// ring and move on. A background thread takes the records out, formats
+// them and writes them in batches, so a slow terminal or pipe never
+// stalls the event loop. When the ring is full the record is dropped
+// and counted instead of waiting.
+
+typedef enum {
+    LOG_DEBUG = 0,
+    LOG_INFO,
+    LOG_WARN,
+    LOG_ERROR,
+    LOG_OFF,
+} Log_Level;
+
+// NOTE: the records below this level are not even formatted
+extern Log_Level log_level;
+
+static inline
+int log_enabled(Log_Level level)
+{
+    return level >= log_level;
+}
+
+// NOTE: starts the background thread. The level is taken from
+// SKEDUDLE_LOG_LEVEL (debug, info, warn, error, off), info by default.
+// Whatever is still in the ring is written out at exit.
+int log_init(void);
+void log_shutdown(void);
+
+void log_message(Log_Level level, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+void log_messagev(Log_Level level, const char *format, va_list args)
+    __attribute__((format(printf, 2, 0)));
+
+typedef struct {
+    String method;
+    String target;
+    int code;
+    size_t body_size;
+    uint64_t duration_us;
+} Log_Access;
+
+// NOTE: a line of the access log. Logged at LOG_INFO.
+void log_access(const Log_Access *access);
+
+// NOTE: the amount of records dropped because the ring was full
+uint64_t log_dropped(void);
+
+#endif  // LOG_H_
@@ -17,8 +17,8 @@
 #include <unistd.h>
 #include <sys/mman.h>
 #include <sys/time.h>
-#include <fnmatch.h>
 #include <limits.h>
+#include <signal.h>
 
 #include "s.h"
 #include "response.h"
@@ -27,458 +27,489 @@
 #include "schedule.h"
 #include "json.h"
 #include "platform_specific.h"
+#include "asset.h"
+#include "public_assets.h"
+#include "router.h"
+#include "tt.h"
+#include "server.h"
+#include "metrics.h"
+#include "log.h"
+
+struct Request_Context
+{
+    Server *server;
+    Connection *connection;
+    Memory *memory;
+    struct Schedule *schedule;
+    const Http_Request *request;
+    Route_Params params;
+    Response *response;
+};
 
-#define REQUEST_BUFFER_CAPACITY (640 * KILO)
-char request_buffer[REQUEST_BUFFER_CAPACITY];
-
-void http_error_page_template(int OUT, int code)
+void http_error_page_template(Buffer *OUT, int code)
 {
-#define INT(x) dprintf(OUT, "%d", x);
 #include "error_page_template.h"
-#undef INT
 }
 
-int http_error(int fd, int code, const char *format, ...)
+int http_error(Response *response, int code, const char *format, ...)
 {
-    va_list args;
-    va_start(args, format);
-    vfprintf(stderr, format, args);
-    va_end(args);
+    if (log_enabled(LOG_DEBUG)) {
+        va_list args;
+        va_start(args, format);
+        log_messagev(LOG_DEBUG, format, args);
+        va_end(args);
+    }
 
-    response_status_line(fd, code);
-    response_header(fd, "Content-Type", "text/html");
-    response_body_start(fd);
-    http_error_page_template(fd, code);
+    response_start(response, code, CONTENT_TYPE_HTML);
+    http_error_page_template(&response->body, code);
 
     return 1;
 }
 
-int serve_file(int dest_fd,
-               const char *filepath,
-               const char *content_type)
+int serve_asset(Request_Context *context, const Asset *asset)
 {
-    printf("[INFO] Serving file: %s\n", filepath);
-
-    int src_fd = -1;
+    assert(asset);
 
-    struct stat file_stat;
-    int err = stat(filepath, &file_stat);
-    if (err < 0) {
-        return http_error(dest_fd, 404, strerror(errno));
-    }
+    log_message(LOG_DEBUG, "Serving asset: %.*s", (int) asset->path.len, asset->path.data);
 
-    src_fd = open(filepath, O_RDONLY);
-    if (src_fd < 0) {
-        return http_error(dest_fd, 404, strerror(errno));
+    String if_none_match = http_request_header(context->request, HTTP_HEADER_IF_NONE_MATCH);
+    if (string_equal(if_none_match, asset->etag)) {
+        response_start(context->response, 304, CONTENT_TYPE_NONE);
+        response_header(context->response, SLT("ETag"), asset->etag);
+        return 0;
     }
 
-    response_status_line(dest_fd, 200);
-    response_header(dest_fd, "Content-Type", content_type);
-    response_header(dest_fd, "Content-Length", "%d", file_stat.st_size);
-    response_body_start(dest_fd);
-
-    off_t offset = 0;
-    while (offset < file_stat.st_size) {
-        // TODO(#3): Try to align sendfile chunks according to tcp mem buffer
-        //     Will that even improve the performance?
-        //     References:
-        //     - http://man7.org/linux/man-pages/man2/sysctl.2.html
-        //     - `sysctl -w net.ipv4.tcp_mem='8388608 8388608 8388608'`
-        ssize_t n = sendfile_wrapper(dest_fd, src_fd, &offset, 1024);
-        if (n < 0) {
-            fprintf(stderr, "[ERROR] Could not finish serving the file: %s\n",
-                    strerror(errno));
-            break;
-        }
-    }
-
-    if (src_fd >= 0) {
-        close(src_fd);
-    }
+    response_start(context->response, 200, CONTENT_TYPE_NONE);
+    response_header_block(context->response, asset->headers);
+    response_content(context->response, asset->content);
 
     return 0;
 }
 
-int is_cancelled(struct Schedule *schedule, time_t id)
+int serve_static(Request_Context *context)
 {
-    for (size_t i = 0; i < schedule->cancelled_events_count; ++i) {
-        if (schedule->cancelled_events[i] == id) {
-            return 1;
-        }
+    const Asset *asset = asset_table_lookup(&public_assets, route_param(&context->params, SLT("path")));
+    if (asset == NULL) {
+        return http_error(context->response, 404, "Unknown asset\n");
     }
-    return 0;
+    return serve_asset(context, asset);
 }
 
 // TODO(#13): schedule does not support patches
 // TODO(#10): there is no endpoint to get a schedule for a period
-// TODO(#14): / should probably return the page of https://tsoding.org/schedule
-//   Which will require to move rest map to somewhere
-
-time_t id_of_event(struct Event event)
-{
-    return timegm(&event.date) + timezone + event.time_min * 60;
-}
 
-Json_Value event_as_json(Memory *memory, struct Event event)
+void write_event(Json_Writer *writer, struct Event *event)
 {
-    assert(memory);
-
-    const time_t id = id_of_event(event);
-    const size_t id_cstr_size = 256;
-    char *id_cstr = memory_alloc(memory, id_cstr_size);
-    snprintf(id_cstr, id_cstr_size, "%ld", id);
-
-    Json_Object object = {0};
-
-    json_object_push(memory, &object, SLT("id"), json_string(cstr_as_string(id_cstr)));
-    json_object_push(memory, &object, SLT("title"), json_string(event.title));
-    json_object_push(memory, &object, SLT("description"), json_string(event.description));
-    json_object_push(memory, &object, SLT("url"), json_string(event.url));
-    json_object_push(memory, &object, SLT("channel"), json_string(event.channel));
-
-    return (Json_Value) {
-        .type = JSON_OBJECT,
-        .object = object
-    };
-}
-
-void print_event(int dest_fd, Memory *memory, struct Event event)
-{
-    Json_Value event_json = event_as_json(memory, event);
-    print_json_value_fd(dest_fd, event_json);
-}
-
-int next_event(time_t current_time,
-               struct Schedule *schedule,
-               struct Event *output)
-{
-    struct Event result = {0};
-    time_t result_id = -1;
-
-    for (size_t i = 0; i < schedule->extra_events_size; ++i) {
-        struct Event event = schedule->extra_events[i];
-        time_t event_id = id_of_event(event);
-        if (current_time < event_id && !is_cancelled(schedule, event_id)) {
-            if (result_id < 0 || event_id < result_id) {
-                result = event;
-                result_id = event_id;
-            }
-        }
-    }
-
-    for (int j = 0; j < 7; ++j) {
-        time_t week_time = current_time + 24 * 60 * 60 * j;
-        struct tm *week_tm = gmtime(&week_time);
-
-        for (size_t i = 0; i < schedule->projects_size; ++i) {
-            if (!(schedule->projects[i].days & (1 << week_tm->tm_wday))) {
-                continue;
-            }
-
-            if (schedule->projects[i].starts) {
-                time_t starts_time = timegm(schedule->projects[i].starts) - timezone;
-                if (week_time < starts_time) continue;
-            }
-
-            if (schedule->projects[i].ends) {
-                time_t ends_time = timegm(schedule->projects[i].ends) - timezone;
-                if (ends_time < week_time) continue;
-            }
-
-            struct Event event = {
-                .time_min = schedule->projects[i].time_min,
-                .title = schedule->projects[i].name,
-                .description = schedule->projects[i].description,
-                .url = schedule->projects[i].url,
-                .channel = schedule->projects[i].channel
-            };
-
-            event.date = *week_tm;
-            event.date.tm_sec = 0;
-            event.date.tm_min = 0;
-            event.date.tm_hour = 0;
-
-            time_t event_id = id_of_event(event);
-
-            if (is_cancelled(schedule, event_id)) {
-                continue;
-            }
-
-            if (current_time >= event_id) {
-                continue;
-            }
-
-            if (result_id < 0 || event_id < result_id) {
-                result = event;
-                result_id = event_id;
-            }
-        }
-    }
-
-    if (output) {
-        *output = result;
-    }
-
-    return result_id >= 0;
+    assert(writer);
+    assert(event);
+    json_writer_element(writer);
+    print_event_json(writer->buffer, event);
 }
 
-int serve_next_stream(int dest_fd, Memory *memory, struct Schedule *schedule)
+int serve_next_stream(Request_Context *context)
 {
-    response_status_line(dest_fd, 200);
-    response_header(dest_fd, "Content-Type", "application/json");
-    response_body_start(dest_fd);
+    response_start(context->response, 200, CONTENT_TYPE_JSON);
 
     time_t current_time = time(NULL) - timezone;
     struct Event event;
-    if (next_event(current_time, schedule, &event)) {
-        print_event(dest_fd, memory, event);
+    if (next_event(current_time, context->schedule, &event)) {
+        print_event_json(&context->response->body, &event);
     }
 
     return 0;
 }
 
-int serve_rest_map(Memory *memory, int dest_fd, String host)
+int serve_rest_map(Request_Context *context)
 {
-    assert(memory);
+    assert(context);
 
-    response_status_line(dest_fd, 200);
-    response_header(dest_fd, "Content-Type", "application/json");
-    response_body_start(dest_fd);
+    Memory *memory = context->memory;
+    String host = http_request_header(context->request, HTTP_HEADER_HOST);
 
-    Json_Object rest_map = {0};
-    json_object_push(
-        memory, &rest_map,
-        SLT("next_stream"),
-        json_string(concat3(memory, SLT("http://"), host, SLT("/api/next_stream"))));
-    json_object_push(
-        memory, &rest_map,
-        SLT("period_streams"),
-        json_string(concat3(memory, SLT("http://"), host, SLT("/api/period_streams"))));
+    response_start(context->response, 200, CONTENT_TYPE_JSON);
 
-    print_json_value_fd(dest_fd, (Json_Value) { .type = JSON_OBJECT, .object = rest_map });
+    Json_Writer writer = json_writer(&context->response->body);
+    json_begin_object(&writer);
+    json_key(&writer, SLT("next_stream"));
+    json_write_string(&writer, concat3(memory, SLT("http://"), host, SLT("/api/next_stream")));
+    json_key(&writer, SLT("period_streams"));
+    json_write_string(&writer, concat3(memory, SLT("http://"), host, SLT("/api/period_streams")));
+    json_key(&writer, SLT("events_stream"));
+    json_write_string(&writer, concat3(memory, SLT("http://"), host, SLT("/api/events/stream")));
+    json_end_object(&writer);
 
     return 0;
 }
 
-int is_same_day(struct tm a, struct tm b)
-{
-    return a.tm_mday == b.tm_mday
-        && a.tm_mon  == b.tm_mon
-        && a.tm_year == b.tm_year;
-}
-
-typedef void (*EventCallback)(void *context, struct Event* event);
+#define SECONDS_IN_DAY (24 * 60 * 60)
+#define PERIOD_DAYS_IN_PAST 4
+#define PERIOD_DAYS (14 + PERIOD_DAYS_IN_PAST)
 
 static
-size_t events_at_day(struct tm date,
-                     struct Schedule *schedule,
-                     EventCallback event_callback,
-                     void *event_context)
+int serve_period_streams(Request_Context *request_context)
 {
-    size_t result = 0;
+    assert(request_context);
 
-    date.tm_sec = 0;
-    date.tm_min = 0;
-    date.tm_hour = 0;
+    struct Schedule *schedule = request_context->schedule;
 
-    for (size_t i = 0; i < schedule->extra_events_size; ++i) {
-        if (is_same_day(date, schedule->extra_events[i].date)) {
-            result += 1;
-            event_callback(event_context, &schedule->extra_events[i]);
-        }
-    }
+    response_start(request_context->response, 200, CONTENT_TYPE_JSON);
 
-    time_t date_time = timegm(&date) - timezone;
+    Json_Writer writer = json_writer(&request_context->response->body);
+    json_begin_array(&writer);
 
-    for (size_t i = 0; i < schedule->projects_size; ++i) {
-        if (!(schedule->projects[i].days & (1 << date.tm_wday))) {
-            continue;
-        }
+    time_t current_time = time(NULL) - timezone - SECONDS_IN_DAY * PERIOD_DAYS_IN_PAST;
+    for (size_t i = 0; i < PERIOD_DAYS; ++i) {
+        struct tm *current_date = gmtime(&current_time);
 
-        if (schedule->projects[i].starts) {
-            time_t starts_time = timegm(schedule->projects[i].starts) - timezone;
-            if (date_time < starts_time) continue;
-        }
+        size_t count = events_at_day(*current_date,
+                                     schedule,
+                                     (EventCallback)write_event,
+                                     &writer);
 
-        if (schedule->projects[i].ends) {
-            time_t ends_time = timegm(schedule->projects[i].ends) - timezone;
-            if (ends_time < date_time) continue;
+        if (count == 0) {
+            // TODO(#72): Day off cell does not have a date attached to it
+            json_write_null(&writer);
         }
 
-        struct Event event = {
-            .time_min = schedule->projects[i].time_min,
-            .title = schedule->projects[i].name,
-            .description = schedule->projects[i].description,
-            .url = schedule->projects[i].url,
-            .channel = schedule->projects[i].channel
-        };
+        current_time += SECONDS_IN_DAY;
+    }
 
-        event.date = date;
-        time_t event_id = id_of_event(event);
+    json_end_array(&writer);
 
-        if (is_cancelled(schedule, event_id)) {
-            continue;
-        }
+    return 0;
+}
 
-        result += 1;
-        event_callback(event_context, &event);
-    }
+struct Schedule_Page_Item
+{
+    int day_off;
+    int past;
+    time_t id;
+    String when;
+    struct Event event;
+};
 
-    return result;
+// NOTE: The rendered schedule page only changes when one of its events
+// starts or when the period moves to the next day. Until then every
+// request gets the same bytes. The expiry timer drops the page at
+// that moment.
+struct Schedule_Page
+{
+    Memory memory;
+    struct Schedule_Page_Item *items;
+    size_t items_count;
+    size_t items_capacity;
+    String html;
+    int valid;
+    Timer expiry;
+};
+
+static struct Schedule_Page schedule_page = {0};
+
+void schedule_page_template(Buffer *OUT,
+                            const struct Schedule_Page_Item *items,
+                            size_t items_count)
+{
+#include "schedule_page_template.h"
 }
 
-struct Context
+static
+struct Schedule_Page_Item *schedule_page_push_item(struct Schedule_Page *page)
 {
-    Json_Array array;
-    Memory *memory;
+    assert(page->items_count < page->items_capacity);
+    struct Schedule_Page_Item *item = &page->items[page->items_count++];
+    memset(item, 0, sizeof(*item));
+    return item;
+}
+
+// NOTE: the bounds of the HTML the template produces. The literal text
+// around the items and of a single item (see schedule_page_template.h.tt)
+// with a lot of room to spare. The strings of an item come on top of it.
+#define SCHEDULE_PAGE_HTML_BOUND (8 * KILO)
+#define SCHEDULE_PAGE_ITEM_HTML_BOUND KILO
+#define SCHEDULE_PAGE_WHEN_CAPACITY 32
+
+struct Schedule_Page_Size
+{
+    size_t items_count;
+    size_t html_size;
 };
 
-void append_event_to_context(struct Context *context, struct Event *event)
+static
+void schedule_page_size_event(struct Schedule_Page_Size *size, struct Event *event)
+{
+    size->items_count += 1;
+    size->html_size += SCHEDULE_PAGE_ITEM_HTML_BOUND
+        + TT_HTML_BOUND(event->url)
+        + event->title.len
+        + 6 * SCHEDULE_PAGE_WHEN_CAPACITY
+        + 2 * TT_HTML_BOUND(event->channel)
+        + event->description.len;
+}
+
+// NOTE: the items, their times and the HTML. The buffer of the HTML
+// doubles as it grows, so it may take twice as much as the HTML itself.
+static
+size_t schedule_page_memory_size(struct Schedule_Page_Size size)
+{
+    return alignof(struct Schedule_Page_Item)
+        + size.items_count * (sizeof(struct Schedule_Page_Item) + SCHEDULE_PAGE_WHEN_CAPACITY)
+        + 2 * size.html_size;
+}
+
+void append_event_to_page(struct Schedule_Page *page, struct Event *event)
+{
+    struct Schedule_Page_Item *item = schedule_page_push_item(page);
+    item->event = *event;
+    item->id = id_of_event(*event);
+
+    const size_t when_capacity = SCHEDULE_PAGE_WHEN_CAPACITY;
+    char *when = memory_alloc(&page->memory, when_capacity);
+    struct tm when_tm;
+    gmtime_r(&item->id, &when_tm);
+    item->when = string(strftime(when, when_capacity, "%Y-%m-%d %H:%M UTC", &when_tm), when);
+}
+
+void schedule_page_expire(Timer *timer, struct Schedule_Page *page)
 {
-    Json_Value value = event_as_json(context->memory, *event);
-    json_array_push(context->memory, &context->array, value);
+    (void) timer;
+    page->valid = 0;
 }
 
 static
-int serve_period_streams(int fd, Memory *memory, struct Schedule *schedule)
+void render_schedule_page(struct Schedule_Page *page, Server *server,
+                          struct Schedule *schedule, time_t now)
 {
-    assert(memory);
+    assert(page);
+    assert(server);
     assert(schedule);
 
-    struct Context context = {
-        .array = {0},
-        .memory = memory
+    // NOTE: the first pass only measures the page, so the memory of
+    // the page can grow to fit it before anything is rendered
+    struct Schedule_Page_Size size = {
+        .html_size = SCHEDULE_PAGE_HTML_BOUND,
     };
+    time_t current_time = now - timezone - SECONDS_IN_DAY * PERIOD_DAYS_IN_PAST;
+    for (size_t i = 0; i < PERIOD_DAYS; ++i) {
+        struct tm *current_date = gmtime(&current_time);
+        if (events_at_day(*current_date, schedule, (EventCallback) schedule_page_size_event, &size) == 0) {
+            size.items_count += 1;
+            size.html_size += SCHEDULE_PAGE_ITEM_HTML_BOUND;
+        }
+        current_time += SECONDS_IN_DAY;
+    }
 
-    const time_t SECONDS_IN_DAYS = 24 * 60 * 60;
-    const size_t DAYS_IN_PAST = 4;
-    time_t current_time = time(NULL) - timezone - SECONDS_IN_DAYS * DAYS_IN_PAST;
-    for (size_t i = 0; i < 14 + DAYS_IN_PAST; ++i) {
+    const size_t memory_size = schedule_page_memory_size(size);
+    if (page->memory.capacity < memory_size) {
+        free(page->memory.buffer);
+        page->memory.capacity = memory_size;
+        page->memory.buffer = malloc(memory_size);
+        assert(page->memory.buffer);
+    }
+
+    memory_clean(&page->memory);
+
+    page->items_count = 0;
+    page->items_capacity = size.items_count;
+    page->items = memory_alloc_aligned(&page->memory,
+                                       sizeof(page->items[0]) * page->items_capacity,
+                                       alignof(struct Schedule_Page_Item));
+
+    current_time = now - timezone - SECONDS_IN_DAY * PERIOD_DAYS_IN_PAST;
+    for (size_t i = 0; i < PERIOD_DAYS; ++i) {
         struct tm *current_date = gmtime(&current_time);
 
         size_t count = events_at_day(*current_date,
                                      schedule,
-                                     (EventCallback)append_event_to_context,
-                                     &context);
+                                     (EventCallback)append_event_to_page,
+                                     page);
 
         if (count == 0) {
-            // TODO(#72): Day off cell does not have a date attached to it
-            json_array_push(context.memory, &context.array, json_null);
+            schedule_page_push_item(page)->day_off = 1;
         }
 
-        current_time += SECONDS_IN_DAYS;
+        current_time += SECONDS_IN_DAY;
     }
 
-    response_status_line(fd, 200);
-    response_header(fd, "Content-Type", "application/json");
-    response_body_start(fd);
-    print_json_value_fd(fd, (Json_Value) { .type = JSON_ARRAY, .array = context.array });
+    // NOTE: the period moves at the local midnight
+    time_t expires = ((now - timezone) / SECONDS_IN_DAY + 1) * SECONDS_IN_DAY + timezone;
+    for (size_t i = 0; i < page->items_count; ++i) {
+        struct Schedule_Page_Item *item = &page->items[i];
+        if (item->day_off) continue;
 
-    return 0;
+        item->past = item->id <= now;
+        if (!item->past && item->id < expires) {
+            expires = item->id;
+        }
+    }
+
+    Buffer html = buffer_of_memory(&page->memory);
+    schedule_page_template(&html, page->items, page->items_count);
+    page->html = buffer_as_string(html);
+    metrics_arena(METRICS_ARENA_SCHEDULE_PAGE, page->memory.size);
+
+    page->valid = 1;
+    page->expiry.callback = (Timer_Callback) schedule_page_expire;
+    page->expiry.data = page;
+    server_timer_set(server, &page->expiry, (uint64_t) (expires - now) * 1000);
 }
 
-const char *mime_of_file_path(const char *file_path)
+int serve_index(Request_Context *context)
 {
-    if (fnmatch("*.css", file_path, 0) == 0) {
-        return "text/css";
-    } else if (fnmatch("*.js", file_path, 0) == 0) {
-        return "application/javascript";
-    } else if (fnmatch("*.html", file_path, 0) == 0) {
-        return "text/html";
+    assert(context);
+
+    if (!schedule_page.valid) {
+        render_schedule_page(&schedule_page, context->server, context->schedule, time(NULL));
     }
 
-    return "text/plain";
+    response_start(context->response, 200, CONTENT_TYPE_HTML);
+    response_content(context->response, schedule_page.html);
+
+    return 0;
 }
 
-int handle_request(int fd, struct sockaddr_in *addr, Memory *memory, struct Schedule *schedule)
+struct Event_Search
 {
-    assert(addr);
-
-    ssize_t request_buffer_size = read(fd, request_buffer, REQUEST_BUFFER_CAPACITY);
-
-    if (request_buffer_size == 0) return http_error(fd, 400, "EOF");
-    if (request_buffer_size < 0)  return http_error(fd, 500, strerror(errno));
+    time_t id;
+    int found;
+    struct Event event;
+};
 
-    String buffer = {
-        .len = (uint64_t)request_buffer_size,
-        .data = request_buffer
-    };
+void match_event_id(struct Event_Search *search, struct Event *event)
+{
+    if (!search->found && id_of_event(*event) == search->id) {
+        search->found = 1;
+        search->event = *event;
+    }
+}
 
-    Status_Line status_line = chop_status_line(&buffer);
+static
+int serve_event(Request_Context *context)
+{
+    assert(context);
 
-    if (!string_equal(status_line.method, SLT("GET"))) {
-        return http_error(fd, 405, "Unknown method\n");
+    String id = route_param(&context->params, SLT("id"));
+    if (id.len == 0 || id.len > 18) {
+        return http_error(context->response, 400, "Incorrect event id\n");
     }
-    printf("[%.*s] %.*s\n",
-           (int) status_line.method.len, status_line.method.data,
-           (int) status_line.path.len, status_line.path.data);
 
-    String host = {0};
-    String header_line = trim(chop_line(&buffer));
-    Header header = {{0}, {0}};
-    while (header_line.len > 0) {
-        header = parse_header(header_line);
-        if (string_equal(header.name, SLT("Host"))) {
-            host = header.value;
+    struct Event_Search search = {0};
+    for (size_t i = 0; i < id.len; ++i) {
+        const char c = id.data[i];
+        if (!('0' <= c && c <= '9')) {
+            return http_error(context->response, 400, "Incorrect event id\n");
         }
-
-        header_line = trim(chop_line(&buffer));
+        search.id = search.id * 10 + (c - '0');
     }
 
-    // TODO(#56): serve static files from a specific folder instead of hardcoding routes
+    // NOTE: the time of the event may move it to the neighbour day
+    for (int i = -1; i <= 1 && !search.found; ++i) {
+        time_t day_time = search.id - timezone + i * SECONDS_IN_DAY;
+        struct tm *day = gmtime(&day_time);
+        events_at_day(*day, context->schedule, (EventCallback) match_event_id, &search);
+    }
 
-    String router = chop_until_char(&status_line.path, '/');
-    if (router.len != 0) {
-        return http_error(fd, 400, "Broken status line\n");
+    if (!search.found) {
+        return http_error(context->response, 404, "Unknown event\n");
     }
 
-    router = chop_until_char(&status_line.path, '/');
+    response_start(context->response, 200, CONTENT_TYPE_JSON);
+    print_event_json(&context->response->body, &search.event);
 
-#define STATIC_FOLDER "./public"
+    return 0;
+}
 
-    if (router.len == 0) {
-        return serve_file(fd, STATIC_FOLDER"/index.html", "text/html");
-    } else if (string_equal(router, SLT("api"))) {
-        router = chop_until_char(&status_line.path, '/');
+static
+int serve_event_stream(Request_Context *context)
+{
+    assert(context);
 
-        if (string_equal(router, SLT(""))) {
-            return serve_rest_map(memory, fd, host);
-        }
+    response_start(context->response, 200, CONTENT_TYPE_EVENT_STREAM);
+    context->response->streaming = 1;
 
-        if (string_equal(router, SLT("next_stream"))) {
-            return serve_next_stream(fd, memory, schedule);
-        }
+    if (!context->response->head_only) {
+        server_subscribe(context->server, context->connection);
+    }
 
-        if (string_equal(router, SLT("period_streams"))) {
-            return serve_period_streams(fd, memory, schedule);
-        }
-    } else if (string_equal(router, SLT("static"))) {
-#define STATIC_FILE_ROUTE(filename, mime)                               \
-        if (string_equal(status_line.path, SLT(filename))) {            \
-            return serve_file(fd, STATIC_FOLDER "/" filename, mime);    \
-        }
+    return 0;
+}
+
+// NOTE: the requests that did not match any route are accounted right
+// after the routes of the router
+static inline
+size_t metrics_route_of(const Router *router, size_t route)
+{
+    return route == ROUTE_NONE ? router->routes_count : route;
+}
 
-        // TODO(#60): generate static file routes at compile time
-        STATIC_FILE_ROUTE("favicon.png", "image/png");
-        STATIC_FILE_ROUTE("index.js", "text/javascript");
-        STATIC_FILE_ROUTE("main.css", "text/css");
-        STATIC_FILE_ROUTE("reset.css", "text/css");
+static
+uint64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + (uint64_t) ts.tv_nsec / 1000;
+}
 
-#undef STATIC_FILE_ROUTE
+// NOTE: RFC 9110 15.5.6: 405 must say what the resource does allow
+static
+void response_allow_header(Response *response, unsigned allowed_methods)
+{
+    Buffer *headers = &response->headers;
+    buffer_append_cstr(headers, "Allow: ");
+    int first = 1;
+    for (Http_Method method = 0; method < HTTP_METHOD_COUNT; ++method) {
+        if (allowed_methods & (1u << method)) {
+            if (!first) buffer_append_cstr(headers, ", ");
+            buffer_append_cstr(headers, http_method_as_cstr(method));
+            first = 0;
+        }
     }
+    buffer_append_cstr(headers, "\r\n");
+}
 
-#undef STATIC_FOLDER
-    return http_error(fd, 404, "Unknown path\n");
+static
+void route_request(Request_Context *context, const Router *router)
+{
+    const Http_Request *request = context->request;
+    const uint64_t begin = now_us();
+
+    Route_Match match = router_match(router, request->method, request->path, &context->params);
+    switch (match.status) {
+    case ROUTE_FOUND:
+        match.handler(context);
+        break;
+    case ROUTE_METHOD_NOT_ALLOWED:
+        http_error(context->response, 405, "Unknown method\n");
+        response_allow_header(context->response, match.allowed_methods);
+        break;
+    case ROUTE_NOT_FOUND:
+        http_error(context->response, 404, "Unknown path\n");
+        break;
+    }
+
+    const uint64_t duration_us = now_us() - begin;
+    metrics_request(metrics_route_of(router, match.route), context->response->code, duration_us);
+
+    const Response *response = context->response;
+    Log_Access access = {
+        .method = request->method_name,
+        .target = request->target,
+        .code = response->code,
+        .body_size = response->head_only ? 0
+            : response->content.data ? response->content.len : response->body.size,
+        .duration_us = duration_us,
+    };
+    log_access(&access);
 }
 
 #define MEMORY_CAPACITY (1 * MEGA)
+#define ROUTER_MEMORY_CAPACITY (64 * KILO)
 
 String mmap_file_to_string(const char *filepath)
 {
     int fd = open(filepath, O_RDONLY);
     if (fd < 0) {
-        fprintf(stderr, "Cannot open file `%s'\n", filepath);
-        abort();
+        log_message(LOG_ERROR, "Cannot open file `%s'", filepath);
+        return string_empty();
     }
 
     struct stat fd_stat;
@@ -499,6 +530,204 @@ void munmap_string(String s)
     munmap((void*) s.data, s.len);
 }
 
+
+// NOTE: the schedule is parsed into a temporary arena and then
+// compacted into a tightly sized one of its own, so the JSON tree does
+// not stay around for the lifetime of the process. Reloading loads the
+// file anew and switches to it only if that succeeded, so a broken
+// schedule.json does not take the server down.
+struct Skedudle
+{
+    const char *filepath;
+    Memory memory;
+    struct Schedule schedule;
+    Router router;
+    Timer next_stream_timer;
+};
+
+int load_schedule(const char *filepath, Memory *memory, struct Schedule *schedule)
+{
+    String input = mmap_file_to_string(filepath);
+    if (input.data == NULL) {
+        return -1;
+    }
+
+    // NOTE: mapped directly instead of malloc()-ed, so unmapping it
+    // surely gives the pages back to the system. free() may keep them
+    // in the heap. The capacity is the most the schedule can ever take,
+    // so the arena never overflows. Only the pages that are actually
+    // touched take memory.
+    if (input.len > (SIZE_MAX - SCHEDULE_MEMORY_BASE) / SCHEDULE_MEMORY_RATIO) {
+        log_message(LOG_ERROR, "`%s' is too big", filepath);
+        munmap_string(input);
+        return -1;
+    }
+    Memory parse_memory = {
+        .capacity = input.len * SCHEDULE_MEMORY_RATIO + SCHEDULE_MEMORY_BASE,
+    };
+    parse_memory.buffer = mmap(NULL, parse_memory.capacity, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (parse_memory.buffer == MAP_FAILED) {
+        log_message(LOG_ERROR, "Could not map %zu bytes to parse `%s': %s",
+                    parse_memory.capacity, filepath, strerror(errno));
+        munmap_string(input);
+        return -1;
+    }
+
+    Json_Result result = parse_json_value(&parse_memory, input);
+    if (result.is_error) {
+        print_json_error(stderr, result, input, filepath);
+        munmap_string(input);
+        munmap(parse_memory.buffer, parse_memory.capacity);
+        return -1;
+    }
+    log_message(LOG_INFO, "Parsing consumed %ld bytes of memory", parse_memory.size);
+    struct Schedule loaded;
+    if (json_as_schedule(&parse_memory, result.value, &loaded) < 0) {
+        log_message(LOG_ERROR, "`%s' is not a valid schedule", filepath);
+        munmap_string(input);
+        munmap(parse_memory.buffer, parse_memory.capacity);
+        return -1;
+    }
+    munmap_string(input);
+    metrics_arena(METRICS_ARENA_SCHEDULE, parse_memory.size);
+
+    if (loaded.timezone.len == 0) {
+        log_message(LOG_ERROR, "Timezone is not provided in the json file");
+        munmap(parse_memory.buffer, parse_memory.capacity);
+        return -1;
+    }
+
+    log_message(LOG_INFO, "Schedule timezone: %*.s", (int) loaded.timezone.len, loaded.timezone.data);
+
+    char schedule_timezone[256];
+    snprintf(schedule_timezone, 256, ":%*.s", (int) loaded.timezone.len, loaded.timezone.data);
+    setenv("TZ", schedule_timezone, 1);
+    tzset();
+
+    const size_t resident_before = resident_memory_size();
+    Memory compact_memory = {
+        .capacity = schedule_compact_size(&loaded),
+    };
+    compact_memory.buffer = malloc(compact_memory.capacity);
+    assert(compact_memory.buffer);
+    *schedule = schedule_compact(&compact_memory, &loaded);
+    munmap(parse_memory.buffer, parse_memory.capacity);
+    const size_t resident_after = resident_memory_size();
+
+    log_message(LOG_INFO, "Compacted the schedule from %zu to %zu bytes. Resident memory: %zu KB -> %zu KB",
+                parse_memory.size, compact_memory.size,
+                resident_before / KILO, resident_after / KILO);
+
+    *memory = compact_memory;
+    return 0;
+}
+
+// NOTE: broadcasts the next stream and schedules the broadcast for the
+// moment it changes
+static
+void broadcast_next_stream(Server *server)
+{
+    struct Skedudle *skedudle = server->data;
+    const time_t now = time(NULL);
+
+    Buffer data = buffer_of_memory(server->memory);
+    struct Event event;
+    time_t changes = now + SECONDS_IN_DAY;
+    if (next_event(now - timezone, &skedudle->schedule, &event)) {
+        print_event_json(&data, &event);
+        // NOTE: the same moment /api/next_stream starts returning the next event
+        changes = id_of_event(event) + timezone;
+    } else {
+        buffer_append_string(&data, SLT("null"));
+    }
+
+    server_broadcast(server, SLT("next_stream"), buffer_as_string(data));
+    memory_clean(server->memory);
+
+    server_timer_set(server, &skedudle->next_stream_timer,
+                     (uint64_t) (changes > now ? changes - now : 0) * 1000);
+}
+
+void next_stream_changed(Timer *timer, Server *server)
+{
+    (void) timer;
+    broadcast_next_stream(server);
+}
+
+static
+void skedudle_reload(Server *server)
+{
+    struct Skedudle *skedudle = server->data;
+
+    log_message(LOG_INFO, "Reloading %s", skedudle->filepath);
+
+    Memory memory;
+    struct Schedule schedule;
+    if (load_schedule(skedudle->filepath, &memory, &schedule) < 0) {
+        log_message(LOG_ERROR, "Could not reload the schedule. Keeping the old one.");
+        return;
+    }
+
+    free(skedudle->memory.buffer);
+    skedudle->memory = memory;
+    skedudle->schedule = schedule;
+
+    schedule_page.valid = 0;
+    server_timer_cancel(server, &schedule_page.expiry);
+    broadcast_next_stream(server);
+}
+
+static
+int serve_metrics(Request_Context *context)
+{
+    assert(context);
+
+    const Router *router = &((struct Skedudle *) context->server->data)->router;
+
+    String routes[METRICS_ROUTES_CAPACITY];
+    static_assert(ROUTER_ROUTES_CAPACITY < METRICS_ROUTES_CAPACITY,
+                  "The metrics must have room for every route and the unmatched requests");
+    memcpy(routes, router->routes, sizeof(router->routes[0]) * router->routes_count);
+    routes[metrics_route_of(router, ROUTE_NONE)] = SLT("unmatched");
+
+    response_start(context->response, 200, CONTENT_TYPE_PLAIN);
+    metrics_render(&context->response->body, routes, router->routes_count + 1);
+
+    Buffer *body = &context->response->body;
+    buffer_append_cstr(body, "# HELP skedudle_log_dropped_total Log records dropped because the ring was full.\n"
+                       "# TYPE skedudle_log_dropped_total counter\n"
+                       "skedudle_log_dropped_total ");
+    buffer_append_u64(body, log_dropped());
+    buffer_append_char(body, '\n');
+
+    return 0;
+}
+
+static
+void handle_request(Server *server, Connection *connection,
+                    const Http_Parser *parser, Response *response)
+{
+    struct Skedudle *skedudle = server->data;
+
+    if (parser->state == HTTP_PARSER_ERROR) {
+        http_error(response, parser->error_code, "%s\n", parser->error_message);
+        metrics_request(metrics_route_of(&skedudle->router, ROUTE_NONE), response->code, 0);
+        return;
+    }
+
+    Request_Context context = {
+        .server = server,
+        .connection = connection,
+        .memory = server->memory,
+        .schedule = &skedudle->schedule,
+        .request = &parser->request,
+        .response = response,
+    };
+
+    route_request(&context, &skedudle->router);
+}
+
 int main(int argc, char *argv[])
 {
     if (argc < 3) {
@@ -506,6 +735,11 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
+    if (log_init() < 0) {
+        fprintf(stderr, "Could not start the logger: %s\n", strerror(errno));
+        exit(1);
+    }
+
     const char *filepath = argv[1];
     const char *port_cstr = argv[2];
     const char *addr = "127.0.0.1";
@@ -513,11 +747,10 @@ int main(int argc, char *argv[])
         addr = argv[3];
     }
 
-    Memory json_memory = {
-        .capacity = MEMORY_CAPACITY,
-        .buffer = malloc(MEMORY_CAPACITY)
-    };
-    assert(json_memory.buffer);
+    struct Skedudle skedudle = { .filepath = filepath };
+    if (load_schedule(filepath, &skedudle.memory, &skedudle.schedule) < 0) {
+        exit(1);
+    }
 
     Memory request_memory = {
         .capacity = MEMORY_CAPACITY,
@@ -525,28 +758,6 @@ int main(int argc, char *argv[])
     };
     assert(request_memory.buffer);
 
-    String input = mmap_file_to_string(filepath);
-    Json_Result result = parse_json_value(&json_memory, input);
-    if (result.is_error) {
-        print_json_error(stderr, result, input, filepath);
-        exit(1);
-    }
-    printf("Parsing consumed %ld bytes of memory\n", json_memory.size);
-    struct Schedule schedule = json_as_schedule(&json_memory, result.value);
-    munmap_string(input);
-
-    if (schedule.timezone.len == 0) {
-        fprintf(stderr, "Timezone is not provided in the json file\n");
-        exit(1);
-    }
-
-    printf("Schedule timezone: %*.s\n", (int) schedule.timezone.len, schedule.timezone.data);
-
-    char schedule_timezone[256];
-    snprintf(schedule_timezone, 256, ":%*.s", (int) schedule.timezone.len, schedule.timezone.data);
-    setenv("TZ", schedule_timezone, 1);
-    tzset();
-
     uint16_t port = 0;
 
     {
@@ -579,37 +790,69 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
-    err = listen(server_fd, 69);
+    err = listen(server_fd, SOMAXCONN);
     if (err != 0) {
         fprintf(stderr, "Could not listen to socket, it's too quiet: %s\n", strerror(errno));
         exit(1);
     }
 
-    printf("[INFO] Listening to http://%s:%d/\n", addr, port);
+    // NOTE: a client that went away must not kill the whole server
+    signal(SIGPIPE, SIG_IGN);
 
-    for (;;) {
-        struct sockaddr_in client_addr;
-        socklen_t client_addrlen = 0;
-        int client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &client_addrlen);
-        if (client_fd < 0) {
-            fprintf(stderr, "Could not accept connection. This is unacceptable! %s\n", strerror(errno));
-            exit(1);
-        }
+    schedule_page.memory = (Memory) {
+        .capacity = MEMORY_CAPACITY,
+        .buffer = malloc(MEMORY_CAPACITY)
+    };
+    assert(schedule_page.memory.buffer);
 
-        assert(client_addrlen == sizeof(client_addr));
+    Memory router_memory = {
+        .capacity = ROUTER_MEMORY_CAPACITY,
+        .buffer = malloc(ROUTER_MEMORY_CAPACITY)
+    };
+    assert(router_memory.buffer);
+
+    Router *router = &skedudle.router;
+    router->memory = &router_memory;
+    router_add(router, HTTP_METHOD_GET, SLT("/"), serve_index);
+    router_add(router, HTTP_METHOD_GET, SLT("/api"), serve_rest_map);
+    router_add(router, HTTP_METHOD_GET, SLT("/api/"), serve_rest_map);
+    router_add(router, HTTP_METHOD_GET, SLT("/api/next_stream"), serve_next_stream);
+    router_add(router, HTTP_METHOD_GET, SLT("/api/period_streams"), serve_period_streams);
+    router_add(router, HTTP_METHOD_GET, SLT("/api/events/stream"), serve_event_stream);
+    router_add(router, HTTP_METHOD_GET, SLT("/api/events/:id"), serve_event);
+    router_add(router, HTTP_METHOD_GET, SLT("/static/*path"), serve_static);
+    router_add(router, HTTP_METHOD_GET, SLT("/metrics"), serve_metrics);
+
+    // NOTE: SKEDUDLE_BACKEND=io_uring opts into the io_uring backend
+    const char *backend = getenv("SKEDUDLE_BACKEND");
+
+    Server server = {
+        .backend = backend && strcmp(backend, "io_uring") == 0
+            ? SERVER_BACKEND_IO_URING
+            : SERVER_BACKEND_EPOLL,
+        .memory = &request_memory,
+        .data = &skedudle,
+        .handler = handle_request,
+        .reload = skedudle_reload,
+    };
+    if (server_init(&server, server_fd) < 0) {
+        fprintf(stderr, "Could not start the event loop: %s\n", strerror(errno));
+        exit(1);
+    }
 
-        // TODO(#57): running out of request memory should not crash the application
-        handle_request(client_fd, &client_addr, &request_memory, &schedule);
-        request_memory.size = 0;
+    skedudle.next_stream_timer.callback = (Timer_Callback) next_stream_changed;
+    skedudle.next_stream_timer.data = &server;
+    broadcast_next_stream(&server);
 
-        err = close(client_fd);
-        if (err < 0) {
-            fprintf(stderr, "Could not close client connection: %s\n", strerror(errno));
-        }
-    }
+    log_message(LOG_INFO, "Listening to http://%s:%d/ (%s)", addr, port,
+           server.backend == SERVER_BACKEND_IO_URING ? "io_uring" : "epoll");
+
+    server_run(&server);
 
-    free(json_memory.buffer);
+    free(skedudle.memory.buffer);
     free(request_memory.buffer);
+    free(router_memory.buffer);
+    free(schedule_page.memory.buffer);
 
     return 0;
 }
@@ -0,0 +1,240 @@
+#define _DEFAULT_SOURCE
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "metrics.h"
+
+_Thread_local Metrics_Shard *metrics_local_shard = NULL;
+
+// NOTE: every shard ever created. Shards are pushed with a CAS and
+// never removed, so the scraper can walk the list at any moment.
+static Metrics_Shard *metrics_shards = NULL;
+
+typedef struct {
+    uint64_t us;
+    const char *le;
+} Metrics_Bucket;
+
+static const Metrics_Bucket latency_buckets[METRICS_LATENCY_BUCKETS_COUNT - 1] = {
+    {50, "0.00005"},
+    {100, "0.0001"},
+    {250, "0.00025"},
+    {500, "0.0005"},
+    {1000, "0.001"},
+    {2500, "0.0025"},
+    {5000, "0.005"},
+    {10000, "0.01"},
+    {25000, "0.025"},
+    {50000, "0.05"},
+    {100000, "0.1"},
+    {250000, "0.25"},
+    {1000000, "1"},
+};
+
+static const char *const arena_names[METRICS_ARENA_COUNT] = {
+    [METRICS_ARENA_REQUEST] = "request",
+    [METRICS_ARENA_SCHEDULE] = "schedule",
+    [METRICS_ARENA_SCHEDULE_PAGE] = "schedule_page",
+};
+
+Metrics_Shard *metrics_shard_slow(void)
+{
+    Metrics_Shard *shard = aligned_alloc(METRICS_CACHE_LINE, sizeof(Metrics_Shard));
+    assert(shard);
+    memset(shard, 0, sizeof(*shard));
+
+    shard->next = __atomic_load_n(&metrics_shards, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&metrics_shards, &shard->next, shard, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+
+    metrics_local_shard = shard;
+    return shard;
+}
+
+void metrics_request(size_t route, int code, uint64_t latency_us)
+{
+    assert(route < METRICS_ROUTES_CAPACITY);
+
+    Metrics_Shard *shard = metrics_shard();
+    Metrics_Route *metrics = &shard->routes[route];
+
+    size_t bucket = 0;
+    while (bucket < METRICS_LATENCY_BUCKETS_COUNT - 1 && latency_us > latency_buckets[bucket].us) {
+        bucket += 1;
+    }
+
+    metrics_add(&metrics->requests, 1);
+    metrics_add(&metrics->latency_sum_us, latency_us);
+    metrics_add(&metrics->latency[bucket], 1);
+
+    if (METRICS_STATUS_MIN <= code && code <= METRICS_STATUS_MAX) {
+        metrics_add(&shard->statuses[code - METRICS_STATUS_MIN], 1);
+    }
+}
+
+static
+uint64_t metrics_load(const uint64_t *counter)
+{
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+// NOTE: the sum of the field across all the shards
+#define METRICS_SUM(result, field)                                      \
+    do {                                                                \
+        (result) = 0;                                                   \
+        for (const Metrics_Shard *shard__ = shards; shard__; shard__ = shard__->next) { \
+            (result) += metrics_load(&shard__->field);                  \
+        }                                                               \
+    } while (0)
+
+static
+void metrics_render_seconds(Buffer *buffer, uint64_t us)
+{
+    char fraction[7];
+    uint64_t x = us % 1000000;
+    for (int i = 5; i >= 0; --i) {
+        fraction[i] = (char) ('0' + x % 10);
+        x /= 10;
+    }
+    fraction[6] = '\0';
+
+    buffer_append_u64(buffer, us / 1000000);
+    buffer_append_char(buffer, '.');
+    buffer_append(buffer, fraction, 6);
+}
+
+static
+void metrics_render_header(Buffer *buffer, const char *name, const char *type, const char *help)
+{
+    buffer_append_cstr(buffer, "# HELP ");
+    buffer_append_cstr(buffer, name);
+    buffer_append_char(buffer, ' ');
+    buffer_append_cstr(buffer, help);
+    buffer_append_cstr(buffer, "\n# TYPE ");
+    buffer_append_cstr(buffer, name);
+    buffer_append_char(buffer, ' ');
+    buffer_append_cstr(buffer, type);
+    buffer_append_char(buffer, '\n');
+}
+
+static
+void metrics_render_route_label(Buffer *buffer, String route)
+{
+    buffer_append_cstr(buffer, "route=\"");
+    for (size_t i = 0; i < route.len; ++i) {
+        if (route.data[i] == '"' || route.data[i] == '\\') {
+            buffer_append_char(buffer, '\\');
+        }
+        buffer_append_char(buffer, route.data[i]);
+    }
+    buffer_append_char(buffer, '"');
+}
+
+void metrics_render(Buffer *buffer, const String *routes, size_t routes_count)
+{
+    assert(buffer);
+    assert(routes_count <= METRICS_ROUTES_CAPACITY);
+
+    const Metrics_Shard *shards = __atomic_load_n(&metrics_shards, __ATOMIC_ACQUIRE);
+    uint64_t value = 0;
+
+    metrics_render_header(buffer, "skedudle_http_requests_total", "counter",
+                          "Requests handled, by route.");
+    for (size_t route = 0; route < routes_count; ++route) {
+        METRICS_SUM(value, routes[route].requests);
+        buffer_append_cstr(buffer, "skedudle_http_requests_total{");
+        metrics_render_route_label(buffer, routes[route]);
+        buffer_append_cstr(buffer, "} ");
+        buffer_append_u64(buffer, value);
+        buffer_append_char(buffer, '\n');
+    }
+
+    metrics_render_header(buffer, "skedudle_http_responses_total", "counter",
+                          "Responses sent, by status code.");
+    for (int code = METRICS_STATUS_MIN; code <= METRICS_STATUS_MAX; ++code) {
+        METRICS_SUM(value, statuses[code - METRICS_STATUS_MIN]);
+        if (value == 0) continue;
+        buffer_append_cstr(buffer, "skedudle_http_responses_total{code=\"");
+        buffer_append_u64(buffer, (uint64_t) code);
+        buffer_append_cstr(buffer, "\"} ");
+        buffer_append_u64(buffer, value);
+        buffer_append_char(buffer, '\n');
+    }
+
+    metrics_render_header(buffer, "skedudle_http_request_duration_seconds", "histogram",
+                          "Time spent producing the response, by route.");
+    for (size_t route = 0; route < routes_count; ++route) {
+        uint64_t cumulative = 0;
+        for (size_t bucket = 0; bucket < METRICS_LATENCY_BUCKETS_COUNT; ++bucket) {
+            METRICS_SUM(value, routes[route].latency[bucket]);
+            cumulative += value;
+
+            buffer_append_cstr(buffer, "skedudle_http_request_duration_seconds_bucket{");
+            metrics_render_route_label(buffer, routes[route]);
+            buffer_append_cstr(buffer, ",le=\"");
+            buffer_append_cstr(buffer, bucket < METRICS_LATENCY_BUCKETS_COUNT - 1
+                               ? latency_buckets[bucket].le
+                               : "+Inf");
+            buffer_append_cstr(buffer, "\"} ");
+            buffer_append_u64(buffer, cumulative);
+            buffer_append_char(buffer, '\n');
+        }
+
+        METRICS_SUM(value, routes[route].latency_sum_us);
+        buffer_append_cstr(buffer, "skedudle_http_request_duration_seconds_sum{");
+        metrics_render_route_label(buffer, routes[route]);
+        buffer_append_cstr(buffer, "} ");
+        metrics_render_seconds(buffer, value);
+        buffer_append_char(buffer, '\n');
+
+        buffer_append_cstr(buffer, "skedudle_http_request_duration_seconds_count{");
+        metrics_render_route_label(buffer, routes[route]);
+        buffer_append_cstr(buffer, "} ");
+        buffer_append_u64(buffer, cumulative);
+        buffer_append_char(buffer, '\n');
+    }
+
+    metrics_render_header(buffer, "skedudle_sent_bytes_total", "counter",
+                          "Bytes written to the sockets.");
+    METRICS_SUM(value, bytes_sent);
+    buffer_append_cstr(buffer, "skedudle_sent_bytes_total ");
+    buffer_append_u64(buffer, value);
+    buffer_append_char(buffer, '\n');
+
+    uint64_t opened = 0;
+    uint64_t closed = 0;
+    METRICS_SUM(opened, connections_opened);
+    METRICS_SUM(closed, connections_closed);
+
+    metrics_render_header(buffer, "skedudle_connections_total", "counter",
+                          "Connections accepted.");
+    buffer_append_cstr(buffer, "skedudle_connections_total ");
+    buffer_append_u64(buffer, opened);
+    buffer_append_char(buffer, '\n');
+
+    // NOTE: the counters of different shards are read at slightly
+    // different moments, so the difference may be off by a bit
+    metrics_render_header(buffer, "skedudle_connections_open", "gauge",
+                          "Connections currently open.");
+    buffer_append_cstr(buffer, "skedudle_connections_open ");
+    buffer_append_u64(buffer, opened > closed ? opened - closed : 0);
+    buffer_append_char(buffer, '\n');
+
+    metrics_render_header(buffer, "skedudle_arena_high_water_bytes", "gauge",
+                          "The most memory an arena ever had in use.");
+    for (size_t arena = 0; arena < METRICS_ARENA_COUNT; ++arena) {
+        uint64_t high_water = 0;
+        for (const Metrics_Shard *shard = shards; shard; shard = shard->next) {
+            const uint64_t x = metrics_load(&shard->arena_high_water[arena]);
+            if (x > high_water) high_water = x;
+        }
+
+        buffer_append_cstr(buffer, "skedudle_arena_high_water_bytes{arena=\"");
+        buffer_append_cstr(buffer, arena_names[arena]);
+        buffer_append_cstr(buffer, "\"} ");
+        buffer_append_u64(buffer, high_water);
+        buffer_append_char(buffer, '\n');
+    }
+}
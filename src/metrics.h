@@ -0,0 +1,112 @@
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <stdalign.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "s.h"
+#include "buffer.h"
+
+// NOTE: Counters of what the server is doing, exposed in the Prometheus
+// text format. Every thread that touches the counters gets its own
+// shard, so the hot path is a plain increment of a cache line nobody
+// else writes to: no locks, no atomic read-modify-writes. The shards
+// are summed up only when the metrics are scraped.
+
+#define METRICS_CACHE_LINE 64
+#define METRICS_ROUTES_CAPACITY 32
+#define METRICS_STATUS_MIN 100
+#define METRICS_STATUS_MAX 599
+
+// NOTE: the latency buckets are listed in metrics.c, the last one is +Inf
+#define METRICS_LATENCY_BUCKETS_COUNT 14
+
+typedef enum {
+    METRICS_ARENA_REQUEST = 0,
+    METRICS_ARENA_SCHEDULE,
+    METRICS_ARENA_SCHEDULE_PAGE,
+    METRICS_ARENA_COUNT
+} Metrics_Arena;
+
+typedef struct {
+    uint64_t requests;
+    uint64_t latency_sum_us;
+    uint64_t latency[METRICS_LATENCY_BUCKETS_COUNT];
+} Metrics_Route;
+
+typedef struct Metrics_Shard Metrics_Shard;
+
+// NOTE: the shard starts and ends at a cache line boundary, so the
+// shards of different threads never share a line
+struct Metrics_Shard {
+    alignas(METRICS_CACHE_LINE) Metrics_Route routes[METRICS_ROUTES_CAPACITY];
+    uint64_t statuses[METRICS_STATUS_MAX - METRICS_STATUS_MIN + 1];
+    uint64_t bytes_sent;
+    uint64_t connections_opened;
+    uint64_t connections_closed;
+    uint64_t arena_high_water[METRICS_ARENA_COUNT];
+    Metrics_Shard *next;
+};
+
+// NOTE: the shard of the calling thread. Created on the first call.
+Metrics_Shard *metrics_shard_slow(void);
+
+extern _Thread_local Metrics_Shard *metrics_local_shard;
+
+static inline
+Metrics_Shard *metrics_shard(void)
+{
+    Metrics_Shard *shard = metrics_local_shard;
+    return shard ? shard : metrics_shard_slow();
+}
+
+// NOTE: only the owner thread ever writes to its counters, so there is
+// no need for an atomic increment. The relaxed accesses are only there
+// so the scraping thread never sees a torn value.
+static inline
+void metrics_add(uint64_t *counter, uint64_t x)
+{
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + x, __ATOMIC_RELAXED);
+}
+
+static inline
+void metrics_max(uint64_t *gauge, uint64_t x)
+{
+    if (x > __atomic_load_n(gauge, __ATOMIC_RELAXED)) {
+        __atomic_store_n(gauge, x, __ATOMIC_RELAXED);
+    }
+}
+
+void metrics_request(size_t route, int code, uint64_t latency_us);
+
+static inline
+void metrics_bytes_sent(size_t size)
+{
+    metrics_add(&metrics_shard()->bytes_sent, size);
+}
+
+static inline
+void metrics_connection_opened(void)
+{
+    metrics_add(&metrics_shard()->connections_opened, 1);
+}
+
+static inline
+void metrics_connection_closed(void)
+{
+    metrics_add(&metrics_shard()->connections_closed, 1);
+}
+
+static inline
+void metrics_arena(Metrics_Arena arena, size_t size)
+{
+    metrics_max(&metrics_shard()->arena_high_water[arena], size);
+}
+
+// NOTE: sums up all of the shards and renders them in the Prometheus
+// text format. routes are the labels of the route indices passed to
+// metrics_request().
+void metrics_render(Buffer *buffer, const String *routes, size_t routes_count);
+
+#endif  // METRICS_H_
@@ -99,6 +99,42 @@ ssize_t sendfile_wrapper(int out_fd, int in_fd, off_t* offset, size_t count)
 }
 
 
+#endif
+
+// the resident set size of the process in bytes. 0 when the platform
+// does not tell.
+
+#if __linux__
+
+#include <stdio.h>
+#include <unistd.h>
+
+static inline
+size_t resident_memory_size(void)
+{
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm == NULL)
+        return 0;
+
+    unsigned long size = 0;
+    unsigned long resident = 0;
+    int n = fscanf(statm, "%lu %lu", &size, &resident);
+    fclose(statm);
+
+    if (n != 2)
+        return 0;
+
+    return (size_t) resident * (size_t) sysconf(_SC_PAGESIZE);
+}
+
+#else
+
+static inline
+size_t resident_memory_size(void)
+{
+    return 0;
+}
+
 #endif
 
 #endif  // PLATFORM_SPECIFIC_H_
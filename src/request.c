@@ -0,0 +1,502 @@
+#include <assert.h>
+#include <string.h>
+
+#include "request.h"
+
+static const char *const known_header_names[HTTP_HEADER_KNOWN_COUNT] = {
+    [HTTP_HEADER_HOST]              = "host",
+    [HTTP_HEADER_CONNECTION]        = "connection",
+    [HTTP_HEADER_CONTENT_LENGTH]    = "content-length",
+    [HTTP_HEADER_TRANSFER_ENCODING] = "transfer-encoding",
+    [HTTP_HEADER_IF_NONE_MATCH]     = "if-none-match",
+    [HTTP_HEADER_ACCEPT]            = "accept",
+    [HTTP_HEADER_USER_AGENT]        = "user-agent",
+};
+
+static inline
+char http_tolower(char c)
+{
+    return ('A' <= c && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+static inline
+int http_isows(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+static inline
+int http_istchar(char c)
+{
+    return ('a' <= c && c <= 'z')
+        || ('A' <= c && c <= 'Z')
+        || ('0' <= c && c <= '9')
+        || (c != '\0' && strchr("!#$%&'*+-.^_`|~", c) != NULL);
+}
+
+static
+int string_equal_ignore_case(String a, String b)
+{
+    if (a.len != b.len) return 0;
+    for (size_t i = 0; i < a.len; ++i) {
+        if (http_tolower(a.data[i]) != http_tolower(b.data[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static
+String http_trim(String s)
+{
+    while (s.len && http_isows(*s.data)) {
+        s.data++;
+        s.len--;
+    }
+    while (s.len && http_isows(s.data[s.len - 1])) {
+        s.len--;
+    }
+    return s;
+}
+
+static
+Http_Header_Id http_header_id_of_name(String name)
+{
+    for (Http_Header_Id id = 0; id < HTTP_HEADER_KNOWN_COUNT; ++id) {
+        // NOTE: the length check rejects almost all of the names before the comparison
+        if (name.len == strlen(known_header_names[id]) &&
+            string_equal_ignore_case(name, cstr_as_string(known_header_names[id]))) {
+            return id;
+        }
+    }
+    return HTTP_HEADER_UNKNOWN;
+}
+
+String http_request_find_header(const Http_Request *request, String name)
+{
+    assert(request);
+
+    for (size_t i = 0; i < request->headers_count; ++i) {
+        if (string_equal_ignore_case(request->headers[i].name, name)) {
+            return request->headers[i].value;
+        }
+    }
+
+    return string_empty();
+}
+
+void http_parser_init(Http_Parser *parser)
+{
+    assert(parser);
+    memset(parser, 0, sizeof(*parser));
+    parser->head_limit = HTTP_HEAD_SIZE_LIMIT;
+    parser->body_limit = HTTP_BODY_SIZE_LIMIT;
+    parser->request.method = HTTP_METHOD_UNKNOWN;
+}
+
+static
+Http_Parse_Status http_parser_fail(Http_Parser *parser, int code, const char *message)
+{
+    parser->state = HTTP_PARSER_ERROR;
+    parser->error_code = code;
+    parser->error_message = message;
+    return HTTP_PARSE_ERROR;
+}
+
+// NOTE: chops the next line off the buffer. Returns 0 if the line has
+// not arrived completely yet. Bare LF is accepted as a line terminator
+// as RFC 7230 3.5 suggests.
+static
+int http_parser_chop_line(Http_Parser *parser, char *buffer, size_t size, String *line)
+{
+    assert(parser->cursor <= size);
+
+    // NOTE: the bytes up to parser->scanned were already checked for
+    // '\n' by the previous calls, no need to look at them again.
+    const size_t start = parser->scanned > parser->cursor ? parser->scanned : parser->cursor;
+    const String rest = string(size - start, buffer + start);
+    const size_t index = string_find_char(rest, '\n');
+    if (index == rest.len) {
+        parser->scanned = size;
+        return 0;
+    }
+
+    const char *begin = buffer + parser->cursor;
+    const char *end = rest.data + index;
+
+    line->data = begin;
+    line->len = (size_t) (end - begin);
+    if (line->len > 0 && line->data[line->len - 1] == '\r') {
+        line->len -= 1;
+    }
+
+    parser->cursor = (size_t) (end - buffer) + 1;
+    return 1;
+}
+
+static
+int http_parse_decimal(String s, size_t *result)
+{
+    // NOTE: 18 digits always fit into size_t without overflowing
+    if (s.len == 0 || s.len > 18) {
+        return 0;
+    }
+
+    size_t value = 0;
+    for (size_t i = 0; i < s.len; ++i) {
+        if (!('0' <= s.data[i] && s.data[i] <= '9')) {
+            return 0;
+        }
+        value = value * 10 + (size_t) (s.data[i] - '0');
+    }
+
+    *result = value;
+    return 1;
+}
+
+static
+int http_has_token(String list, String token)
+{
+    while (list.len > 0) {
+        String item = http_trim(chop_until_char(&list, ','));
+        if (string_equal_ignore_case(item, token)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static
+Http_Parse_Status http_parse_request_line(Http_Parser *parser, String line)
+{
+    Http_Request *request = &parser->request;
+
+    String method = chop_until_char(&line, ' ');
+    String target = chop_until_char(&line, ' ');
+    String version = line;
+
+    if (method.len == 0) {
+        return http_parser_fail(parser, 400, "Empty method");
+    }
+    for (size_t i = 0; i < method.len; ++i) {
+        if (!http_istchar(method.data[i])) {
+            return http_parser_fail(parser, 400, "Incorrect method");
+        }
+    }
+
+    if (target.len == 0) {
+        return http_parser_fail(parser, 400, "Empty request target");
+    }
+    for (size_t i = 0; i < target.len; ++i) {
+        const unsigned char c = (unsigned char) target.data[i];
+        if (c <= ' ' || c == 0x7f) {
+            return http_parser_fail(parser, 400, "Incorrect request target");
+        }
+    }
+
+    if (!prefix_of(SLT("HTTP/"), version)) {
+        return http_parser_fail(parser, 400, "Incorrect HTTP version");
+    }
+    chop(&version, 5);
+    if (version.len != 3 || version.data[1] != '.' ||
+        !('0' <= version.data[0] && version.data[0] <= '9') ||
+        !('0' <= version.data[2] && version.data[2] <= '9')) {
+        return http_parser_fail(parser, 400, "Incorrect HTTP version");
+    }
+    if (version.data[0] != '1') {
+        return http_parser_fail(parser, 505, "Unsupported HTTP version");
+    }
+
+    request->method_name = method;
+    request->method = http_method_of_string(method);
+    request->target = target;
+    request->version_minor = version.data[2] - '0';
+
+    if (*target.data == '/') {
+        request->path = chop_until_char(&target, '?');
+        request->query = target;
+    } else if (!(string_equal(target, SLT("*")) && request->method == HTTP_METHOD_OPTIONS)) {
+        return http_parser_fail(parser, 400, "Unsupported form of request target");
+    }
+
+    return HTTP_PARSE_INCOMPLETE;
+}
+
+static
+Http_Parse_Status http_parse_header_line(Http_Parser *parser, String line)
+{
+    Http_Request *request = &parser->request;
+
+    if (http_isows(*line.data)) {
+        return http_parser_fail(parser, 400, "Obsolete header line folding");
+    }
+
+    size_t colon = 0;
+    while (colon < line.len && line.data[colon] != ':') {
+        if (!http_istchar(line.data[colon])) {
+            return http_parser_fail(parser, 400, "Incorrect header name");
+        }
+        ++colon;
+    }
+
+    if (colon == 0 || colon == line.len) {
+        return http_parser_fail(parser, 400, "Incorrect header line");
+    }
+
+    Header header = {
+        .name = take(line, colon),
+        .value = http_trim(drop(line, colon + 1)),
+    };
+
+    for (size_t i = 0; i < header.value.len; ++i) {
+        const unsigned char c = (unsigned char) header.value.data[i];
+        if ((c < ' ' && c != '\t') || c == 0x7f) {
+            return http_parser_fail(parser, 400, "Incorrect header value");
+        }
+    }
+
+    if (request->headers_count >= HTTP_HEADERS_CAPACITY) {
+        return http_parser_fail(parser, 431, "Too many headers");
+    }
+    request->headers[request->headers_count++] = header;
+
+    Http_Header_Id id = http_header_id_of_name(header.name);
+    if (id == HTTP_HEADER_UNKNOWN) {
+        return HTTP_PARSE_INCOMPLETE;
+    }
+
+    if (request->known_headers[id].data != NULL) {
+        if (id == HTTP_HEADER_HOST) {
+            return http_parser_fail(parser, 400, "Duplicate Host header");
+        }
+        if (id == HTTP_HEADER_CONTENT_LENGTH &&
+            !string_equal(request->known_headers[id], header.value)) {
+            return http_parser_fail(parser, 400, "Conflicting Content-Length headers");
+        }
+        return HTTP_PARSE_INCOMPLETE;
+    }
+
+    request->known_headers[id] = header.value;
+
+    return HTTP_PARSE_INCOMPLETE;
+}
+
+static
+Http_Parse_Status http_parse_head_end(Http_Parser *parser, char *buffer)
+{
+    Http_Request *request = &parser->request;
+
+    if (request->version_minor >= 1 && request->known_headers[HTTP_HEADER_HOST].data == NULL) {
+        return http_parser_fail(parser, 400, "Missing Host header");
+    }
+
+    String connection = request->known_headers[HTTP_HEADER_CONNECTION];
+    if (request->version_minor >= 1) {
+        request->keep_alive = !http_has_token(connection, SLT("close"));
+    } else {
+        request->keep_alive = http_has_token(connection, SLT("keep-alive"));
+    }
+
+    String transfer_encoding = request->known_headers[HTTP_HEADER_TRANSFER_ENCODING];
+    String content_length = request->known_headers[HTTP_HEADER_CONTENT_LENGTH];
+
+    parser->body_start = parser->cursor;
+    request->body = string(0, buffer + parser->body_start);
+
+    if (transfer_encoding.data != NULL) {
+        // NOTE: RFC 7230 3.3.3: both of them at the same time is a
+        // sign of request smuggling, so we don't even try.
+        if (content_length.data != NULL) {
+            return http_parser_fail(parser, 400, "Both Transfer-Encoding and Content-Length");
+        }
+        if (!string_equal_ignore_case(transfer_encoding, SLT("chunked"))) {
+            return http_parser_fail(parser, 501, "Unsupported Transfer-Encoding");
+        }
+        parser->state = HTTP_PARSER_CHUNK_SIZE;
+    } else if (content_length.data != NULL) {
+        if (!http_parse_decimal(content_length, &parser->content_length)) {
+            return http_parser_fail(parser, 400, "Incorrect Content-Length");
+        }
+        if (parser->content_length > parser->body_limit) {
+            return http_parser_fail(parser, 413, "Request body is too large");
+        }
+        parser->state = HTTP_PARSER_BODY;
+    } else {
+        parser->state = HTTP_PARSER_DONE;
+    }
+
+    return HTTP_PARSE_INCOMPLETE;
+}
+
+static
+Http_Parse_Status http_parse_chunk_size(Http_Parser *parser, String line)
+{
+    size_t chunk_size = 0;
+    size_t digits = 0;
+
+    while (line.len > 0) {
+        char c = http_tolower(*line.data);
+        size_t x = 0;
+        if ('0' <= c && c <= '9') {
+            x = (size_t) (c - '0');
+        } else if ('a' <= c && c <= 'f') {
+            x = (size_t) (c - 'a' + 10);
+        } else {
+            break;
+        }
+
+        chunk_size = chunk_size * 16 + x;
+        digits += 1;
+        chop(&line, 1);
+
+        if (chunk_size > parser->body_limit) {
+            return http_parser_fail(parser, 413, "Request body is too large");
+        }
+    }
+
+    line = http_trim(line);
+    if (digits == 0 || (line.len > 0 && *line.data != ';')) {
+        return http_parser_fail(parser, 400, "Incorrect chunk size");
+    }
+
+    if (parser->request.body.len + chunk_size > parser->body_limit) {
+        return http_parser_fail(parser, 413, "Request body is too large");
+    }
+
+    parser->chunk_remaining = chunk_size;
+    parser->state = chunk_size == 0 ? HTTP_PARSER_TRAILERS : HTTP_PARSER_CHUNK_DATA;
+
+    return HTTP_PARSE_INCOMPLETE;
+}
+
+Http_Parse_Status http_parser_feed(Http_Parser *parser, char *buffer, size_t size)
+{
+    assert(parser);
+    assert(buffer || size == 0);
+
+    Http_Request *request = &parser->request;
+    String line = {0};
+
+    for (;;) {
+        Http_Parse_Status status = HTTP_PARSE_INCOMPLETE;
+
+        switch (parser->state) {
+        case HTTP_PARSER_REQUEST_LINE: {
+            if (!http_parser_chop_line(parser, buffer, size, &line)) {
+                if (size - parser->cursor > parser->head_limit) {
+                    return http_parser_fail(parser, 414, "Request line is too long");
+                }
+                return HTTP_PARSE_INCOMPLETE;
+            }
+
+            // NOTE: RFC 7230 3.5: ignore empty lines before the request line
+            if (line.len == 0) {
+                continue;
+            }
+
+            parser->state = HTTP_PARSER_HEADERS;
+            status = http_parse_request_line(parser, line);
+        } break;
+
+        case HTTP_PARSER_HEADERS: {
+            if (!http_parser_chop_line(parser, buffer, size, &line)) {
+                if (size > parser->head_limit) {
+                    return http_parser_fail(parser, 431, "Request header fields are too large");
+                }
+                return HTTP_PARSE_INCOMPLETE;
+            }
+
+            if (parser->cursor > parser->head_limit) {
+                return http_parser_fail(parser, 431, "Request header fields are too large");
+            }
+
+            if (line.len == 0) {
+                status = http_parse_head_end(parser, buffer);
+            } else {
+                status = http_parse_header_line(parser, line);
+            }
+        } break;
+
+        case HTTP_PARSER_BODY: {
+            if (size - parser->cursor < parser->content_length) {
+                return HTTP_PARSE_INCOMPLETE;
+            }
+
+            request->body = string(parser->content_length, buffer + parser->cursor);
+            parser->cursor += parser->content_length;
+            parser->state = HTTP_PARSER_DONE;
+        } break;
+
+        case HTTP_PARSER_CHUNK_SIZE: {
+            if (!http_parser_chop_line(parser, buffer, size, &line)) {
+                if (size - parser->cursor > parser->head_limit) {
+                    return http_parser_fail(parser, 400, "Chunk size line is too long");
+                }
+                return HTTP_PARSE_INCOMPLETE;
+            }
+
+            status = http_parse_chunk_size(parser, line);
+        } break;
+
+        case HTTP_PARSER_CHUNK_DATA: {
+            size_t n = size - parser->cursor;
+            if (n > parser->chunk_remaining) {
+                n = parser->chunk_remaining;
+            }
+
+            // NOTE: decoding in place. The decoded body is never longer
+            // than the encoded one, so we only ever move the bytes back.
+            char *body_end = buffer + parser->body_start + request->body.len;
+            memmove(body_end, buffer + parser->cursor, n);
+            request->body.len += n;
+            parser->cursor += n;
+            parser->chunk_remaining -= n;
+
+            if (parser->chunk_remaining > 0) {
+                return HTTP_PARSE_INCOMPLETE;
+            }
+
+            parser->state = HTTP_PARSER_CHUNK_DATA_END;
+        } break;
+
+        case HTTP_PARSER_CHUNK_DATA_END: {
+            if (!http_parser_chop_line(parser, buffer, size, &line)) {
+                if (size - parser->cursor > 2) {
+                    return http_parser_fail(parser, 400, "Expected CRLF after the chunk data");
+                }
+                return HTTP_PARSE_INCOMPLETE;
+            }
+
+            if (line.len != 0) {
+                return http_parser_fail(parser, 400, "Expected CRLF after the chunk data");
+            }
+
+            parser->state = HTTP_PARSER_CHUNK_SIZE;
+        } break;
+
+        case HTTP_PARSER_TRAILERS: {
+            if (!http_parser_chop_line(parser, buffer, size, &line)) {
+                if (size - parser->cursor > parser->head_limit) {
+                    return http_parser_fail(parser, 431, "Trailer fields are too large");
+                }
+                return HTTP_PARSE_INCOMPLETE;
+            }
+
+            // NOTE: trailer fields are ignored
+            if (line.len == 0) {
+                parser->state = HTTP_PARSER_DONE;
+            }
+        } break;
+
+        case HTTP_PARSER_DONE:
+            return HTTP_PARSE_DONE;
+
+        case HTTP_PARSER_ERROR:
+            return HTTP_PARSE_ERROR;
+        }
+
+        if (status == HTTP_PARSE_ERROR) {
+            return status;
+        }
+    }
+}
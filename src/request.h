@@ -1,31 +1,143 @@
 #ifndef REQUEST_H_
 #define REQUEST_H_
 
-typedef struct {
-    String method;
-    String path;
-} Status_Line;
+#include "s.h"
+#include "memory.h"
 
-Status_Line chop_status_line(String *buffer)
+typedef enum {
+    HTTP_METHOD_GET = 0,
+    HTTP_METHOD_HEAD,
+    HTTP_METHOD_POST,
+    HTTP_METHOD_PUT,
+    HTTP_METHOD_DELETE,
+    HTTP_METHOD_OPTIONS,
+    HTTP_METHOD_COUNT,
+    HTTP_METHOD_UNKNOWN = HTTP_METHOD_COUNT
+} Http_Method;
+
+static inline
+const char *http_method_as_cstr(Http_Method method)
 {
-    String line = trim_end(chop_line(buffer));
-    Status_Line result;
-    result.method = chop_word(&line);
-    result.path = chop_word(&line);
-    return result;
+    switch (method) {
+    case HTTP_METHOD_GET: return "GET";
+    case HTTP_METHOD_HEAD: return "HEAD";
+    case HTTP_METHOD_POST: return "POST";
+    case HTTP_METHOD_PUT: return "PUT";
+    case HTTP_METHOD_DELETE: return "DELETE";
+    case HTTP_METHOD_OPTIONS: return "OPTIONS";
+    case HTTP_METHOD_UNKNOWN: break;
+    }
+
+    assert(!"Incorrect Http_Method");
+    return NULL;
 }
 
+static inline
+Http_Method http_method_of_string(String method)
+{
+    for (Http_Method m = 0; m < HTTP_METHOD_COUNT; ++m) {
+        if (string_equal(method, cstr_as_string(http_method_as_cstr(m)))) {
+            return m;
+        }
+    }
+
+    return HTTP_METHOD_UNKNOWN;
+}
+
+// NOTE: headers the server cares about. Their values are indexed
+// during parsing, so looking them up later is a single array access.
+typedef enum {
+    HTTP_HEADER_HOST = 0,
+    HTTP_HEADER_CONNECTION,
+    HTTP_HEADER_CONTENT_LENGTH,
+    HTTP_HEADER_TRANSFER_ENCODING,
+    HTTP_HEADER_IF_NONE_MATCH,
+    HTTP_HEADER_ACCEPT,
+    HTTP_HEADER_USER_AGENT,
+    HTTP_HEADER_KNOWN_COUNT,
+    HTTP_HEADER_UNKNOWN = HTTP_HEADER_KNOWN_COUNT
+} Http_Header_Id;
+
 typedef struct {
     String name;
     String value;
 } Header;
 
-Header parse_header(String line)
+#define HTTP_HEADERS_CAPACITY 64
+
+typedef struct {
+    Http_Method method;
+    String method_name;
+    String target;
+    String path;
+    String query;
+    int version_minor;
+    int keep_alive;
+
+    size_t headers_count;
+    Header headers[HTTP_HEADERS_CAPACITY];
+    String known_headers[HTTP_HEADER_KNOWN_COUNT];
+
+    String body;
+} Http_Request;
+
+static inline
+String http_request_header(const Http_Request *request, Http_Header_Id id)
 {
-    Header result;
-    result.name = trim(chop_until_char(&line, ':'));
-    result.value = trim(line);
-    return result;
+    assert(request);
+    assert(id < HTTP_HEADER_KNOWN_COUNT);
+    return request->known_headers[id];
 }
 
+String http_request_find_header(const Http_Request *request, String name);
+
+typedef enum {
+    HTTP_PARSER_REQUEST_LINE = 0,
+    HTTP_PARSER_HEADERS,
+    HTTP_PARSER_BODY,
+    HTTP_PARSER_CHUNK_SIZE,
+    HTTP_PARSER_CHUNK_DATA,
+    HTTP_PARSER_CHUNK_DATA_END,
+    HTTP_PARSER_TRAILERS,
+    HTTP_PARSER_DONE,
+    HTTP_PARSER_ERROR,
+} Http_Parser_State;
+
+typedef enum {
+    HTTP_PARSE_INCOMPLETE = 0,
+    HTTP_PARSE_DONE,
+    HTTP_PARSE_ERROR,
+} Http_Parse_Status;
+
+#define HTTP_HEAD_SIZE_LIMIT (8 * KILO)
+#define HTTP_BODY_SIZE_LIMIT (512 * KILO)
+
+typedef struct {
+    Http_Parser_State state;
+    // NOTE: offset of the first byte that was not consumed yet. After
+    // HTTP_PARSE_DONE everything past the cursor belongs to the next
+    // pipelined request.
+    size_t cursor;
+    size_t scanned;
+    size_t head_limit;
+    size_t body_limit;
+    size_t content_length;
+    size_t body_start;
+    size_t chunk_remaining;
+
+    int error_code;
+    const char *error_message;
+
+    Http_Request request;
+} Http_Parser;
+
+void http_parser_init(Http_Parser *parser);
+
+// NOTE: The parser is resumable. Call it every time more bytes arrive,
+// always passing the same buffer from its very beginning. It never
+// allocates: all the Strings in the request point into the buffer.
+// The chunked bodies are decoded in place, that's why the buffer is
+// not const.
+Http_Parse_Status http_parser_feed(Http_Parser *parser, char *buffer, size_t size);
+
 #endif  // REQUEST_H_
@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "request.h"
+#include "test.h"
+
+#define BUFFER_CAPACITY (64 * KILO)
+
+static char buffer[BUFFER_CAPACITY];
+static char buffer_bytewise[BUFFER_CAPACITY];
+
+static
+Http_Parse_Status parse_at_once(Http_Parser *parser, char *dest, String input)
+{
+    assert(input.len <= BUFFER_CAPACITY);
+    memcpy(dest, input.data, input.len);
+    http_parser_init(parser);
+    return http_parser_feed(parser, dest, input.len);
+}
+
+// NOTE: the way the slowest client sends its request. Every call gets
+// the same buffer with one more byte in it.
+static
+Http_Parse_Status parse_bytewise(Http_Parser *parser, char *dest, String input)
+{
+    assert(input.len <= BUFFER_CAPACITY);
+    memcpy(dest, input.data, input.len);
+    http_parser_init(parser);
+
+    Http_Parse_Status status = HTTP_PARSE_INCOMPLETE;
+    for (size_t size = 1; size <= input.len && status == HTTP_PARSE_INCOMPLETE; ++size) {
+        status = http_parser_feed(parser, dest, size);
+    }
+    return status;
+}
+
+static
+int same_request(const Http_Request *a, const Http_Request *b)
+{
+    if (a->method != b->method
+        || !string_equal(a->method_name, b->method_name)
+        || !string_equal(a->target, b->target)
+        || !string_equal(a->path, b->path)
+        || !string_equal(a->query, b->query)
+        || a->version_minor != b->version_minor
+        || a->keep_alive != b->keep_alive
+        || a->headers_count != b->headers_count
+        || !string_equal(a->body, b->body)) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < a->headers_count; ++i) {
+        if (!string_equal(a->headers[i].name, b->headers[i].name)
+            || !string_equal(a->headers[i].value, b->headers[i].value)) {
+            return 0;
+        }
+    }
+
+    for (size_t i = 0; i < HTTP_HEADER_KNOWN_COUNT; ++i) {
+        if ((a->known_headers[i].data == NULL) != (b->known_headers[i].data == NULL)
+            || !string_equal(a->known_headers[i], b->known_headers[i])) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static
+void test_bytewise_feed(void)
+{
+    const String inputs[] = {
+        SLT("GET / HTTP/1.1\r\nHost: localhost\r\n\r\n"),
+        SLT("GET /api/period_streams?from=2024-01-01&to=2024-02-01 HTTP/1.1\r\n"
+            "Host: localhost:6969\r\n"
+            "User-Agent: curl/8.0\r\n"
+            "Accept:   */*  \r\n"
+            "X-Custom:\r\n"
+            "Connection: close\r\n"
+            "\r\n"),
+        SLT("\r\nGET /bare-lf HTTP/1.0\nConnection: keep-alive\n\n"),
+        SLT("POST /echo HTTP/1.1\r\nHost: a\r\nContent-Length: 11\r\n\r\nhello world"),
+        SLT("POST /echo HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\n\r\n"
+            "5\r\nhello\r\n1;ext=1\r\n \r\n5\r\nworld\r\n0\r\nTrailer: x\r\n\r\n"),
+        SLT("OPTIONS * HTTP/1.1\r\nHost: a\r\n\r\n"),
+    };
+
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); ++i) {
+        Http_Parser at_once, bytewise;
+        EXPECT(parse_at_once(&at_once, buffer, inputs[i]) == HTTP_PARSE_DONE);
+        EXPECT(parse_bytewise(&bytewise, buffer_bytewise, inputs[i]) == HTTP_PARSE_DONE);
+        EXPECT(at_once.cursor == inputs[i].len);
+        EXPECT(bytewise.cursor == inputs[i].len);
+        EXPECT(same_request(&at_once.request, &bytewise.request));
+    }
+
+    Http_Parser parser;
+    EXPECT(parse_at_once(&parser, buffer, inputs[1]) == HTTP_PARSE_DONE);
+    EXPECT(parser.request.method == HTTP_METHOD_GET);
+    EXPECT(string_equal(parser.request.path, SLT("/api/period_streams")));
+    EXPECT(string_equal(parser.request.query, SLT("from=2024-01-01&to=2024-02-01")));
+    EXPECT(string_equal(http_request_header(&parser.request, HTTP_HEADER_ACCEPT), SLT("*/*")));
+    EXPECT(string_equal(http_request_find_header(&parser.request, SLT("x-custom")), SLT("")));
+    EXPECT(!parser.request.keep_alive);
+
+    EXPECT(parse_at_once(&parser, buffer, inputs[2]) == HTTP_PARSE_DONE);
+    EXPECT(parser.request.version_minor == 0);
+    EXPECT(parser.request.keep_alive);
+}
+
+static
+void test_chunked_body(void)
+{
+    const String input = SLT(
+        "POST /echo HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: Chunked\r\n\r\n"
+        "5\r\nhello\r\n1\r\n \r\nA\r\n0123456789\r\n0\r\n\r\n");
+
+    Http_Parser parser;
+    EXPECT(parse_at_once(&parser, buffer, input) == HTTP_PARSE_DONE);
+    EXPECT(parser.cursor == input.len);
+    EXPECT(string_equal(parser.request.body, SLT("hello 0123456789")));
+
+    EXPECT(parse_bytewise(&parser, buffer, input) == HTTP_PARSE_DONE);
+    EXPECT(string_equal(parser.request.body, SLT("hello 0123456789")));
+}
+
+static
+void test_pipelining(void)
+{
+    const String input = SLT(
+        "GET /first HTTP/1.1\r\nHost: a\r\n\r\n"
+        "POST /second HTTP/1.1\r\nHost: a\r\nContent-Length: 3\r\n\r\nabc"
+        "POST /third HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\n\r\n3\r\ndef\r\n0\r\n\r\n"
+        "GET /fourth HTTP/1.1\r\nHo");
+    const String paths[] = {SLT("/first"), SLT("/second"), SLT("/third")};
+    const String bodies[] = {SLT(""), SLT("abc"), SLT("def")};
+
+    memcpy(buffer, input.data, input.len);
+    size_t offset = 0;
+    Http_Parser parser;
+
+    // NOTE: the way the server does it: whatever is past the cursor is
+    // the beginning of the next request
+    for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); ++i) {
+        http_parser_init(&parser);
+        EXPECT(http_parser_feed(&parser, buffer + offset, input.len - offset) == HTTP_PARSE_DONE);
+        EXPECT(string_equal(parser.request.path, paths[i]));
+        EXPECT(string_equal(parser.request.body, bodies[i]));
+        offset += parser.cursor;
+    }
+
+    http_parser_init(&parser);
+    EXPECT(http_parser_feed(&parser, buffer + offset, input.len - offset) == HTTP_PARSE_INCOMPLETE);
+}
+
+static
+void append_repeated(char *dest, size_t *size, const char *s, size_t count)
+{
+    const size_t len = strlen(s);
+    for (size_t i = 0; i < count; ++i) {
+        assert(*size + len <= BUFFER_CAPACITY);
+        memcpy(dest + *size, s, len);
+        *size += len;
+    }
+}
+
+static
+void expect_error(String head, const char *filler, size_t filler_count, String tail, int error_code)
+{
+    static char input[BUFFER_CAPACITY];
+    size_t size = 0;
+
+    assert(head.len <= BUFFER_CAPACITY);
+    memcpy(input, head.data, head.len);
+    size += head.len;
+    append_repeated(input, &size, filler, filler_count);
+    assert(size + tail.len <= BUFFER_CAPACITY);
+    memcpy(input + size, tail.data, tail.len);
+    size += tail.len;
+
+    Http_Parser parser;
+    EXPECT(parse_at_once(&parser, buffer, string(size, input)) == HTTP_PARSE_ERROR);
+    EXPECT(parser.error_code == error_code);
+    EXPECT(parser.error_message != NULL);
+
+    EXPECT(parse_bytewise(&parser, buffer, string(size, input)) == HTTP_PARSE_ERROR);
+    EXPECT(parser.error_code == error_code);
+}
+
+static
+void test_errors(void)
+{
+    const struct {
+        String input;
+        int error_code;
+    } errors[] = {
+        {SLT("GET / HTTP/1.1\r\n\r\n"), 400},
+        {SLT("GET / HTTP/1.1\r\nHost: a\r\nHost: b\r\n\r\n"), 400},
+        {SLT("GET  / HTTP/1.1\r\nHost: a\r\n\r\n"), 400},
+        {SLT("G(T / HTTP/1.1\r\nHost: a\r\n\r\n"), 400},
+        {SLT("GET /\x7f HTTP/1.1\r\nHost: a\r\n\r\n"), 400},
+        {SLT("GET index.html HTTP/1.1\r\nHost: a\r\n\r\n"), 400},
+        {SLT("GET / HTTP/1.12\r\nHost: a\r\n\r\n"), 400},
+        {SLT("GET / HTTX/1.1\r\nHost: a\r\n\r\n"), 400},
+        {SLT("GET / HTTP/1.1\r\nHost: a\r\n folded\r\n\r\n"), 400},
+        {SLT("GET / HTTP/1.1\r\nHost : a\r\n\r\n"), 400},
+        {SLT("GET / HTTP/1.1\r\nHost a\r\n\r\n"), 400},
+        {SLT("GET / HTTP/1.1\r\nHost: a\x01\r\n\r\n"), 400},
+        {SLT("POST / HTTP/1.1\r\nHost: a\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\n"), 400},
+        {SLT("POST / HTTP/1.1\r\nHost: a\r\nContent-Length: x\r\n\r\n"), 400},
+        {SLT("POST / HTTP/1.1\r\nHost: a\r\nContent-Length: 1\r\nTransfer-Encoding: chunked\r\n\r\n"), 400},
+        {SLT("POST / HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\n\r\nx\r\n"), 400},
+        {SLT("POST / HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\n\r\n1\r\nab\r\n"), 400},
+        {SLT("POST / HTTP/1.1\r\nHost: a\r\nContent-Length: 524289\r\n\r\n"), 413},
+        {SLT("POST / HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\n\r\n80001\r\n"), 413},
+        {SLT("POST / HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: gzip\r\n\r\n"), 501},
+        {SLT("GET / HTTP/2.0\r\nHost: a\r\n\r\n"), 505},
+        {SLT("GET / HTTP/0.9\r\nHost: a\r\n\r\n"), 505},
+    };
+
+    for (size_t i = 0; i < sizeof(errors) / sizeof(errors[0]); ++i) {
+        expect_error(errors[i].input, "", 0, SLT(""), errors[i].error_code);
+    }
+
+    // NOTE: the request line never ends
+    expect_error(SLT("GET /"), "a", HTTP_HEAD_SIZE_LIMIT + 1, SLT(""), 414);
+    // NOTE: the headers never end
+    expect_error(SLT("GET / HTTP/1.1\r\nHost: a\r\nX-Long: "), "a", HTTP_HEAD_SIZE_LIMIT, SLT(""), 431);
+    // NOTE: the headers end, but past the limit
+    expect_error(SLT("GET / HTTP/1.1\r\nHost: a\r\n"), "X: a\r\n", HTTP_HEAD_SIZE_LIMIT / 6 + 1, SLT("\r\n"), 431);
+    expect_error(SLT("GET / HTTP/1.1\r\n"), "X: a\r\n", HTTP_HEADERS_CAPACITY + 1, SLT("Host: a\r\n\r\n"), 431);
+    // NOTE: the trailers never end
+    expect_error(SLT("POST / HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\n\r\n0\r\nX-Long: "),
+                 "a", HTTP_HEAD_SIZE_LIMIT + 1, SLT(""), 431);
+}
+
+int main(void)
+{
+    test_bytewise_feed();
+    test_chunked_body();
+    test_pipelining();
+    test_errors();
+
+    if (failures > 0) {
+        fprintf(stderr, "%d checks FAILED\n", failures);
+        return 1;
+    }
+
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,170 @@
+#define _DEFAULT_SOURCE
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+
+#include "response.h"
+
+#define SERVER_BLOCK "Server: " HTTP_SERVER_NAME "\r\n"
+
+#define HTTP_STATUSES                                   \
+    HTTP_STATUS(200, "OK")                              \
+    HTTP_STATUS(304, "Not Modified")                    \
+    HTTP_STATUS(400, "Bad Request")                     \
+    HTTP_STATUS(404, "Not Found")                       \
+    HTTP_STATUS(405, "Method Not Allowed")              \
+    HTTP_STATUS(408, "Request Timeout")                 \
+    HTTP_STATUS(413, "Payload Too Large")               \
+    HTTP_STATUS(414, "URI Too Long")                    \
+    HTTP_STATUS(431, "Request Header Fields Too Large") \
+    HTTP_STATUS(500, "Internal Server Error")           \
+    HTTP_STATUS(501, "Not Implemented")                 \
+    HTTP_STATUS(503, "Service Unavailable")             \
+    HTTP_STATUS(505, "HTTP Version Not Supported")
+
+String http_status_block(int code)
+{
+    switch (code) {
+#define HTTP_STATUS(code, reason)                                       \
+    case code: return SLT("HTTP/1.1 " #code " " reason "\r\n" SERVER_BLOCK);
+    HTTP_STATUSES
+#undef HTTP_STATUS
+    }
+
+    return SLT("HTTP/1.1 500 Internal Server Error\r\n" SERVER_BLOCK);
+}
+
+static const char *const content_type_blocks[CONTENT_TYPE_COUNT] = {
+    [CONTENT_TYPE_NONE]  = "",
+    [CONTENT_TYPE_HTML]  = "Content-Type: text/html\r\n",
+    [CONTENT_TYPE_JSON]  = "Content-Type: application/json\r\n",
+    [CONTENT_TYPE_PLAIN] = "Content-Type: text/plain\r\n",
+    [CONTENT_TYPE_EVENT_STREAM] = "Content-Type: text/event-stream\r\nCache-Control: no-cache\r\n",
+};
+
+#define DATE_BLOCK_CAPACITY 64
+
+static time_t date_time = -1;
+static char date_block[DATE_BLOCK_CAPACITY];
+static size_t date_block_size = 0;
+
+void http_date_update(time_t now)
+{
+    if (now == date_time) {
+        return;
+    }
+
+    struct tm tm;
+    gmtime_r(&now, &tm);
+    date_block_size = strftime(date_block, sizeof(date_block),
+                               "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+    date_time = now;
+}
+
+String http_date_block(void)
+{
+    if (date_time < 0) {
+        http_date_update(time(NULL));
+    }
+    return string(date_block_size, date_block);
+}
+
+void response_init(Response *response, Memory *memory)
+{
+    assert(response);
+    assert(memory);
+
+    memset(response, 0, sizeof(*response));
+    response->code = 500;
+    response->headers = buffer_of_memory(memory);
+    response->body = buffer_of_memory(memory);
+}
+
+void response_start(Response *response, int code, Content_Type content_type)
+{
+    assert(response);
+    assert(content_type < CONTENT_TYPE_COUNT);
+
+    response->code = code;
+    response->content_type = content_type;
+    buffer_clean(&response->headers);
+    buffer_clean(&response->body);
+    response->content = string_empty();
+}
+
+void response_header(Response *response, String name, String value)
+{
+    assert(response);
+
+    buffer_reserve(&response->headers, name.len + value.len + 4);
+    buffer_append_string(&response->headers, name);
+    buffer_append_string(&response->headers, SLT(": "));
+    buffer_append_string(&response->headers, value);
+    buffer_append_string(&response->headers, SLT("\r\n"));
+}
+
+void response_header_block(Response *response, String block)
+{
+    assert(response);
+    buffer_append_string(&response->headers, block);
+}
+
+void response_content(Response *response, String content)
+{
+    assert(response);
+    response->content = content;
+}
+
+static
+int http_status_has_body(int code)
+{
+    return !((100 <= code && code < 200) || code == 204 || code == 304);
+}
+
+void response_iov(Response *response, Response_Iov *out)
+{
+    assert(response);
+    assert(out);
+
+    const String body = response->content.data != NULL
+        ? response->content
+        : buffer_as_string(response->body);
+
+    const String connection = response->keep_alive || response->streaming
+        ? SLT("Connection: keep-alive\r\n")
+        : SLT("Connection: close\r\n");
+
+    // NOTE: "Content-Length: " + digits + "\r\n" + the empty line
+    char *tail = out->tail;
+    size_t tail_size = 0;
+
+    if (http_status_has_body(response->code) && !response->streaming) {
+        const String prefix = SLT("Content-Length: ");
+        memcpy(tail, prefix.data, prefix.len);
+        tail_size += prefix.len;
+        tail_size += u64_to_digits(tail + tail_size, body.len);
+        memcpy(tail + tail_size, "\r\n", 2);
+        tail_size += 2;
+    }
+
+    memcpy(tail + tail_size, "\r\n", 2);
+    tail_size += 2;
+
+    const String status = http_status_block(response->code);
+    const String date = http_date_block();
+    const char *content_type = content_type_blocks[response->content_type];
+
+    struct iovec *iov = out->iov;
+    iov[0] = (struct iovec) { .iov_base = (void *) status.data,       .iov_len = status.len };
+    iov[1] = (struct iovec) { .iov_base = (void *) date.data,         .iov_len = date.len };
+    iov[2] = (struct iovec) { .iov_base = (void *) content_type,      .iov_len = strlen(content_type) };
+    iov[3] = (struct iovec) { .iov_base = response->headers.data,     .iov_len = response->headers.size };
+    iov[4] = (struct iovec) { .iov_base = (void *) connection.data,   .iov_len = connection.len };
+    iov[5] = (struct iovec) { .iov_base = tail,                       .iov_len = tail_size };
+    iov[6] = (struct iovec) { .iov_base = (void *) body.data,         .iov_len = body.len };
+    out->count = RESPONSE_IOV_CAPACITY;
+
+    if (response->head_only || response->streaming || !http_status_has_body(response->code)) {
+        out->count -= 1;
+    }
+}
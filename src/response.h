@@ -1,26 +1,71 @@
 #ifndef RESPONSE_H_
 #define RESPONSE_H_
 
-void response_status_line(int fd, int code)
-{
-    dprintf(fd, "HTTP/1.1 %d\n", code);
-}
-
-void response_header(int fd, const char *name, const char *value_format, ...)
-{
-    va_list args;
-    va_start(args, value_format);
-
-    dprintf(fd, "%s: ", name);
-    vdprintf(fd, value_format, args);
-    dprintf(fd, "\n");
-
-    va_end(args);
-}
-
-void response_body_start(int fd)
-{
-    dprintf(fd, "\n");
-}
+#include <time.h>
+
+#include <sys/uio.h>
+
+#include "s.h"
+#include "memory.h"
+#include "buffer.h"
+
+#define HTTP_SERVER_NAME "skedudle"
+
+typedef enum {
+    CONTENT_TYPE_NONE = 0,
+    CONTENT_TYPE_HTML,
+    CONTENT_TYPE_JSON,
+    CONTENT_TYPE_PLAIN,
+    CONTENT_TYPE_EVENT_STREAM,
+    CONTENT_TYPE_COUNT
+} Content_Type;
+
+// NOTE: Everything that is known at compile time is sent as a constant
+// block: the status line together with the Server header, the
+// Content-Type header, the Connection header. The Date header is
+// formatted once per second. So building the head of a response is a
+// couple of memcpy-s plus Content-Length.
+typedef struct {
+    int code;
+    Content_Type content_type;
+    int keep_alive;
+    // NOTE: HEAD requests get the same head but no body
+    int head_only;
+    // NOTE: the body is sent later piece by piece (Server-Sent Events),
+    // so there is no Content-Length and the connection stays open
+    int streaming;
+    // NOTE: extra header lines, every one of them terminated with CRLF
+    Buffer headers;
+    Buffer body;
+    // NOTE: when set it is sent instead of the body without copying it
+    String content;
+} Response;
+
+void response_init(Response *response, Memory *memory);
+void response_start(Response *response, int code, Content_Type content_type);
+void response_header(Response *response, String name, String value);
+void response_header_block(Response *response, String block);
+void response_content(Response *response, String content);
+String http_status_block(int code);
+
+// NOTE: formats the Date header for the given second. Cheap to call
+// many times within the same second.
+void http_date_update(time_t now);
+String http_date_block(void);
+
+#define RESPONSE_IOV_CAPACITY 7
+#define RESPONSE_TAIL_CAPACITY 64
+
+// NOTE: the whole response as a list of slices that can be sent with a
+// single writev(). The slices point into the Response, the constant
+// blocks and the tail below, so the Response_Iov must not be moved
+// while it is in use.
+typedef struct {
+    struct iovec iov[RESPONSE_IOV_CAPACITY];
+    size_t count;
+    char tail[RESPONSE_TAIL_CAPACITY];
+} Response_Iov;
+
+void response_iov(Response *response, Response_Iov *out);
 
 #endif  // RESPONSE_H_
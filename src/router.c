@@ -0,0 +1,250 @@
+#include <assert.h>
+#include <string.h>
+
+#include "router.h"
+
+String route_param(const Route_Params *params, String name)
+{
+    assert(params);
+
+    for (size_t i = 0; i < params->count; ++i) {
+        if (string_equal(params->items[i].name, name)) {
+            return params->items[i].value;
+        }
+    }
+
+    return string_empty();
+}
+
+static
+Route_Node *route_node_new(Memory *memory, String prefix)
+{
+    assert(memory);
+    Route_Node *node = memory_alloc_aligned(memory, sizeof(Route_Node), alignof(Route_Node));
+    memset(node, 0, sizeof(*node));
+    node->prefix = prefix;
+    return node;
+}
+
+static
+size_t common_prefix_len(String a, String b)
+{
+    size_t i = 0;
+    while (i < a.len && i < b.len && a.data[i] == b.data[i]) {
+        ++i;
+    }
+    return i;
+}
+
+static
+String chop_static_part(String *pattern)
+{
+    size_t i = 0;
+    while (i < pattern->len && pattern->data[i] != ':' && pattern->data[i] != '*') {
+        ++i;
+    }
+
+    String part = take(*pattern, i);
+    chop(pattern, i);
+    return part;
+}
+
+static
+Route_Node *route_node_insert_static(Memory *memory, Route_Node *node, String part)
+{
+    while (part.len > 0) {
+        Route_Node **child = &node->children;
+        while (*child && (*child)->prefix.data[0] != part.data[0]) {
+            child = &(*child)->next;
+        }
+
+        if (*child == NULL) {
+            *child = route_node_new(memory, part);
+            return *child;
+        }
+
+        const size_t n = common_prefix_len((*child)->prefix, part);
+        assert(n > 0);
+
+        if (n < (*child)->prefix.len) {
+            // NOTE: split the edge into the common part and the rest
+            Route_Node *middle = route_node_new(memory, take((*child)->prefix, n));
+            Route_Node *rest = *child;
+            middle->next = rest->next;
+            middle->children = rest;
+            rest->next = NULL;
+            chop(&rest->prefix, n);
+            *child = middle;
+        }
+
+        node = *child;
+        chop(&part, n);
+    }
+
+    return node;
+}
+
+static
+int route_node_has_handlers(const Route_Node *node)
+{
+    for (size_t i = 0; i < HTTP_METHOD_COUNT; ++i) {
+        if (node->handlers[i]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void router_add(Router *router, Http_Method method, String pattern, Route_Handler handler)
+{
+    assert(router);
+    assert(method < HTTP_METHOD_COUNT);
+    assert(handler);
+
+    Route_Node *node = &router->root;
+    const String route = pattern;
+
+    while (pattern.len > 0) {
+        String part = chop_static_part(&pattern);
+        node = route_node_insert_static(router->memory, node, part);
+
+        if (pattern.len > 0 && *pattern.data == ':') {
+            chop(&pattern, 1);
+            String name = take(pattern, 0);
+            while (name.len < pattern.len && pattern.data[name.len] != '/') {
+                name.len++;
+            }
+            chop(&pattern, name.len);
+
+            if (node->param == NULL) {
+                node->param = route_node_new(router->memory, name);
+            }
+            // NOTE: all the routes must agree on the name of a parameter at the same position
+            assert(string_equal(node->param->prefix, name));
+            node = node->param;
+        } else if (pattern.len > 0 && *pattern.data == '*') {
+            String name = drop(pattern, 1);
+            pattern = drop(pattern, pattern.len);
+
+            if (node->catch_all == NULL) {
+                node->catch_all = route_node_new(router->memory, name);
+            }
+            assert(string_equal(node->catch_all->prefix, name));
+            node = node->catch_all;
+        }
+    }
+
+    assert(node->handlers[method] == NULL && "The route is already registered");
+    if (!route_node_has_handlers(node)) {
+        assert(router->routes_count < ROUTER_ROUTES_CAPACITY);
+        node->route = router->routes_count;
+        router->routes[router->routes_count++] = route;
+    }
+    node->handlers[method] = handler;
+}
+
+static
+const Route_Node *route_node_match(const Route_Node *node, String path, Route_Params *params)
+{
+    if (path.len == 0) {
+        return route_node_has_handlers(node) ? node : NULL;
+    }
+
+    // NOTE: siblings never share the first byte, so at most one of
+    // them can be a prefix of the path
+    for (const Route_Node *child = node->children; child != NULL; child = child->next) {
+        if (child->prefix.data[0] == path.data[0]) {
+            if (prefix_of(child->prefix, path)) {
+                const Route_Node *result = route_node_match(child, drop(path, child->prefix.len), params);
+                if (result) {
+                    return result;
+                }
+            }
+            break;
+        }
+    }
+
+    if (node->param && params->count < ROUTE_PARAMS_CAPACITY) {
+        String rest = path;
+        String segment = chop_until_char(&rest, '/');
+        if (segment.len > 0) {
+            params->items[params->count++] = (Route_Param) {
+                .name = node->param->prefix,
+                .value = segment,
+            };
+
+            const Route_Node *result = route_node_match(node->param, drop(path, segment.len), params);
+            if (result) {
+                return result;
+            }
+
+            params->count--;
+        }
+    }
+
+    if (node->catch_all && params->count < ROUTE_PARAMS_CAPACITY) {
+        params->items[params->count++] = (Route_Param) {
+            .name = node->catch_all->prefix,
+            .value = path,
+        };
+        return node->catch_all;
+    }
+
+    return NULL;
+}
+
+static
+unsigned route_node_allowed_methods(const Route_Node *node)
+{
+    unsigned allowed = 0;
+    for (size_t i = 0; i < HTTP_METHOD_COUNT; ++i) {
+        if (node->handlers[i]) {
+            allowed |= 1u << i;
+        }
+    }
+    if (node->handlers[HTTP_METHOD_GET]) {
+        allowed |= 1u << HTTP_METHOD_HEAD;
+    }
+    return allowed;
+}
+
+Route_Match router_match(const Router *router, Http_Method method, String path, Route_Params *params)
+{
+    assert(router);
+    assert(params);
+
+    params->count = 0;
+    const Route_Node *node = route_node_match(&router->root, path, params);
+
+    if (node == NULL) {
+        return (Route_Match) { .status = ROUTE_NOT_FOUND, .route = ROUTE_NONE };
+    }
+
+    if (method >= HTTP_METHOD_COUNT) {
+        return (Route_Match) {
+            .status = ROUTE_METHOD_NOT_ALLOWED,
+            .route = node->route,
+            .allowed_methods = route_node_allowed_methods(node),
+        };
+    }
+
+    Route_Handler handler = node->handlers[method];
+    // NOTE: HEAD is GET without the body, unless there is a dedicated handler
+    if (handler == NULL && method == HTTP_METHOD_HEAD) {
+        handler = node->handlers[HTTP_METHOD_GET];
+    }
+
+    if (handler == NULL) {
+        return (Route_Match) {
+            .status = ROUTE_METHOD_NOT_ALLOWED,
+            .route = node->route,
+            .allowed_methods = route_node_allowed_methods(node),
+        };
+    }
+
+    return (Route_Match) {
+        .status = ROUTE_FOUND,
+        .handler = handler,
+        .route = node->route,
+    };
+}
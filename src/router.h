@@ -0,0 +1,82 @@
+#ifndef ROUTER_H_
+#define ROUTER_H_
+
+#include "s.h"
+#include "memory.h"
+#include "request.h"
+
+// NOTE: The router does not know anything about the application. Every
+// handler receives the same Request_Context which is defined by the
+// user of the router.
+typedef struct Request_Context Request_Context;
+typedef int (*Route_Handler)(Request_Context *context);
+
+#define ROUTE_PARAMS_CAPACITY 8
+
+typedef struct {
+    String name;
+    String value;
+} Route_Param;
+
+typedef struct {
+    size_t count;
+    Route_Param items[ROUTE_PARAMS_CAPACITY];
+} Route_Params;
+
+String route_param(const Route_Params *params, String name);
+
+typedef struct Route_Node Route_Node;
+
+struct Route_Node {
+    // NOTE: label of the edge that leads into this node. For the
+    // parameter nodes this is the name of the parameter.
+    String prefix;
+    Route_Node *children;
+    Route_Node *next;
+    // NOTE: `:name` matches a single non-empty path segment
+    Route_Node *param;
+    // NOTE: `*name` matches the whole rest of the path
+    Route_Node *catch_all;
+    Route_Handler handlers[HTTP_METHOD_COUNT];
+    // NOTE: index into Router.routes. Only meaningful for the nodes
+    // with handlers.
+    size_t route;
+};
+
+#define ROUTER_ROUTES_CAPACITY 31
+
+typedef struct {
+    Memory *memory;
+    Route_Node root;
+    // NOTE: the patterns of the registered routes in the order they
+    // were added, so the routes can be told apart (e.g. in the metrics)
+    // without comparing strings
+    String routes[ROUTER_ROUTES_CAPACITY];
+    size_t routes_count;
+} Router;
+
+typedef enum {
+    ROUTE_FOUND = 0,
+    ROUTE_NOT_FOUND,
+    ROUTE_METHOD_NOT_ALLOWED,
+} Route_Status;
+
+#define ROUTE_NONE ((size_t) -1)
+
+typedef struct {
+    Route_Status status;
+    Route_Handler handler;
+    // NOTE: ROUTE_NONE when the path matched nothing
+    size_t route;
+    // NOTE: bit (1 << method) is set for every method the matched route
+    // answers to, HEAD included whenever GET is there. That's what
+    // goes into the Allow header of 405.
+    unsigned allowed_methods;
+} Route_Match;
+
+// NOTE: the pattern is not copied. It is expected to outlive the
+// router, which is usually the case for string literals.
+void router_add(Router *router, Http_Method method, String pattern, Route_Handler handler);
+Route_Match router_match(const Router *router, Http_Method method, String path, Route_Params *params);
+
+#endif  // ROUTER_H_
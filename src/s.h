@@ -7,6 +7,16 @@
 
 #include "memory.h"
 
+// NOTE: SSE2 is the baseline of x86_64, so the vectorized paths are
+// always enabled there. SSE4.2 is picked up when the compiler is allowed
+// to use it (e.g. CFLAGS+=-msse4.2 or -march=native). Everything else
+// falls back to the scalar loops.
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 typedef struct  {
     size_t len;
     const char *data;
@@ -51,6 +61,99 @@ String string_empty(void)
     return result;
 }
 
+// NOTE: Returns the index of the first occurrence of `c` in `s` or
+// `s.len` if there is none.
+static inline
+size_t string_find_char(String s, char c)
+{
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128i needle = _mm_set1_epi8(c);
+    for (; i + 16 <= s.len; i += 16) {
+        const __m128i chunk = _mm_loadu_si128((const __m128i *) (s.data + i));
+        const int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+        if (mask) {
+            return i + (size_t) __builtin_ctz((unsigned) mask);
+        }
+    }
+#endif
+
+    for (; i < s.len; ++i) {
+        if (s.data[i] == c) {
+            return i;
+        }
+    }
+
+    return s.len;
+}
+
+#define STRING_FIND_ANY_SET_CAPACITY 16
+
+// NOTE: Returns the index of the first byte of `s` that is present in
+// `set` or `s.len` if there is none. Sets of up to 16 bytes are
+// vectorized, which is plenty for the delimiters of HTTP and JSON.
+static inline
+size_t string_find_any(String s, String set)
+{
+    size_t i = 0;
+
+#if defined(__SSE4_2__)
+    if (0 < set.len && set.len <= STRING_FIND_ANY_SET_CAPACITY) {
+        char set_buffer[STRING_FIND_ANY_SET_CAPACITY] = {0};
+        memcpy(set_buffer, set.data, set.len);
+        const __m128i needles = _mm_loadu_si128((const __m128i *) set_buffer);
+
+        for (; i + 16 <= s.len; i += 16) {
+            const __m128i chunk = _mm_loadu_si128((const __m128i *) (s.data + i));
+            const int index = _mm_cmpestri(
+                needles, (int) set.len, chunk, 16,
+                _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+            if (index < 16) {
+                return i + (size_t) index;
+            }
+        }
+    }
+#elif defined(__SSE2__)
+    if (0 < set.len && set.len <= STRING_FIND_ANY_SET_CAPACITY) {
+        __m128i needles[STRING_FIND_ANY_SET_CAPACITY];
+        for (size_t j = 0; j < set.len; ++j) {
+            needles[j] = _mm_set1_epi8(set.data[j]);
+        }
+
+        for (; i + 16 <= s.len; i += 16) {
+            const __m128i chunk = _mm_loadu_si128((const __m128i *) (s.data + i));
+            __m128i matches = _mm_cmpeq_epi8(chunk, needles[0]);
+            for (size_t j = 1; j < set.len; ++j) {
+                matches = _mm_or_si128(matches, _mm_cmpeq_epi8(chunk, needles[j]));
+            }
+
+            const int mask = _mm_movemask_epi8(matches);
+            if (mask) {
+                return i + (size_t) __builtin_ctz((unsigned) mask);
+            }
+        }
+    }
+#endif
+
+    for (; i < s.len; ++i) {
+        for (size_t j = 0; j < set.len; ++j) {
+            if (s.data[i] == set.data[j]) {
+                return i;
+            }
+        }
+    }
+
+    return s.len;
+}
+
+// NOTE: isspace() depends on the current locale, this one does not
+static inline
+int string_isspace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
 static inline
 String chop_until_char(String *input, char delim)
 {
@@ -58,9 +161,7 @@ String chop_until_char(String *input, char delim)
         return string_empty();
     }
 
-    size_t i = 0;
-    while (i < input->len && input->data[i] != delim)
-        ++i;
+    size_t i = string_find_char(*input, delim);
 
     String line;
     line.data = input->data;
@@ -85,7 +186,7 @@ String chop_line(String *input) {
 static inline
 String trim_begin(String s)
 {
-    while (s.len && isspace(*s.data)) {
+    while (s.len && string_isspace(*s.data)) {
         s.data++;
         s.len--;
     }
@@ -95,7 +196,7 @@ String trim_begin(String s)
 static inline
 String trim_end(String s)
 {
-    while (s.len && isspace(s.data[s.len - 1])) {
+    while (s.len && string_isspace(s.data[s.len - 1])) {
         s.len--;
     }
     return s;
@@ -117,7 +218,7 @@ String chop_word(String *input)
     *input = trim_begin(*input);
 
     size_t i = 0;
-    while (i < input->len && !isspace(input->data[i])) {
+    while (i < input->len && !string_isspace(input->data[i])) {
         ++i;
     }
 
@@ -1,258 +1,834 @@
+#define _GNU_SOURCE
 #include <assert.h>
-#define __USE_XOPEN
+#include <inttypes.h>
 #include <time.h>
 #include <string.h>
 
 #include "schedule.h"
 
+#define SECONDS_IN_DAY (24 * 60 * 60)
+
 static inline
-void expect_json_type(Json_Value value, Json_Type type)
+int expect_json_type(Json_Value value, Json_Type type)
 {
-    if (value.type != type) {
+    if (json_type(value) != type) {
         fprintf(stderr,
                 "Expected %s, but got %s\n",
                 json_type_as_cstr(type),
-                json_type_as_cstr(value.type));
-        abort();
+                json_type_as_cstr(json_type(value)));
+        return -1;
+    }
+    return 0;
+}
+
+static
+uint64_t string_pool_hash(String s)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < s.len; ++i) {
+        hash ^= (uint8_t) s.data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+void string_pool_init(struct String_Pool *pool, Memory *memory, size_t capacity)
+{
+    assert(pool);
+    assert(memory);
+
+    // NOTE: the table is never more than half full
+    size_t slots_count = 1;
+    while (slots_count < capacity * 2) {
+        slots_count *= 2;
     }
+
+    pool->count = 0;
+    pool->capacity = capacity;
+    pool->strings = memory_alloc_aligned(memory, sizeof(pool->strings[0]) * capacity, alignof(String));
+    pool->json = memory_alloc_aligned(memory, sizeof(pool->json[0]) * capacity, alignof(String));
+    pool->slots_count = slots_count;
+    pool->slots = memory_alloc_aligned(memory, sizeof(pool->slots[0]) * slots_count, alignof(String_Id));
+    memset(pool->slots, 0, sizeof(pool->slots[0]) * slots_count);
+}
+
+String_Id string_pool_intern(struct String_Pool *pool, Memory *memory, String s)
+{
+    assert(pool);
+    assert(pool->slots);
+    assert(memory);
+
+    size_t slot = string_pool_hash(s) & (pool->slots_count - 1);
+    while (pool->slots[slot] != 0) {
+        const String_Id id = pool->slots[slot] - 1;
+        if (string_equal(pool->strings[id], s)) {
+            return id;
+        }
+        slot = (slot + 1) & (pool->slots_count - 1);
+    }
+
+    assert(pool->count < pool->capacity);
+    const String_Id id = (String_Id) pool->count++;
+    pool->slots[slot] = id + 1;
+    pool->strings[id] = s;
+
+    Buffer json = buffer_of_memory(memory);
+    print_json_string_buffer(&json, s);
+    buffer_shrink(&json);
+    pool->json[id] = buffer_as_string(json);
+
+    return id;
 }
 
 static inline
-String unwrap_json_string(Json_Value value)
+int unwrap_json_string(Json_Value value, String *s)
 {
-    expect_json_type(value, JSON_STRING);
-    return value.string;
+    if (expect_json_type(value, JSON_STRING) < 0) {
+        return -1;
+    }
+    *s = json_as_string(value);
+    return 0;
 }
 
-uint8_t json_as_days(Memory *memory, Json_Value input)
+int json_as_days(Memory *memory, Json_Value input, uint8_t *output)
 {
     assert(memory);
-    expect_json_type(input, JSON_ARRAY);
+    assert(output);
+    if (expect_json_type(input, JSON_ARRAY) < 0) {
+        return -1;
+    }
 
     uint8_t days = 0;
-    for (Json_Array_Page *page = input.array.begin;
-         page != NULL;
-         page = page->next)
-    {
-        for (size_t page_index = 0; page_index < page->size; ++page_index) {
-            expect_json_type(page->elements[page_index], JSON_NUMBER);
-            int64_t x = json_number_to_integer(page->elements[page_index].number);
-            // NOTE:
-            // - schedule.json (1-7, Monday = 1)
-            // - POSIX         (0-6, Sunday = 0)
-            //
-            // the mask is expected to be POSIX compliant.
-            //
-            //     JSON  POSIX
-            //  Mon  1 -> 1
-            //  Tue  2 -> 2
-            //  Wed  3 -> 3
-            //  Thu  4 -> 4
-            //  Fri  5 -> 5
-            //  Sat  6 -> 6
-            //  Sun  7 -> 0
-            days |= 1 << (x % 7);
+    for (size_t i = 0; i < json_array_size(input); ++i) {
+        const Json_Value element = json_array_at(input, i);
+        if (expect_json_type(element, JSON_NUMBER) < 0) {
+            return -1;
+        }
+        int64_t x = json_as_integer(element);
+        if (x < 0) {
+            fprintf(stderr, "Expected a day of the week, but got %" PRId64 "\n", x);
+            return -1;
         }
+        // NOTE:
+        // - schedule.json (1-7, Monday = 1)
+        // - POSIX         (0-6, Sunday = 0)
+        //
+        // the mask is expected to be POSIX compliant.
+        //
+        //     JSON  POSIX
+        //  Mon  1 -> 1
+        //  Tue  2 -> 2
+        //  Wed  3 -> 3
+        //  Thu  4 -> 4
+        //  Fri  5 -> 5
+        //  Sat  6 -> 6
+        //  Sun  7 -> 0
+        days |= 1 << (x % 7);
     }
 
-    return days;
+    *output = days;
+    return 0;
 }
 
-int json_as_time_min(Memory *memory, Json_Value input)
+// NOTE: takes at least 1 and at most max digits off the beginning of s,
+// the way strptime() reads its numbers. -1 when s does not start with a
+// digit.
+static inline
+int chop_number(String *s, size_t max, int *x)
 {
-    assert(memory);
-    const char *input_cstr = string_as_cstr(memory, unwrap_json_string(input));
-    struct tm tm = {0};
-    strptime(input_cstr, "%H:%M", &tm);
-    return tm.tm_hour * 60 + tm.tm_min;
+    size_t n = 0;
+    *x = 0;
+    while (n < max && n < s->len && '0' <= s->data[n] && s->data[n] <= '9') {
+        *x = *x * 10 + (s->data[n] - '0');
+        n += 1;
+    }
+    chop(s, n);
+    return n > 0 ? 0 : -1;
 }
 
-struct tm json_as_date(Memory *memory, Json_Value input)
+static inline
+int chop_char(String *s, char c)
 {
-    assert(memory);
-    expect_json_type(input, JSON_STRING);
-    const char *input_cstr = string_as_cstr(memory, unwrap_json_string(input));
+    if (s->len == 0 || *s->data != c) {
+        return -1;
+    }
+    chop(s, 1);
+    return 0;
+}
+
+// NOTE: days since 1970-01-01 of a proleptic Gregorian date, see
+// http://howardhinnant.github.io/date_algorithms.html#days_from_civil
+static
+int64_t days_from_civil(int64_t year, int month, int day)
+{
+    year -= month <= 2;
+    const int64_t era = (year >= 0 ? year : year - 399) / 400;
+    const int64_t year_of_era = year - era * 400;
+    const int64_t day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    const int64_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + day_of_era - 719468;
+}
+
+// NOTE: the inverse of days_from_civil() as a struct tm, the same one
+// gmtime() gives for the midnight of the day
+struct tm tm_of_epoch_days(int64_t epoch_days)
+{
+    const int64_t z = epoch_days + 719468;
+    const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    const int64_t day_of_era = z - era * 146097;
+    const int64_t year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    const int64_t day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    const int64_t mp = (5 * day_of_year + 2) / 153;
+    const int day = (int) (day_of_year - (153 * mp + 2) / 5 + 1);
+    const int month = (int) (mp < 10 ? mp + 3 : mp - 9);
+    const int64_t year = year_of_era + era * 400 + (month <= 2);
+
     struct tm tm = {0};
-    strptime(input_cstr, "%Y-%m-%d", &tm);
+    tm.tm_year = (int) (year - 1900);
+    tm.tm_mon = month - 1;
+    tm.tm_mday = day;
+    // NOTE: 1970-01-01 is Thursday
+    tm.tm_wday = (int) (((epoch_days + 4) % 7 + 7) % 7);
+    tm.tm_yday = (int) (epoch_days - days_from_civil(year, 1, 1));
     return tm;
 }
 
 static
-struct Project json_as_project(Memory *memory, Json_Value input)
+int days_in_month(int year, int month)
+{
+    static const int days[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    const int leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    return days[month - 1] + (month == 2 && leap);
+}
+
+int parse_time_min(String s, int *time_min)
+{
+    int hours = 0;
+    int minutes = 0;
+    if (chop_number(&s, 2, &hours) < 0
+        || chop_char(&s, ':') < 0
+        || chop_number(&s, 2, &minutes) < 0
+        || s.len != 0
+        || hours > 23 || minutes > 59) {
+        return -1;
+    }
+
+    *time_min = hours * 60 + minutes;
+    return 0;
+}
+
+int parse_epoch_days(String s, int64_t *epoch_days)
+{
+    const size_t len = s.len;
+    int year = 0;
+    int month = 0;
+    int day = 0;
+    if (chop_number(&s, 4, &year) < 0
+        || len - s.len != 4
+        || chop_char(&s, '-') < 0
+        || chop_number(&s, 2, &month) < 0
+        || chop_char(&s, '-') < 0
+        || chop_number(&s, 2, &day) < 0
+        || s.len != 0
+        || month < 1 || month > 12
+        || day < 1 || day > days_in_month(year, month)) {
+        return -1;
+    }
+
+    *epoch_days = days_from_civil(year, month, day);
+    return 0;
+}
+
+int json_as_time_min(Json_Value input, int *time_min)
+{
+    String s = {0};
+    if (unwrap_json_string(input, &s) < 0) {
+        return -1;
+    }
+    if (parse_time_min(s, time_min) < 0) {
+        fprintf(stderr, "Expected time in the format HH:MM, but got `%.*s`\n",
+                (int) s.len, s.data);
+        return -1;
+    }
+    return 0;
+}
+
+static
+int json_as_epoch_days(Json_Value input, int64_t *epoch_days)
+{
+    String s = {0};
+    if (unwrap_json_string(input, &s) < 0) {
+        return -1;
+    }
+    if (parse_epoch_days(s, epoch_days) < 0) {
+        fprintf(stderr, "Expected date in the format YYYY-MM-DD, but got `%.*s`\n",
+                (int) s.len, s.data);
+        return -1;
+    }
+    return 0;
+}
+
+int json_as_date(Json_Value input, struct tm *date)
+{
+    int64_t epoch_days = 0;
+    if (json_as_epoch_days(input, &epoch_days) < 0) {
+        return -1;
+    }
+    *date = tm_of_epoch_days(epoch_days);
+    return 0;
+}
+
+static
+int parse_schedule_project(Memory *memory, Json_Value input, struct Schedule *schedule)
 {
     assert(memory);
+    assert(schedule);
 
-    expect_json_type(input, JSON_OBJECT);
-
-    struct Project project;
-    memset(&project, 0, sizeof(project));
-
-    for (Json_Object_Page *page = input.object.begin;
-         page != NULL;
-         page = page->next)
-    {
-        for (size_t page_index = 0; page_index < page->size; ++page_index) {
-            if (string_equal(page->elements[page_index].key, SLT("name"))) {
-                project.name = unwrap_json_string(page->elements[page_index].value);
-            } else if (string_equal(page->elements[page_index].key, SLT("description"))) {
-                project.description = unwrap_json_string(page->elements[page_index].value);
-            } else if (string_equal(page->elements[page_index].key, SLT("url"))) {
-                project.url = unwrap_json_string(page->elements[page_index].value);
-            } else if (string_equal(page->elements[page_index].key, SLT("days"))) {
-                project.days = json_as_days(memory, page->elements[page_index].value);
-            } else if (string_equal(page->elements[page_index].key, SLT("time"))) {
-                project.time_min = json_as_time_min(memory, page->elements[page_index].value);
-            } else if (string_equal(page->elements[page_index].key, SLT("channel"))) {
-                project.channel = unwrap_json_string(page->elements[page_index].value);
-            } else if (string_equal(page->elements[page_index].key, SLT("starts"))) {
-                project.starts = memory_alloc_aligned(memory, sizeof(*project.starts), alignof(struct tm));
-                memset(project.starts, 0, sizeof(*project.starts));
-                *project.starts = json_as_date(memory, page->elements[page_index].value);
-            } else if (string_equal(page->elements[page_index].key, SLT("ends"))) {
-                project.ends = memory_alloc_aligned(memory, sizeof(*project.ends), alignof(struct tm));
-                memset(project.ends, 0, sizeof(*project.ends));
-                *project.ends = json_as_date(memory, page->elements[page_index].value);
-            }
+    if (expect_json_type(input, JSON_OBJECT) < 0) {
+        return -1;
+    }
+
+    const size_t index = schedule->projects_size++;
+    uint8_t days = 0;
+    int time_min = 0;
+    int64_t starts_epoch = INT64_MIN;
+    int64_t ends_epoch = INT64_MAX;
+
+    String name = {0};
+    String description = {0};
+    String url = {0};
+    String channel = {0};
+
+    for (size_t i = 0; i < json_object_size(input); ++i) {
+        const Json_Member member = json_object_at(input, i);
+        int err = 0;
+        if (string_equal(member.key, SLT("name"))) {
+            err = unwrap_json_string(member.value, &name);
+        } else if (string_equal(member.key, SLT("description"))) {
+            err = unwrap_json_string(member.value, &description);
+        } else if (string_equal(member.key, SLT("url"))) {
+            err = unwrap_json_string(member.value, &url);
+        } else if (string_equal(member.key, SLT("days"))) {
+            err = json_as_days(memory, member.value, &days);
+        } else if (string_equal(member.key, SLT("time"))) {
+            err = json_as_time_min(member.value, &time_min);
+        } else if (string_equal(member.key, SLT("channel"))) {
+            err = unwrap_json_string(member.value, &channel);
+        } else if (string_equal(member.key, SLT("starts"))) {
+            err = json_as_epoch_days(member.value, &starts_epoch);
+            starts_epoch *= SECONDS_IN_DAY;
+        } else if (string_equal(member.key, SLT("ends"))) {
+            err = json_as_epoch_days(member.value, &ends_epoch);
+            ends_epoch *= SECONDS_IN_DAY;
+        }
+
+        if (err < 0) {
+            fprintf(stderr, "...in the field `%.*s` of the project #%zu\n",
+                    (int) member.key.len, member.key.data, index);
+            return -1;
         }
     }
 
-    return project;
+    schedule->projects_days[index] = days;
+    schedule->projects_time_min[index] = time_min;
+    schedule->projects_starts_epoch[index] = starts_epoch;
+    schedule->projects_ends_epoch[index] = ends_epoch;
+
+    struct Project *project = &schedule->projects[index];
+    project->name = string_pool_intern(schedule->strings, memory, name);
+    project->description = string_pool_intern(schedule->strings, memory, description);
+    project->url = string_pool_intern(schedule->strings, memory, url);
+    project->channel = string_pool_intern(schedule->strings, memory, channel);
+
+    return 0;
 }
 
+// NOTE: a column of the schedule, count elements of type
+#define SCHEDULE_COLUMN(memory, type, count) \
+    ((type*) memory_alloc_aligned(memory, sizeof(type) * (count), alignof(type)))
+
 static
-void parse_schedule_projects(Memory *memory, Json_Value input, struct Schedule *schedule)
+int parse_schedule_projects(Memory *memory, Json_Value input, struct Schedule *schedule)
 {
     assert(memory);
     assert(schedule);
 
-    expect_json_type(input, JSON_ARRAY);
+    if (expect_json_type(input, JSON_ARRAY) < 0) {
+        return -1;
+    }
 
-    const size_t array_size = json_array_size(input.array);
-    const size_t memory_size = sizeof(schedule->projects[0]) * array_size;
+    const size_t array_size = json_array_size(input);
 
-    schedule->projects = memory_alloc_aligned(memory, memory_size, alignof(struct Project));
-    memset(schedule->projects, 0, memory_size);
+    schedule->projects_days = SCHEDULE_COLUMN(memory, uint8_t, array_size);
+    schedule->projects_time_min = SCHEDULE_COLUMN(memory, int32_t, array_size);
+    schedule->projects_starts_epoch = SCHEDULE_COLUMN(memory, int64_t, array_size);
+    schedule->projects_ends_epoch = SCHEDULE_COLUMN(memory, int64_t, array_size);
+    schedule->projects = SCHEDULE_COLUMN(memory, struct Project, array_size);
     schedule->projects_size = 0;
 
-    for (Json_Array_Page *page = input.array.begin;
-         page != NULL;
-         page = page->next)
-    {
-        for (size_t page_index = 0; page_index < page->size; ++page_index) {
-            schedule->projects[schedule->projects_size++] =
-                json_as_project(memory, page->elements[page_index]);
+    for (size_t i = 0; i < array_size; ++i) {
+        if (parse_schedule_project(memory, json_array_at(input, i), schedule) < 0) {
+            return -1;
         }
     }
+
+    return 0;
 }
 
 static
-void parse_schedule_cancelled_events(Memory *memory, Json_Value input, struct Schedule *schedule)
+int parse_schedule_cancelled_events(Memory *memory, Json_Value input, struct Schedule *schedule)
 {
     assert(memory);
     assert(schedule);
-    expect_json_type(input, JSON_ARRAY);
+    if (expect_json_type(input, JSON_ARRAY) < 0) {
+        return -1;
+    }
 
-    const size_t array_size = json_array_size(input.array);
+    const size_t array_size = json_array_size(input);
     const size_t memory_size = sizeof(schedule->cancelled_events[0]) * array_size;
 
     schedule->cancelled_events = memory_alloc_aligned(memory, memory_size, alignof(time_t));
     memset(schedule->cancelled_events, 0, memory_size);
     schedule->cancelled_events_count = 0;
 
-    for (Json_Array_Page *page = input.array.begin;
-         page != NULL;
-         page = page->next)
-    {
-        for (size_t page_index = 0; page_index < page->size; ++page_index) {
-            expect_json_type(page->elements[page_index], JSON_NUMBER);
-            schedule->cancelled_events[schedule->cancelled_events_count++] =
-                json_number_to_integer(page->elements[page_index].number);
+    for (size_t i = 0; i < json_array_size(input); ++i) {
+        const Json_Value element = json_array_at(input, i);
+        if (expect_json_type(element, JSON_NUMBER) < 0) {
+            fprintf(stderr, "...in the cancelled event #%zu\n", i);
+            return -1;
         }
+        schedule->cancelled_events[schedule->cancelled_events_count++] =
+            json_as_integer(element);
     }
+
+    return 0;
 }
 
 static
-struct Event json_as_event(Memory *memory, Json_Value input)
+int json_as_event(Memory *memory, struct String_Pool *pool, Json_Value input, struct Event *output)
 {
     assert(memory);
-    expect_json_type(input, JSON_OBJECT);
+    assert(pool);
+    assert(output);
+    if (expect_json_type(input, JSON_OBJECT) < 0) {
+        return -1;
+    }
 
     struct Event event = {0};
 
-    for (Json_Object_Page *page = input.object.begin;
-         page != NULL;
-         page = page->next)
-    {
-        for (size_t page_index = 0; page_index < page->size; ++page_index) {
-            if (string_equal(page->elements[page_index].key, SLT("date"))) {
-                event.date = json_as_date(memory, page->elements[page_index].value);
-            } else if (string_equal(page->elements[page_index].key, SLT("time"))) {
-                event.time_min = json_as_time_min(memory, page->elements[page_index].value);
-            } else if (string_equal(page->elements[page_index].key, SLT("title"))) {
-                event.title = unwrap_json_string(page->elements[page_index].value);
-            } else if (string_equal(page->elements[page_index].key, SLT("description"))) {
-                event.description = unwrap_json_string(page->elements[page_index].value);
-            } else if (string_equal(page->elements[page_index].key, SLT("url"))) {
-                event.url = unwrap_json_string(page->elements[page_index].value);
-            } else if (string_equal(page->elements[page_index].key, SLT("channel"))) {
-                event.channel = unwrap_json_string(page->elements[page_index].value);
-            }
+    for (size_t i = 0; i < json_object_size(input); ++i) {
+        const Json_Member member = json_object_at(input, i);
+        int err = 0;
+        if (string_equal(member.key, SLT("date"))) {
+            err = json_as_date(member.value, &event.date);
+        } else if (string_equal(member.key, SLT("time"))) {
+            err = json_as_time_min(member.value, &event.time_min);
+        } else if (string_equal(member.key, SLT("title"))) {
+            err = unwrap_json_string(member.value, &event.title);
+        } else if (string_equal(member.key, SLT("description"))) {
+            err = unwrap_json_string(member.value, &event.description);
+        } else if (string_equal(member.key, SLT("url"))) {
+            err = unwrap_json_string(member.value, &event.url);
+        } else if (string_equal(member.key, SLT("channel"))) {
+            err = unwrap_json_string(member.value, &event.channel);
+        }
+
+        if (err < 0) {
+            fprintf(stderr, "...in the field `%.*s`\n", (int) member.key.len, member.key.data);
+            return -1;
         }
     }
 
-    return event;
+    event.strings = pool;
+    event.title_id = string_pool_intern(pool, memory, event.title);
+    event.description_id = string_pool_intern(pool, memory, event.description);
+    event.url_id = string_pool_intern(pool, memory, event.url);
+    event.channel_id = string_pool_intern(pool, memory, event.channel);
+
+    event.title = string_pool_get(pool, event.title_id);
+    event.description = string_pool_get(pool, event.description_id);
+    event.url = string_pool_get(pool, event.url_id);
+    event.channel = string_pool_get(pool, event.channel_id);
+
+    *output = event;
+    return 0;
 }
 
 static
-void parse_schedule_extra_events(Memory *memory, Json_Value input, struct Schedule *schedule)
+int parse_schedule_extra_events(Memory *memory, Json_Value input, struct Schedule *schedule)
 {
     assert(memory);
     assert(schedule);
-    expect_json_type(input, JSON_ARRAY);
+    if (expect_json_type(input, JSON_ARRAY) < 0) {
+        return -1;
+    }
 
-    const size_t array_size = json_array_size(input.array);
+    const size_t array_size = json_array_size(input);
     const size_t memory_size = sizeof(schedule->extra_events[0]) * array_size;
 
     schedule->extra_events = memory_alloc_aligned(memory, memory_size, alignof(struct Event));
     memset(schedule->extra_events, 0, memory_size);
+    schedule->extra_events_dates_epoch = SCHEDULE_COLUMN(memory, int64_t, array_size);
     schedule->extra_events_size = 0;
 
-    for (Json_Array_Page *page = input.array.begin;
-         page != NULL;
-         page = page->next)
-    {
-        for (size_t page_index = 0; page_index < page->size; ++page_index) {
-            assert(schedule->extra_events_size < array_size);
-            schedule->extra_events[schedule->extra_events_size++] =
-                json_as_event(memory, page->elements[page_index]);
+    for (size_t i = 0; i < json_array_size(input); ++i) {
+        const Json_Value element = json_array_at(input, i);
+        assert(schedule->extra_events_size < array_size);
+        struct Event *event = &schedule->extra_events[schedule->extra_events_size];
+        if (json_as_event(memory, schedule->strings, element, event) < 0) {
+            fprintf(stderr, "...of the extra event #%zu\n", i);
+            return -1;
         }
+        struct tm date = event->date;
+        schedule->extra_events_dates_epoch[schedule->extra_events_size] = timegm(&date);
+        schedule->extra_events_size += 1;
     }
+
+    return 0;
 }
 
-struct Schedule json_as_schedule(Memory *memory, Json_Value input)
+int json_as_schedule(Memory *memory, Json_Value input, struct Schedule *output)
 {
     assert(memory);
-    expect_json_type(input, JSON_OBJECT);
+    assert(output);
+    if (expect_json_type(input, JSON_OBJECT) < 0) {
+        return -1;
+    }
 
     struct Schedule schedule = {0};
 
-    for (Json_Object_Page *page = input.object.begin;
-         page != NULL;
-         page = page->next)
-    {
-        for (size_t page_index = 0; page_index < page->size; ++page_index)
-        {
-            if (string_equal(page->elements[page_index].key, SLT("projects"))) {
-                parse_schedule_projects(memory, page->elements[page_index].value, &schedule);
-            } else if (string_equal(page->elements[page_index].key, SLT("cancelledEvents"))) {
-                parse_schedule_cancelled_events(memory, page->elements[page_index].value, &schedule);
-            } else if (string_equal(page->elements[page_index].key, SLT("extraEvents"))) {
-                parse_schedule_extra_events(memory, page->elements[page_index].value, &schedule);
-            } else if (string_equal(page->elements[page_index].key, SLT("timezone"))) {
-                schedule.timezone = unwrap_json_string(page->elements[page_index].value);
+    // NOTE: every project and every extra event has 4 strings at most
+    size_t strings_capacity = 0;
+    for (size_t i = 0; i < json_object_size(input); ++i) {
+        const Json_Member member = json_object_at(input, i);
+        if ((string_equal(member.key, SLT("projects")) || string_equal(member.key, SLT("extraEvents")))
+            && json_type(member.value) == JSON_ARRAY) {
+            strings_capacity += 4 * json_array_size(member.value);
+        }
+    }
+    schedule.strings = memory_alloc_aligned(memory, sizeof(*schedule.strings), alignof(struct String_Pool));
+    string_pool_init(schedule.strings, memory, strings_capacity);
+
+    for (size_t i = 0; i < json_object_size(input); ++i) {
+        const Json_Member member = json_object_at(input, i);
+        int err = 0;
+        if (string_equal(member.key, SLT("projects"))) {
+            err = parse_schedule_projects(memory, member.value, &schedule);
+        } else if (string_equal(member.key, SLT("cancelledEvents"))) {
+            err = parse_schedule_cancelled_events(memory, member.value, &schedule);
+        } else if (string_equal(member.key, SLT("extraEvents"))) {
+            err = parse_schedule_extra_events(memory, member.value, &schedule);
+        } else if (string_equal(member.key, SLT("timezone"))) {
+            err = unwrap_json_string(member.value, &schedule.timezone);
+        }
+
+        if (err < 0) {
+            fprintf(stderr, "...in `%.*s` of the schedule\n", (int) member.key.len, member.key.data);
+            return -1;
+        }
+    }
+
+    *output = schedule;
+    return 0;
+}
+
+size_t schedule_compact_size(const struct Schedule *schedule)
+{
+    assert(schedule);
+    const struct String_Pool *pool = schedule->strings;
+
+    // NOTE: every size is a multiple of 8 and schedule_compact() puts
+    // the columns in the order of decreasing alignment, so there is no
+    // padding between them
+    static_assert(sizeof(struct String_Pool) % 8 == 0, "struct String_Pool would need padding");
+    static_assert(sizeof(String) % 8 == 0, "String would need padding");
+    static_assert(sizeof(struct Event) % 8 == 0, "struct Event would need padding");
+    static_assert(sizeof(struct Project) % 4 == 0, "struct Project would need padding");
+
+    size_t size = sizeof(struct String_Pool)
+        + sizeof(pool->strings[0]) * pool->count
+        + sizeof(pool->json[0]) * pool->count
+        + sizeof(schedule->projects_starts_epoch[0]) * schedule->projects_size
+        + sizeof(schedule->projects_ends_epoch[0]) * schedule->projects_size
+        + sizeof(schedule->cancelled_events[0]) * schedule->cancelled_events_count
+        + sizeof(schedule->extra_events[0]) * schedule->extra_events_size
+        + sizeof(schedule->extra_events_dates_epoch[0]) * schedule->extra_events_size
+        + sizeof(schedule->projects_time_min[0]) * schedule->projects_size
+        + sizeof(schedule->projects[0]) * schedule->projects_size
+        + sizeof(schedule->projects_days[0]) * schedule->projects_size
+        + schedule->timezone.len;
+
+    for (size_t i = 0; i < pool->count; ++i) {
+        size += pool->strings[i].len + pool->json[i].len;
+    }
+
+    return size;
+}
+
+static
+String compact_string(Memory *memory, String s)
+{
+    char *data = memory_alloc(memory, s.len);
+    // NOTE: memcpy() does not take NULL, even for 0 bytes
+    if (s.len > 0) {
+        memcpy(data, s.data, s.len);
+    }
+    return string(s.len, data);
+}
+
+#define COMPACT_COLUMN(memory, type, dst, src, count)                   \
+    do {                                                                \
+        (dst) = SCHEDULE_COLUMN(memory, type, count);                   \
+        if ((count) > 0) memcpy((dst), (src), sizeof(type) * (count));  \
+    } while (0)
+
+struct Schedule schedule_compact(Memory *memory, const struct Schedule *schedule)
+{
+    assert(memory);
+    assert(schedule);
+
+    const size_t size_before = memory->size;
+    const struct String_Pool *pool = schedule->strings;
+    struct Schedule result = *schedule;
+
+    // NOTE: alignment 8 first, then 4, then 1, see schedule_compact_size()
+    result.strings = memory_alloc_aligned(memory, sizeof(*result.strings), alignof(struct String_Pool));
+    memset(result.strings, 0, sizeof(*result.strings));
+    result.strings->count = pool->count;
+    result.strings->capacity = pool->count;
+    result.strings->strings = memory_alloc_aligned(memory, sizeof(String) * pool->count, alignof(String));
+    result.strings->json = memory_alloc_aligned(memory, sizeof(String) * pool->count, alignof(String));
+
+    COMPACT_COLUMN(memory, int64_t, result.projects_starts_epoch, schedule->projects_starts_epoch, schedule->projects_size);
+    COMPACT_COLUMN(memory, int64_t, result.projects_ends_epoch, schedule->projects_ends_epoch, schedule->projects_size);
+    COMPACT_COLUMN(memory, time_t, result.cancelled_events, schedule->cancelled_events, schedule->cancelled_events_count);
+    COMPACT_COLUMN(memory, struct Event, result.extra_events, schedule->extra_events, schedule->extra_events_size);
+    COMPACT_COLUMN(memory, int64_t, result.extra_events_dates_epoch, schedule->extra_events_dates_epoch, schedule->extra_events_size);
+    COMPACT_COLUMN(memory, int32_t, result.projects_time_min, schedule->projects_time_min, schedule->projects_size);
+    COMPACT_COLUMN(memory, struct Project, result.projects, schedule->projects, schedule->projects_size);
+    COMPACT_COLUMN(memory, uint8_t, result.projects_days, schedule->projects_days, schedule->projects_size);
+
+    for (size_t i = 0; i < pool->count; ++i) {
+        result.strings->strings[i] = compact_string(memory, pool->strings[i]);
+        result.strings->json[i] = compact_string(memory, pool->json[i]);
+    }
+    result.timezone = compact_string(memory, schedule->timezone);
+
+    for (size_t i = 0; i < result.extra_events_size; ++i) {
+        struct Event *event = &result.extra_events[i];
+        event->strings = result.strings;
+        event->title = string_pool_get(result.strings, event->title_id);
+        event->description = string_pool_get(result.strings, event->description_id);
+        event->url = string_pool_get(result.strings, event->url_id);
+        event->channel = string_pool_get(result.strings, event->channel_id);
+    }
+
+    assert(memory->size - size_before == schedule_compact_size(schedule));
+    return result;
+}
+
+int is_cancelled(struct Schedule *schedule, time_t id)
+{
+    for (size_t i = 0; i < schedule->cancelled_events_count; ++i) {
+        if (schedule->cancelled_events[i] == id) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static inline
+struct Event project_event(const struct Schedule *schedule, size_t index, struct tm date)
+{
+    const struct Project *project = &schedule->projects[index];
+    return (struct Event) {
+        .date = date,
+        .time_min = schedule->projects_time_min[index],
+        .title = string_pool_get(schedule->strings, project->name),
+        .description = string_pool_get(schedule->strings, project->description),
+        .url = string_pool_get(schedule->strings, project->url),
+        .channel = string_pool_get(schedule->strings, project->channel),
+        .strings = schedule->strings,
+        .title_id = project->name,
+        .description_id = project->description,
+        .url_id = project->url,
+        .channel_id = project->channel,
+    };
+}
+
+#define PROJECTS_BLOCK_SIZE 64
+
+// NOTE: bit k of the result is set when the project begin + k runs on
+// the day of the week wday and the moment t (UTC) is within its starts
+// and ends days. There are no branches in the loop, so the compiler is
+// free to vectorize it (e.g. CFLAGS+=-O3).
+static inline
+uint64_t projects_running(const struct Schedule *schedule, size_t begin, int wday, int64_t t)
+{
+    const size_t end = schedule->projects_size - begin < PROJECTS_BLOCK_SIZE
+        ? schedule->projects_size
+        : begin + PROJECTS_BLOCK_SIZE;
+    const uint8_t day = (uint8_t) (1 << wday);
+
+    uint64_t running = 0;
+    for (size_t i = begin; i < end; ++i) {
+        const uint64_t x = (uint64_t) ((schedule->projects_days[i] & day) != 0)
+            & (uint64_t) (schedule->projects_starts_epoch[i] <= t)
+            & (uint64_t) (t <= schedule->projects_ends_epoch[i]);
+        running |= x << (i - begin);
+    }
+    return running;
+}
+
+time_t id_of_event(struct Event event)
+{
+    return timegm(&event.date) + timezone + event.time_min * 60;
+}
+
+int next_event(time_t current_time,
+               struct Schedule *schedule,
+               struct Event *output)
+{
+    struct Event result = {0};
+    time_t result_id = -1;
+
+    for (size_t i = 0; i < schedule->extra_events_size; ++i) {
+        const time_t event_id = schedule->extra_events_dates_epoch[i] + timezone
+            + schedule->extra_events[i].time_min * 60;
+        if (current_time < event_id && !is_cancelled(schedule, event_id)) {
+            if (result_id < 0 || event_id < result_id) {
+                result = schedule->extra_events[i];
+                result_id = event_id;
             }
         }
     }
 
-    return schedule;
+    for (int j = 0; j < 7; ++j) {
+        time_t week_time = current_time + SECONDS_IN_DAY * j;
+        struct tm week_tm = *gmtime(&week_time);
+        week_tm.tm_sec = 0;
+        week_tm.tm_min = 0;
+        week_tm.tm_hour = 0;
+
+        const time_t week_id = timegm(&week_tm) + timezone;
+
+        for (size_t begin = 0; begin < schedule->projects_size; begin += PROJECTS_BLOCK_SIZE) {
+            uint64_t running = projects_running(schedule, begin, week_tm.tm_wday, week_time + timezone);
+            for (; running != 0; running &= running - 1) {
+                const size_t i = begin + (size_t) __builtin_ctzll(running);
+                const time_t event_id = week_id + schedule->projects_time_min[i] * 60;
+
+                if (current_time >= event_id) {
+                    continue;
+                }
+
+                if (result_id >= 0 && event_id >= result_id) {
+                    continue;
+                }
+
+                if (is_cancelled(schedule, event_id)) {
+                    continue;
+                }
+
+                result = project_event(schedule, i, week_tm);
+                result_id = event_id;
+            }
+        }
+    }
+
+    if (output) {
+        *output = result;
+    }
+
+    return result_id >= 0;
+}
+
+void print_event_json(Buffer *buffer, const struct Event *event)
+{
+    assert(buffer);
+    assert(event);
+    assert(event->strings);
+
+    const struct String_Pool *strings = event->strings;
+    const String prefix = SLT("{\"id\":\"");
+    const String fields[] = {
+        SLT("\",\"title\":"), string_pool_json(strings, event->title_id),
+        SLT(",\"description\":"), string_pool_json(strings, event->description_id),
+        SLT(",\"url\":"), string_pool_json(strings, event->url_id),
+        SLT(",\"channel\":"), string_pool_json(strings, event->channel_id),
+        SLT("}"),
+    };
+    const size_t fields_count = sizeof(fields) / sizeof(fields[0]);
+    const time_t id = id_of_event(*event);
+
+    size_t size = prefix.len + 1 + U64_DIGITS_CAPACITY;
+    for (size_t i = 0; i < fields_count; ++i) {
+        size += fields[i].len;
+    }
+
+    buffer_reserve(buffer, size);
+    char *out = buffer->data + buffer->size;
+
+    memcpy(out, prefix.data, prefix.len);
+    out += prefix.len;
+    if (id < 0) {
+        *out++ = '-';
+        out += u64_to_digits(out, (uint64_t) 0 - (uint64_t) id);
+    } else {
+        out += u64_to_digits(out, (uint64_t) id);
+    }
+    for (size_t i = 0; i < fields_count; ++i) {
+        memcpy(out, fields[i].data, fields[i].len);
+        out += fields[i].len;
+    }
+
+    buffer->size = (size_t) (out - buffer->data);
+}
+
+int is_same_day(struct tm a, struct tm b)
+{
+    return a.tm_mday == b.tm_mday
+        && a.tm_mon  == b.tm_mon
+        && a.tm_year == b.tm_year;
+}
+
+typedef void (*EventCallback)(void *context, struct Event* event);
+
+size_t events_at_day(struct tm date,
+                     struct Schedule *schedule,
+                     EventCallback event_callback,
+                     void *event_context)
+{
+    size_t result = 0;
+
+    date.tm_sec = 0;
+    date.tm_min = 0;
+    date.tm_hour = 0;
+
+    // NOTE: normalizes the date as well, so tm_wday is right
+    const time_t date_time = timegm(&date);
+    const time_t date_id = date_time + timezone;
+
+    for (size_t i = 0; i < schedule->extra_events_size; ++i) {
+        if (schedule->extra_events_dates_epoch[i] == date_time) {
+            result += 1;
+            event_callback(event_context, &schedule->extra_events[i]);
+        }
+    }
+
+    for (size_t begin = 0; begin < schedule->projects_size; begin += PROJECTS_BLOCK_SIZE) {
+        uint64_t running = projects_running(schedule, begin, date.tm_wday, date_time);
+        for (; running != 0; running &= running - 1) {
+            const size_t i = begin + (size_t) __builtin_ctzll(running);
+            if (is_cancelled(schedule, date_id + schedule->projects_time_min[i] * 60)) {
+                continue;
+            }
+
+            struct Event event = project_event(schedule, i, date);
+            result += 1;
+            event_callback(event_context, &event);
+        }
+    }
+
+    return result;
 }
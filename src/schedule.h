@@ -3,20 +3,58 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <time.h>
 #include "s.h"
 #include "memory.h"
 #include "json.h"
 
+typedef uint32_t String_Id;
+
+// NOTE: The text of the schedule. Every distinct string is stored once
+// and gets a stable id, the index into strings. The strings are not
+// copied, the first occurrence becomes the canonical one, so they live
+// as long as the memory they were parsed into. Along with every string
+// its escaped JSON form is kept, so the same channel or url is escaped
+// only once no matter how many events share it.
+struct String_Pool
+{
+    String *strings;
+    String *json;
+    size_t count;
+    size_t capacity;
+    // NOTE: open addressing with linear probing. A slot holds id + 1,
+    // 0 is an empty slot. NULL in a compacted schedule.
+    String_Id *slots;
+    size_t slots_count;
+};
+
+// NOTE: capacity is the most strings that are ever going to be interned
+void string_pool_init(struct String_Pool *pool, Memory *memory, size_t capacity);
+String_Id string_pool_intern(struct String_Pool *pool, Memory *memory, String s);
+
+static inline
+String string_pool_get(const struct String_Pool *pool, String_Id id)
+{
+    assert(id < pool->count);
+    return pool->strings[id];
+}
+
+static inline
+String string_pool_json(const struct String_Pool *pool, String_Id id)
+{
+    assert(id < pool->count);
+    return pool->json[id];
+}
+
+// NOTE: the cold part of a project, only looked at when the project
+// makes it into the result. The hot part is in the projects_* columns
+// of struct Schedule.
 struct Project
 {
-    String name;
-    String description;
-    String url;
-    uint8_t days;
-    int time_min;
-    String channel;
-    struct tm *starts;
-    struct tm *ends;
+    String_Id name;
+    String_Id description;
+    String_Id url;
+    String_Id channel;
 };
 
 struct Event
@@ -27,19 +65,103 @@ struct Event
     String description;
     String url;
     String channel;
+    // NOTE: the same strings as ids in the String_Pool of the schedule.
+    // Their JSON was escaped once at load, so serializing an event is
+    // mostly a few memcpys.
+    const struct String_Pool *strings;
+    String_Id title_id;
+    String_Id description_id;
+    String_Id url_id;
+    String_Id channel_id;
 };
 
 struct Schedule
 {
+    // NOTE: lives in the memory of the schedule, so the events can point
+    // to it however the struct Schedule is copied around
+    struct String_Pool *strings;
+
+    // NOTE: the projects as a struct of arrays, projects_size long each.
+    // The filters of the queries scan only the columns of days, time and
+    // dates, and look into projects (the text) only for what passed.
+    uint8_t *projects_days;
+    int32_t *projects_time_min;
+    // NOTE: the midnights (UTC) of the first and the last day of the
+    // projects in seconds since the epoch. INT64_MIN and INT64_MAX when
+    // the project has no such day.
+    int64_t *projects_starts_epoch;
+    int64_t *projects_ends_epoch;
     struct Project *projects;
     size_t projects_size;
+
     time_t *cancelled_events;
     size_t cancelled_events_count;
+
     struct Event *extra_events;
+    // NOTE: the midnights (UTC) of extra_events[i].date, so matching
+    // them against a day does not go through struct tm
+    int64_t *extra_events_dates_epoch;
     size_t extra_events_size;
+
     String timezone;
 };
 
-struct Schedule json_as_schedule(Memory *memory, Json_Value input);
+// NOTE: `HH:MM` into the minutes since midnight. Like strptime("%H:%M")
+// the hours and the minutes may have 1 digit, e.g. `9:00`. -1 when s is
+// not a time.
+int parse_time_min(String s, int *time_min);
+// NOTE: `YYYY-MM-DD` into the days since 1970-01-01. The month and the
+// day may have 1 digit, e.g. `2020-3-1`. -1 when s is not a date.
+int parse_epoch_days(String s, int64_t *epoch_days);
+// NOTE: the struct tm of the midnight of the day, the same as gmtime()
+struct tm tm_of_epoch_days(int64_t epoch_days);
+
+// NOTE: parse_json_value() of the schedule followed by json_as_schedule()
+// never take more memory than SCHEDULE_MEMORY_RATIO bytes per byte of the
+// input plus SCHEDULE_MEMORY_BASE. The worst case is an array of empty
+// extra events: 3 bytes of `{},` become a Json_Value, a struct Event with
+// its date and 4 entries of the String_Pool (~123 bytes per byte).
+// schedule_test checks the bound.
+#define SCHEDULE_MEMORY_RATIO 128
+#define SCHEDULE_MEMORY_BASE (64 * KILO)
+
+// NOTE: returns 0 on success. Otherwise prints what is wrong with the
+// input to stderr and returns -1. The memory may have been used either
+// way.
+int json_as_schedule(Memory *memory, Json_Value input, struct Schedule *schedule);
+
+// NOTE: the exact amount of memory schedule_compact() takes for the
+// schedule, given that the memory starts at a malloc()-ed address
+size_t schedule_compact_size(const struct Schedule *schedule);
+
+// NOTE: deep copies the schedule into memory, leaving behind whatever
+// else the parsing put into the memory of the original (the JSON tree,
+// the hash table of the String_Pool). Nothing of the copy points into
+// the original, so its memory can be freed. No more strings can be
+// interned into the String_Pool of the copy.
+struct Schedule schedule_compact(Memory *memory, const struct Schedule *schedule);
+
+int is_cancelled(struct Schedule *schedule, time_t id);
+time_t id_of_event(struct Event event);
+
+// NOTE: the closest event that starts after current_time within a week
+int next_event(time_t current_time,
+               struct Schedule *schedule,
+               struct Event *output);
+
+// NOTE: `{"id":"<id>","title":...}`. The event must come from the
+// schedule, so its strings are in the pool.
+void print_event_json(Buffer *buffer, const struct Event *event);
+
+int is_same_day(struct tm a, struct tm b);
+
+typedef void (*EventCallback)(void *context, struct Event* event);
+
+// NOTE: calls event_callback for every event of the day and returns
+// their amount
+size_t events_at_day(struct tm date,
+                     struct Schedule *schedule,
+                     EventCallback event_callback,
+                     void *event_context);
 
 #endif  // SCHEDULE_H_
@@ -0,0 +1,300 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "json.h"
+#include "schedule.h"
+
+// NOTE: Benchmark of the schedule queries on synthetic schedules of
+// growing size. Every schedule has the given amount of projects, a
+// tenth of that of extra events and a tenth of that of cancelled
+// events. For each size it times the full load (parse_json_value +
+// json_as_schedule), next_event() and the period queries of a few
+// widths built on top of events_at_day(), and the serialization of the
+// widest period into JSON. The per project cost in the ns/proj/day
+// column should stay flat, where it grows the query is worse than
+// linear.
+
+#define SCHEDULE_MEMORY_CAPACITY (512 * MEGA)
+// NOTE: the parsed JSON takes a couple of times the size of its text
+#define PARSE_MEMORY_RATIO 8
+
+#define BENCH_MIN_SECONDS 0.2
+#define SECONDS_IN_DAY (24 * 60 * 60)
+
+static
+double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+static uint64_t random_state = 0x9E3779B97F4A7C15ull;
+
+static
+uint32_t random_u32(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return (uint32_t) random_state;
+}
+
+static
+void append_date(Buffer *buffer, time_t t)
+{
+    char date[32];
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    buffer_append(buffer, date, strftime(date, sizeof(date), "\"%Y-%m-%d\"", &tm));
+}
+
+static
+void append_time(Buffer *buffer, int time_min)
+{
+    char time[16];
+    buffer_append(buffer, time, (size_t) snprintf(time, sizeof(time), "\"%02d:%02d\"",
+                                                  time_min / 60, time_min % 60));
+}
+
+// NOTE: the projects are spread around now: most of them are running,
+// some of them have not started yet and some are already over
+static
+void generate_schedule(Buffer *buffer, size_t projects_count, time_t now)
+{
+    const time_t today = now / SECONDS_IN_DAY * SECONDS_IN_DAY;
+
+    buffer_append_cstr(buffer, "{\"timezone\":\"UTC\",\"projects\":[");
+    for (size_t i = 0; i < projects_count; ++i) {
+        if (i > 0) buffer_append_char(buffer, ',');
+        buffer_append_cstr(buffer, "{\"name\":\"Project #");
+        buffer_append_u64(buffer, i);
+        buffer_append_cstr(buffer, "\",\"description\":\"Synthetic project for benchmarking the schedule queries\","
+                           "\"url\":\"https://github.com/tsoding/skedudle\","
+                           "\"channel\":\"https://twitch.tv/tsoding\",\"days\":[");
+        const uint32_t days = random_u32() % 127 + 1;
+        for (int day = 1, first = 1; day <= 7; ++day) {
+            if (days & (1 << (day - 1))) {
+                if (!first) buffer_append_char(buffer, ',');
+                buffer_append_u64(buffer, (uint64_t) day);
+                first = 0;
+            }
+        }
+        buffer_append_cstr(buffer, "],\"time\":");
+        append_time(buffer, (int) (random_u32() % (24 * 4)) * 15);
+
+        const uint32_t r = random_u32() % 8;
+        if (r < 6) {
+            buffer_append_cstr(buffer, ",\"starts\":");
+            append_date(buffer, today - (time_t) (random_u32() % 365 + 1) * SECONDS_IN_DAY);
+        }
+        if (r == 0 || r == 6) {
+            buffer_append_cstr(buffer, ",\"ends\":");
+            append_date(buffer, today + (time_t) (random_u32() % 60) * SECONDS_IN_DAY
+                        - (r == 0 ? 90 * SECONDS_IN_DAY : 0));
+        }
+        buffer_append_char(buffer, '}');
+    }
+
+    const size_t extra_count = projects_count / 10;
+    buffer_append_cstr(buffer, "],\"extraEvents\":[");
+    for (size_t i = 0; i < extra_count; ++i) {
+        if (i > 0) buffer_append_char(buffer, ',');
+        buffer_append_cstr(buffer, "{\"title\":\"Extra event #");
+        buffer_append_u64(buffer, i);
+        buffer_append_cstr(buffer, "\",\"description\":\"Synthetic extra event\","
+                           "\"url\":\"https://github.com/tsoding/skedudle\","
+                           "\"channel\":\"https://twitch.tv/tsoding\",\"date\":");
+        append_date(buffer, today + ((time_t) (random_u32() % 60) - 30) * SECONDS_IN_DAY);
+        buffer_append_cstr(buffer, ",\"time\":");
+        append_time(buffer, (int) (random_u32() % (24 * 4)) * 15);
+        buffer_append_char(buffer, '}');
+    }
+
+    // NOTE: the ids look like the real ones around now, but most of
+    // them do not hit anything, so every lookup scans the whole list
+    const size_t cancelled_count = projects_count / 10;
+    buffer_append_cstr(buffer, "],\"cancelledEvents\":[");
+    for (size_t i = 0; i < cancelled_count; ++i) {
+        if (i > 0) buffer_append_char(buffer, ',');
+        const time_t id = today + ((time_t) (random_u32() % 30) - 15) * SECONDS_IN_DAY
+            + (time_t) (random_u32() % (24 * 4)) * 15 * 60;
+        buffer_append_u64(buffer, (uint64_t) id);
+    }
+    buffer_append_cstr(buffer, "]}");
+}
+
+static
+void count_event(size_t *count, struct Event *event)
+{
+    (void) event;
+    *count += 1;
+}
+
+static
+size_t period_query(struct Schedule *schedule, time_t begin, size_t days)
+{
+    size_t count = 0;
+    time_t current_time = begin;
+    for (size_t i = 0; i < days; ++i) {
+        struct tm current_date;
+        gmtime_r(&current_time, &current_date);
+        events_at_day(current_date, schedule, (EventCallback) count_event, &count);
+        current_time += SECONDS_IN_DAY;
+    }
+    return count;
+}
+
+#define BENCH(best, ...)                                        \
+    do {                                                        \
+        (best) = 0.0;                                           \
+        double total__ = 0.0;                                   \
+        for (int i__ = 0; total__ < BENCH_MIN_SECONDS; ++i__) { \
+            const double begin__ = now_seconds();               \
+            __VA_ARGS__;                                        \
+            const double elapsed__ = now_seconds() - begin__;   \
+            if (i__ == 0 || elapsed__ < (best)) {               \
+                (best) = elapsed__;                             \
+            }                                                   \
+            total__ += elapsed__;                               \
+        }                                                       \
+    } while (0)
+
+static
+void serialize_event(Buffer *buffer, struct Event *event)
+{
+    if (buffer->size > 1) buffer_append_char(buffer, ',');
+    print_event_json(buffer, event);
+}
+
+// NOTE: the same thing /api/period_streams does, minus the nulls of
+// the days off
+static
+void period_serialize(struct Schedule *schedule, Buffer *buffer, time_t begin, size_t days)
+{
+    buffer_clean(buffer);
+    buffer_append_char(buffer, '[');
+    time_t current_time = begin;
+    for (size_t i = 0; i < days; ++i) {
+        struct tm current_date;
+        gmtime_r(&current_time, &current_date);
+        events_at_day(current_date, schedule, (EventCallback) serialize_event, buffer);
+        current_time += SECONDS_IN_DAY;
+    }
+    buffer_append_char(buffer, ']');
+}
+
+static const size_t period_widths[] = {1, 7, 18, 28};
+#define PERIOD_WIDTHS_COUNT (sizeof(period_widths) / sizeof(period_widths[0]))
+
+static
+void bench_schedule(size_t projects_count, time_t now)
+{
+    Memory source_memory = {
+        .capacity = SCHEDULE_MEMORY_CAPACITY,
+        .buffer = malloc(SCHEDULE_MEMORY_CAPACITY),
+    };
+    assert(source_memory.buffer);
+
+    Buffer source = buffer_of_memory(&source_memory);
+    generate_schedule(&source, projects_count, now);
+
+    Memory memory = {
+        .capacity = source.size * PARSE_MEMORY_RATIO + SCHEDULE_MEMORY_CAPACITY,
+    };
+    memory.buffer = malloc(memory.capacity);
+    assert(memory.buffer);
+
+    struct Schedule schedule = {0};
+    double load_time = 0.0;
+    BENCH(load_time, {
+        memory_clean(&memory);
+        Json_Result result = parse_json_value(&memory, buffer_as_string(source));
+        if (result.is_error) {
+            print_json_error(stderr, result, buffer_as_string(source), "synthetic");
+            exit(1);
+        }
+        if (json_as_schedule(&memory, result.value, &schedule) < 0) {
+            exit(1);
+        }
+    });
+    assert(schedule.projects_size == projects_count);
+
+    int found = 0;
+    double next_time = 0.0;
+    BENCH(next_time, {
+        struct Event event;
+        found = next_event(now, &schedule, &event);
+    });
+
+    double period_times[PERIOD_WIDTHS_COUNT] = {0};
+    size_t period_counts[PERIOD_WIDTHS_COUNT] = {0};
+    for (size_t i = 0; i < PERIOD_WIDTHS_COUNT; ++i) {
+        const time_t begin = now - SECONDS_IN_DAY * 4;
+        BENCH(period_times[i], {
+            period_counts[i] = period_query(&schedule, begin, period_widths[i]);
+        });
+    }
+
+    // NOTE: the serialization of the widest period, the query included
+    Buffer json = buffer_of_memory(&source_memory);
+    double json_time = 0.0;
+    BENCH(json_time, {
+        period_serialize(&schedule, &json, now - SECONDS_IN_DAY * 4,
+                         period_widths[PERIOD_WIDTHS_COUNT - 1]);
+    });
+
+    printf("%8zu %8.2f %11.1f %10.3f", projects_count,
+           (double) source.size / (1000.0 * 1000.0), load_time * 1e3, next_time * 1e3);
+    for (size_t i = 0; i < PERIOD_WIDTHS_COUNT; ++i) {
+        printf(" %10.3f", period_times[i] * 1e3);
+    }
+    printf(" %12.1f %8zu %10.3f %8.1f %d\n",
+           period_times[PERIOD_WIDTHS_COUNT - 1] * 1e9
+           / (double) (projects_count * period_widths[PERIOD_WIDTHS_COUNT - 1]),
+           period_counts[PERIOD_WIDTHS_COUNT - 1],
+           json_time * 1e3, (double) json.size / (json_time * 1000.0 * 1000.0), found);
+    fflush(stdout);
+
+    free(memory.buffer);
+    free(source_memory.buffer);
+}
+
+int main(int argc, char *argv[])
+{
+    // NOTE: the schedules are in UTC, so the queries see timezone == 0
+    setenv("TZ", "UTC", 1);
+    tzset();
+
+    const time_t now = time(NULL);
+
+    printf("%8s %8s %11s %10s", "projects", "JSON MB", "load ms", "next ms");
+    for (size_t i = 0; i < PERIOD_WIDTHS_COUNT; ++i) {
+        char column[32];
+        snprintf(column, sizeof(column), "%zud ms", period_widths[i]);
+        printf(" %10s", column);
+    }
+    printf(" %12s %8s %10s %8s %s\n", "ns/proj/day", "events", "json ms", "json MB/s", "next");
+
+    if (argc > 1) {
+        for (int i = 1; i < argc; ++i) {
+            const size_t projects_count = strtoul(argv[i], NULL, 10);
+            if (projects_count == 0) {
+                fprintf(stderr, "schedule_bench [projects-count...]\n");
+                exit(1);
+            }
+            bench_schedule(projects_count, now);
+        }
+    } else {
+        for (size_t projects_count = 100; projects_count <= 100000; projects_count *= 10) {
+            bench_schedule(projects_count, now);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,271 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "json.h"
+#include "schedule.h"
+#include "test.h"
+
+#define MEMORY_CAPACITY (640 * 1000)
+
+static
+void test_parse_time_min(void)
+{
+    const struct {
+        String input;
+        int time_min;
+    } valid[] = {
+        {SLT("00:00"), 0},
+        {SLT("23:59"), 23 * 60 + 59},
+        {SLT("12:30"), 12 * 60 + 30},
+        // NOTE: strptime("%H:%M") took those, so the schedules may have them
+        {SLT("9:00"), 9 * 60},
+        {SLT("9:5"), 9 * 60 + 5},
+    };
+
+    for (size_t i = 0; i < sizeof(valid) / sizeof(valid[0]); ++i) {
+        int time_min = -1;
+        EXPECT(parse_time_min(valid[i].input, &time_min) == 0);
+        EXPECT(time_min == valid[i].time_min);
+    }
+
+    const String invalid[] = {
+        SLT("24:00"),
+        SLT("12:60"),
+        SLT(""),
+        SLT(":"),
+        SLT("12"),
+        SLT("12:"),
+        SLT(":30"),
+        SLT("123:00"),
+        SLT("12:000"),
+        SLT("12:00 "),
+        SLT(" 12:00"),
+        SLT("12-00"),
+        SLT("ab:cd"),
+    };
+
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i) {
+        int time_min = -1;
+        EXPECT(parse_time_min(invalid[i], &time_min) < 0);
+    }
+}
+
+static
+void test_parse_epoch_days(void)
+{
+    const struct {
+        String input;
+        int year;
+        int month;
+        int day;
+    } valid[] = {
+        {SLT("1970-01-01"), 1970, 1, 1},
+        {SLT("2024-02-29"), 2024, 2, 29},
+        {SLT("2000-02-29"), 2000, 2, 29},
+        {SLT("1969-12-31"), 1969, 12, 31},
+        {SLT("2020-3-1"), 2020, 3, 1},
+    };
+
+    for (size_t i = 0; i < sizeof(valid) / sizeof(valid[0]); ++i) {
+        int64_t epoch_days = 0;
+        EXPECT(parse_epoch_days(valid[i].input, &epoch_days) == 0);
+
+        const time_t t = (time_t) epoch_days * 24 * 60 * 60;
+        struct tm tm;
+        gmtime_r(&t, &tm);
+        EXPECT(tm.tm_year + 1900 == valid[i].year);
+        EXPECT(tm.tm_mon + 1 == valid[i].month);
+        EXPECT(tm.tm_mday == valid[i].day);
+    }
+
+    const String invalid[] = {
+        SLT("2023-02-29"),
+        SLT("1900-02-29"),
+        SLT("2024-13-01"),
+        SLT("2024-00-01"),
+        SLT("2024-01-00"),
+        SLT("2024-04-31"),
+        SLT(""),
+        SLT("2024"),
+        SLT("2024-01"),
+        SLT("24-01-01"),
+        SLT("20240-01-01"),
+        SLT("2024-001-01"),
+        SLT("2024-01-011"),
+        SLT("2024-01-01 "),
+        SLT("2024/01/01"),
+    };
+
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i) {
+        int64_t epoch_days = 0;
+        EXPECT(parse_epoch_days(invalid[i], &epoch_days) < 0);
+    }
+}
+
+static
+int same_tm(struct tm a, struct tm b)
+{
+    return a.tm_year == b.tm_year
+        && a.tm_mon == b.tm_mon
+        && a.tm_mday == b.tm_mday
+        && a.tm_wday == b.tm_wday
+        && a.tm_yday == b.tm_yday
+        && a.tm_hour == 0 && a.tm_min == 0 && a.tm_sec == 0;
+}
+
+static
+void test_tm_of_epoch_days(void)
+{
+    // NOTE: the days before 0000-03-01 (-719468) take the negative era
+    // branch of the algorithm
+    const int64_t begins[] = {-719468 - 146097 * 2, -719468 - 400, -800, 0, 20000, 2932896 - 400};
+    for (size_t i = 0; i < sizeof(begins) / sizeof(begins[0]); ++i) {
+        for (int64_t epoch_days = begins[i]; epoch_days < begins[i] + 800; ++epoch_days) {
+            const time_t t = (time_t) epoch_days * 24 * 60 * 60;
+            struct tm expected;
+            gmtime_r(&t, &expected);
+            EXPECT(same_tm(tm_of_epoch_days(epoch_days), expected));
+        }
+    }
+
+    for (int64_t epoch_days = -1000000; epoch_days < 1000000; epoch_days += 997) {
+        const time_t t = (time_t) epoch_days * 24 * 60 * 60;
+        struct tm expected;
+        gmtime_r(&t, &expected);
+        EXPECT(same_tm(tm_of_epoch_days(epoch_days), expected));
+    }
+}
+
+static
+int load_schedule_text(Memory *memory, String text, struct Schedule *schedule)
+{
+    memory_clean(memory);
+    Json_Result result = parse_json_value(memory, text);
+    if (result.is_error) {
+        return -1;
+    }
+    return json_as_schedule(memory, result.value, schedule);
+}
+
+static
+void test_json_as_schedule(Memory *memory)
+{
+    struct Schedule schedule = {0};
+
+    EXPECT(load_schedule_text(memory, SLT(
+        "{\"timezone\": \"UTC\","
+        " \"projects\": [{\"name\": \"a\", \"days\": [1, 7], \"time\": \"9:00\","
+        "                 \"starts\": \"2024-02-29\"}],"
+        " \"extraEvents\": [{\"title\": \"b\", \"date\": \"2024-03-01\", \"time\": \"23:59\"}],"
+        " \"cancelledEvents\": [1]}"), &schedule) == 0);
+    EXPECT(schedule.projects_size == 1);
+    EXPECT(schedule.projects_time_min[0] == 9 * 60);
+    EXPECT(schedule.projects_days[0] == ((1 << 1) | (1 << 0)));
+    EXPECT(schedule.extra_events_size == 1);
+    EXPECT(schedule.extra_events[0].time_min == 23 * 60 + 59);
+    EXPECT(schedule.cancelled_events_count == 1);
+
+    // NOTE: the invalid schedules are reported, not aborted on
+    const String invalid[] = {
+        SLT("[]"),
+        SLT("{\"projects\": [{\"time\": \"24:00\"}]}"),
+        SLT("{\"projects\": [{\"time\": 900}]}"),
+        SLT("{\"projects\": [{\"days\": [-1]}]}"),
+        SLT("{\"projects\": [{\"starts\": \"2023-02-29\"}]}"),
+        SLT("{\"projects\": {}}"),
+        SLT("{\"extraEvents\": [{\"date\": \"2024-13-01\"}]}"),
+        SLT("{\"cancelledEvents\": [\"1\"]}"),
+        SLT("{\"timezone\": 1}"),
+    };
+
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i) {
+        EXPECT(load_schedule_text(memory, invalid[i], &schedule) < 0);
+    }
+}
+
+static
+void append_repeated(Buffer *buffer, const char *prefix, const char *element, size_t count, const char *suffix)
+{
+    buffer_append_cstr(buffer, prefix);
+    for (size_t i = 0; i < count; ++i) {
+        if (i > 0) buffer_append_char(buffer, ',');
+        buffer_append_cstr(buffer, element);
+    }
+    buffer_append_cstr(buffer, suffix);
+}
+
+// NOTE: the schedules that take the most memory per byte of input do
+// not go over SCHEDULE_MEMORY_RATIO
+static
+void test_schedule_memory_bound(void)
+{
+    const struct {
+        const char *prefix;
+        const char *element;
+        const char *suffix;
+    } inputs[] = {
+        {"{\"extraEvents\":[", "{}", "]}"},
+        {"{\"projects\":[", "{}", "]}"},
+        {"{\"projects\":[", "{\"name\":\"\\u0001\",\"days\":[1]}", "]}"},
+        {"{\"cancelledEvents\":[", "1", "]}"},
+        {"{\"projects\":[{\"days\":[", "1", "]}]}"},
+        {"{\"x\":[", "[[[1]]]", "]}"},
+        {"{\"x\":[", "{\"a\":1}", "]}"},
+        {"{\"timezone\":\"", "\\u0001", "\"}"},
+    };
+    const size_t count = 10000;
+
+    Memory source_memory = {
+        .capacity = 1 * MEGA,
+        .buffer = malloc(1 * MEGA),
+    };
+    assert(source_memory.buffer);
+
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); ++i) {
+        memory_clean(&source_memory);
+        Buffer source = buffer_of_memory(&source_memory);
+        append_repeated(&source, inputs[i].prefix, inputs[i].element, count, inputs[i].suffix);
+
+        const size_t bound = source.size * SCHEDULE_MEMORY_RATIO + SCHEDULE_MEMORY_BASE;
+        Memory memory = {
+            .capacity = bound * 2,
+            .buffer = malloc(bound * 2),
+        };
+        assert(memory.buffer);
+
+        struct Schedule schedule = {0};
+        EXPECT(load_schedule_text(&memory, buffer_as_string(source), &schedule) == 0);
+        EXPECT(memory.size <= bound);
+
+        free(memory.buffer);
+    }
+
+    free(source_memory.buffer);
+}
+
+int main(void)
+{
+    Memory memory = {
+        .capacity = MEMORY_CAPACITY,
+        .buffer = malloc(MEMORY_CAPACITY)
+    };
+    assert(memory.buffer);
+
+    test_parse_time_min();
+    test_parse_epoch_days();
+    test_tm_of_epoch_days();
+    test_json_as_schedule(&memory);
+    test_schedule_memory_bound();
+
+    free(memory.buffer);
+
+    if (failures > 0) {
+        fprintf(stderr, "%d checks FAILED\n", failures);
+        return 1;
+    }
+
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,1175 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "server.h"
+#include "metrics.h"
+#include "log.h"
+
+#define CONNECTION_INPUT_CAPACITY (640 * KILO)
+#define SERVER_FREE_INPUTS_CAPACITY 64
+#define SERVER_EVENTS_CAPACITY 256
+
+// NOTE: how long an idle keep-alive connection is kept around
+#define SERVER_KEEP_ALIVE_TIMEOUT_MS (30 * 1000)
+// NOTE: the whole request must arrive within this time from its first
+// byte. Slow clients (or slowloris attacks) do not get to keep the
+// connection forever by sending a byte once in a while.
+#define SERVER_REQUEST_TIMEOUT_MS (10 * 1000)
+// NOTE: how long a client may not accept any of the output
+#define SERVER_WRITE_TIMEOUT_MS (30 * 1000)
+// NOTE: the streams get a comment this often, so the proxies do not
+// consider them dead and the dead clients are noticed
+#define SERVER_HEARTBEAT_INTERVAL_MS (15 * 1000)
+
+#define SERVER_URING_ENTRIES 4096
+#define SERVER_URING_BUFFER_GROUP 0
+#define SERVER_URING_BUFFERS_COUNT 1024
+#define SERVER_URING_BUFFER_SIZE (4 * KILO)
+
+// NOTE: what a completion is about is kept in the lowest bits of its
+// user_data, the rest is the pointer to the Connection (or the Server)
+typedef enum {
+    URING_OP_ACCEPT = 0,
+    URING_OP_SIGNAL,
+    URING_OP_RECV,
+    URING_OP_SEND,
+    URING_OP_CLOSE,
+    URING_OP_CANCEL,
+    URING_OP_MASK = 7,
+} Uring_Op;
+
+static_assert(HTTP_HEAD_SIZE_LIMIT + HTTP_BODY_SIZE_LIMIT <= CONNECTION_INPUT_CAPACITY,
+              "The input buffer must fit the largest request the parser accepts");
+
+typedef enum {
+    CONNECTION_READING = 0,
+    CONNECTION_WRITING,
+    CONNECTION_STREAMING,
+} Connection_State;
+
+struct Connection {
+    Server *server;
+    int fd;
+    Connection_State state;
+    uint32_t events;
+    Timer timer;
+
+    // NOTE: the parser keeps Strings into the input, so the input is
+    // never reallocated while a request is in progress
+    char *input;
+    size_t input_size;
+    Http_Parser parser;
+    int keep_alive;
+
+    // NOTE: the part of the response the socket did not accept right
+    // away. With io_uring it is the whole response, because the kernel
+    // sends it after the request arena is already reused.
+    char *output;
+    size_t output_capacity;
+    size_t output_size;
+    size_t output_sent;
+
+    // NOTE: the message being sent and the one waiting after it. The
+    // messages are snapshots of the state, so the waiting one is simply
+    // replaced when a newer one arrives.
+    Sse_Message *message;
+    size_t message_sent;
+    Sse_Message *message_next;
+
+    Connection *prev;
+    Connection *next;
+
+    // NOTE: io_uring only. The Connection is freed when the last of its
+    // operations completes, because the completions refer to it.
+    size_t pending_ops;
+    int receiving;
+    int sending;
+    int closing;
+};
+
+static
+uint64_t uring_user_data(void *ptr, Uring_Op op)
+{
+    assert(((uintptr_t) ptr & URING_OP_MASK) == 0);
+    return (uint64_t) (uintptr_t) ptr | op;
+}
+
+static
+Sse_Message *sse_message_acquire(Sse_Message *message)
+{
+    if (message) {
+        message->refcount += 1;
+    }
+    return message;
+}
+
+static
+void sse_message_release(Sse_Message *message)
+{
+    if (message) {
+        assert(message->refcount > 0);
+        message->refcount -= 1;
+        if (message->refcount == 0) {
+            free(message);
+        }
+    }
+}
+
+static
+Sse_Message *sse_message_of_parts(const String *parts, size_t parts_count)
+{
+    size_t size = 0;
+    for (size_t i = 0; i < parts_count; ++i) {
+        size += parts[i].len;
+    }
+
+    Sse_Message *message = malloc(sizeof(Sse_Message) + size);
+    assert(message);
+    message->refcount = 1;
+    message->size = 0;
+
+    for (size_t i = 0; i < parts_count; ++i) {
+        memcpy(message->data + message->size, parts[i].data, parts[i].len);
+        message->size += parts[i].len;
+    }
+
+    return message;
+}
+
+uint64_t server_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+}
+
+void server_timer_set(Server *server, Timer *timer, uint64_t delay_ms)
+{
+    assert(server);
+    timer_wheel_add(&server->timers, timer, server_now() + delay_ms);
+}
+
+void server_timer_cancel(Server *server, Timer *timer)
+{
+    assert(server);
+    timer_wheel_cancel(&server->timers, timer);
+}
+
+// NOTE: the input buffers are big, but only the touched pages are
+// backed by physical memory. Keeping a few of them around saves a
+// malloc/free pair (which is an mmap/munmap pair for this size) per
+// request.
+static
+char *server_input_acquire(Server *server)
+{
+    if (server->free_inputs_count > 0) {
+        return server->free_inputs[--server->free_inputs_count];
+    }
+
+    char *input = malloc(CONNECTION_INPUT_CAPACITY);
+    assert(input);
+    return input;
+}
+
+static
+void server_input_release(Server *server, char *input)
+{
+    if (input == NULL) {
+        return;
+    }
+
+    if (server->free_inputs_count < SERVER_FREE_INPUTS_CAPACITY) {
+        server->free_inputs[server->free_inputs_count++] = input;
+    } else {
+        free(input);
+    }
+}
+
+static
+void connection_watch(Server *server, Connection *connection, uint32_t events)
+{
+    // NOTE: io_uring does not need to be told what to wait for. The
+    // events are still tracked, because the state machine looks at them.
+    if (server->backend == SERVER_BACKEND_IO_URING) {
+        connection->events = events;
+        return;
+    }
+
+    if (connection->events == events) {
+        return;
+    }
+
+    struct epoll_event event = {
+        .events = events,
+        .data.ptr = connection,
+    };
+    int err = epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+    assert(err == 0);
+    connection->events = events;
+}
+
+static
+void connection_output_reserve(Connection *connection, size_t size)
+{
+    if (connection->output_size + size <= connection->output_capacity) {
+        return;
+    }
+
+    size_t capacity = connection->output_capacity ? connection->output_capacity : 4 * KILO;
+    while (capacity < connection->output_size + size) {
+        capacity *= 2;
+    }
+
+    connection->output = realloc(connection->output, capacity);
+    assert(connection->output);
+    connection->output_capacity = capacity;
+}
+
+static
+void connection_free(Server *server, Connection *connection)
+{
+    server_timer_cancel(server, &connection->timer);
+    sse_message_release(connection->message);
+    sse_message_release(connection->message_next);
+    server_input_release(server, connection->input);
+    free(connection->output);
+    free(connection);
+    server->connections_count -= 1;
+    metrics_connection_closed();
+}
+
+// NOTE: one of the io_uring operations of the connection is over
+static
+void connection_op_done(Server *server, Connection *connection)
+{
+    assert(connection->pending_ops > 0);
+    connection->pending_ops -= 1;
+    if (connection->closing && connection->pending_ops == 0) {
+        connection_free(server, connection);
+    }
+}
+
+// NOTE: every response is in memory, the static assets too since bake
+// puts them into the binary, so there is no file to sendfile()/splice
+// from and a plain send covers all of the output
+static
+void connection_submit_send(Server *server, Connection *connection,
+                            const char *data, size_t size, uint8_t flags)
+{
+    struct io_uring_sqe *sqe = uring_sqe(&server->uring);
+    sqe->opcode = IORING_OP_SEND;
+    sqe->flags = flags;
+    sqe->fd = connection->fd;
+    sqe->addr = (uint64_t) (uintptr_t) data;
+    sqe->len = (uint32_t) size;
+    sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+    sqe->user_data = uring_user_data(connection, URING_OP_SEND);
+    connection->pending_ops += 1;
+    connection->sending = 1;
+}
+
+static
+void connection_submit_recv(Server *server, Connection *connection)
+{
+    struct io_uring_sqe *sqe = uring_sqe(&server->uring);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = SERVER_URING_BUFFER_GROUP;
+    sqe->fd = connection->fd;
+    sqe->user_data = uring_user_data(connection, URING_OP_RECV);
+    connection->pending_ops += 1;
+    connection->receiving = 1;
+}
+
+static
+void connection_submit_cancel(Server *server, Connection *connection, Uring_Op op)
+{
+    struct io_uring_sqe *sqe = uring_sqe(&server->uring);
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = uring_user_data(connection, op);
+    sqe->user_data = uring_user_data(connection, URING_OP_CANCEL);
+    connection->pending_ops += 1;
+}
+
+// NOTE: the multishot receive keeps the socket alive even after the
+// descriptor is closed, so it is cancelled first. When the close is
+// linked to the send right before it, it starts once the send is over.
+static
+void connection_submit_close(Server *server, Connection *connection)
+{
+    if (connection->receiving) {
+        connection_submit_cancel(server, connection, URING_OP_RECV);
+    }
+
+    struct io_uring_sqe *sqe = uring_sqe(&server->uring);
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = connection->fd;
+    sqe->user_data = uring_user_data(connection, URING_OP_CLOSE);
+    connection->pending_ops += 1;
+}
+
+static
+void connection_close(Server *server, Connection *connection)
+{
+    if (connection->closing) {
+        return;
+    }
+
+    if (connection->state == CONNECTION_STREAMING) {
+        if (connection->prev) {
+            connection->prev->next = connection->next;
+        } else {
+            server->subscribers = connection->next;
+        }
+        if (connection->next) {
+            connection->next->prev = connection->prev;
+        }
+    }
+
+    server_timer_cancel(server, &connection->timer);
+
+    if (server->backend == SERVER_BACKEND_IO_URING) {
+        connection->closing = 1;
+        connection_submit_close(server, connection);
+        return;
+    }
+
+    if (close(connection->fd) < 0) {
+        log_message(LOG_ERROR, "Could not close client connection: %s", strerror(errno));
+    }
+
+    connection_free(server, connection);
+}
+
+// NOTE: returns 0 when everything was sent, 1 when the socket is full
+// and -1 when the connection is dead
+static
+int connection_flush(Connection *connection)
+{
+    Server *server = connection->server;
+
+    if (server->backend == SERVER_BACKEND_IO_URING) {
+        // NOTE: one send at a time, the next one is queued when the
+        // previous one completes
+        if (connection->sending) {
+            return 1;
+        }
+
+        if (connection->output_sent < connection->output_size) {
+            connection_submit_send(server, connection,
+                                   connection->output + connection->output_sent,
+                                   connection->output_size - connection->output_sent,
+                                   0);
+            return 1;
+        }
+        connection->output_size = 0;
+        connection->output_sent = 0;
+
+        while (connection->message) {
+            Sse_Message *message = connection->message;
+            if (connection->message_sent < message->size) {
+                connection_submit_send(server, connection,
+                                       message->data + connection->message_sent,
+                                       message->size - connection->message_sent,
+                                       0);
+                return 1;
+            }
+
+            sse_message_release(message);
+            connection->message = connection->message_next;
+            connection->message_next = NULL;
+            connection->message_sent = 0;
+        }
+
+        return 0;
+    }
+
+    while (connection->output_sent < connection->output_size) {
+        ssize_t n = write(connection->fd,
+                          connection->output + connection->output_sent,
+                          connection->output_size - connection->output_sent);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 1;
+            return -1;
+        }
+        connection->output_sent += (size_t) n;
+        metrics_bytes_sent((size_t) n);
+    }
+
+    connection->output_size = 0;
+    connection->output_sent = 0;
+
+    while (connection->message) {
+        Sse_Message *message = connection->message;
+        while (connection->message_sent < message->size) {
+            ssize_t n = write(connection->fd,
+                              message->data + connection->message_sent,
+                              message->size - connection->message_sent);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return 1;
+                return -1;
+            }
+            connection->message_sent += (size_t) n;
+            metrics_bytes_sent((size_t) n);
+        }
+
+        sse_message_release(message);
+        connection->message = connection->message_next;
+        connection->message_next = NULL;
+        connection->message_sent = 0;
+    }
+
+    return 0;
+}
+
+// NOTE: sends the response with a single writev(). Whatever the socket
+// did not accept is copied aside and sent when it becomes writable, so
+// the request arena can be reused right away.
+static
+int connection_send_response(Connection *connection, Response *response)
+{
+    Response_Iov head;
+    response_iov(response, &head);
+
+    struct iovec *iov = head.iov;
+    size_t iov_count = head.count;
+
+    while (connection->server->backend == SERVER_BACKEND_EPOLL && iov_count > 0) {
+        ssize_t n = writev(connection->fd, iov, (int) iov_count);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return -1;
+        }
+        metrics_bytes_sent((size_t) n);
+
+        size_t written = (size_t) n;
+        while (iov_count > 0 && written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            iov_count--;
+        }
+
+        if (iov_count > 0) {
+            iov->iov_base = (char *) iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+
+    if (iov_count == 0) {
+        return 0;
+    }
+
+    size_t rest = 0;
+    for (size_t i = 0; i < iov_count; ++i) {
+        rest += iov[i].iov_len;
+    }
+
+    assert(connection->output_size == 0);
+    connection_output_reserve(connection, rest);
+    for (size_t i = 0; i < iov_count; ++i) {
+        memcpy(connection->output + connection->output_size, iov[i].iov_base, iov[i].iov_len);
+        connection->output_size += iov[i].iov_len;
+    }
+
+    return 0;
+}
+
+// NOTE: the request is answered with an error without being parsed to the end
+static
+void connection_reject(Connection *connection, int code, const char *message)
+{
+    connection->parser.state = HTTP_PARSER_ERROR;
+    connection->parser.error_code = code;
+    connection->parser.error_message = message;
+}
+
+static
+void connection_handle(Server *server, Connection *connection, Http_Parse_Status status)
+{
+    Response response;
+    response_init(&response, server->memory);
+    response.head_only = status == HTTP_PARSE_DONE
+        && connection->parser.request.method == HTTP_METHOD_HEAD;
+
+    // TODO(#57): running out of request memory should not crash the application
+    server->handler(server, connection, &connection->parser, &response);
+
+    connection->keep_alive = status == HTTP_PARSE_DONE
+        && connection->parser.request.keep_alive
+        && connection->state != CONNECTION_STREAMING;
+    response.keep_alive = connection->keep_alive;
+
+    int err = connection_send_response(connection, &response);
+    metrics_arena(METRICS_ARENA_REQUEST, server->memory->size);
+    memory_clean(server->memory);
+
+    if (err < 0) {
+        connection->keep_alive = 0;
+    }
+}
+
+static void connection_process(Server *server, Connection *connection);
+
+// NOTE: the response is completely sent, the connection is either
+// closed or ready for the next request
+static
+void connection_finish_response(Server *server, Connection *connection)
+{
+    if (!connection->keep_alive) {
+        connection_close(server, connection);
+        return;
+    }
+
+    // NOTE: the bytes past the cursor are the beginning of the next
+    // pipelined request
+    const size_t cursor = connection->parser.cursor;
+    assert(cursor <= connection->input_size);
+    connection->input_size -= cursor;
+    if (connection->input_size > 0) {
+        memmove(connection->input, connection->input + cursor, connection->input_size);
+    } else {
+        server_input_release(server, connection->input);
+        connection->input = NULL;
+    }
+
+    http_parser_init(&connection->parser);
+    connection->state = CONNECTION_READING;
+    connection_watch(server, connection, EPOLLIN);
+
+    if (connection->input_size > 0) {
+        server_timer_set(server, &connection->timer, SERVER_REQUEST_TIMEOUT_MS);
+        connection_process(server, connection);
+    } else {
+        server_timer_set(server, &connection->timer, SERVER_KEEP_ALIVE_TIMEOUT_MS);
+    }
+}
+
+static
+void connection_process(Server *server, Connection *connection)
+{
+    assert(connection->state == CONNECTION_READING);
+
+    Http_Parse_Status status = http_parser_feed(&connection->parser,
+                                                connection->input,
+                                                connection->input_size);
+    if (status == HTTP_PARSE_INCOMPLETE) {
+        if (connection->input_size < CONNECTION_INPUT_CAPACITY) {
+            return;
+        }
+
+        connection_reject(connection, 413, "Request is too large");
+        status = HTTP_PARSE_ERROR;
+    }
+
+    connection_handle(server, connection, status);
+
+    // NOTE: the last response of the connection and the close are
+    // submitted together, the close starts as soon as the send is over
+    if (server->backend == SERVER_BACKEND_IO_URING
+        && connection->state != CONNECTION_STREAMING
+        && !connection->keep_alive) {
+        connection->closing = 1;
+        connection_submit_send(server, connection,
+                               connection->output, connection->output_size,
+                               IOSQE_IO_LINK);
+        connection_submit_close(server, connection);
+        server_timer_set(server, &connection->timer, SERVER_WRITE_TIMEOUT_MS);
+        return;
+    }
+
+    int flushed = connection_flush(connection);
+    if (flushed < 0) {
+        connection_close(server, connection);
+        return;
+    }
+
+    if (connection->state == CONNECTION_STREAMING) {
+        // NOTE: the stream never reads requests anymore
+        server_input_release(server, connection->input);
+        connection->input = NULL;
+        connection->input_size = 0;
+        if (flushed > 0) {
+            connection_watch(server, connection, EPOLLIN | EPOLLOUT);
+            server_timer_set(server, &connection->timer, SERVER_WRITE_TIMEOUT_MS);
+        } else {
+            server_timer_cancel(server, &connection->timer);
+        }
+        return;
+    }
+
+    if (flushed > 0) {
+        connection->state = CONNECTION_WRITING;
+        connection_watch(server, connection, EPOLLOUT);
+        server_timer_set(server, &connection->timer, SERVER_WRITE_TIMEOUT_MS);
+        return;
+    }
+
+    connection_finish_response(server, connection);
+}
+
+static
+void connection_on_readable(Server *server, Connection *connection)
+{
+    if (connection->state == CONNECTION_STREAMING) {
+        // NOTE: the client is not supposed to send anything. Reading is
+        // only needed to notice that it went away.
+        char trash[256];
+        ssize_t n = read(connection->fd, trash, sizeof(trash));
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            connection_close(server, connection);
+        }
+        return;
+    }
+
+    assert(connection->state == CONNECTION_READING);
+
+    if (connection->input == NULL) {
+        connection->input = server_input_acquire(server);
+        connection->input_size = 0;
+    }
+    const int starts_request = connection->input_size == 0;
+
+    ssize_t n = read(connection->fd,
+                     connection->input + connection->input_size,
+                     CONNECTION_INPUT_CAPACITY - connection->input_size);
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return;
+        connection_close(server, connection);
+        return;
+    }
+
+    if (n == 0) {
+        connection_close(server, connection);
+        return;
+    }
+
+    if (starts_request) {
+        server_timer_set(server, &connection->timer, SERVER_REQUEST_TIMEOUT_MS);
+    }
+
+    connection->input_size += (size_t) n;
+    connection_process(server, connection);
+}
+
+static
+void connection_on_writable(Server *server, Connection *connection)
+{
+    int flushed = connection_flush(connection);
+    if (flushed < 0) {
+        connection_close(server, connection);
+        return;
+    }
+
+    if (flushed > 0) {
+        server_timer_set(server, &connection->timer, SERVER_WRITE_TIMEOUT_MS);
+        return;
+    }
+
+    if (connection->state == CONNECTION_STREAMING) {
+        connection_watch(server, connection, EPOLLIN);
+        server_timer_cancel(server, &connection->timer);
+    } else {
+        assert(connection->state == CONNECTION_WRITING);
+        connection_finish_response(server, connection);
+    }
+}
+
+static
+void connection_on_timeout(Timer *timer, void *data)
+{
+    (void) timer;
+    Connection *connection = data;
+    Server *server = connection->server;
+
+    // NOTE: the client does not take the last response. Cancelling the
+    // send cancels the close linked to it, which is then retried alone.
+    if (connection->closing) {
+        connection_submit_cancel(server, connection, URING_OP_SEND);
+        return;
+    }
+
+    // NOTE: a client that started a request and did not finish it in
+    // time gets 408. Everyone else is just disconnected.
+    if (connection->state == CONNECTION_READING && connection->input_size > 0) {
+        connection_reject(connection, 408, "Request timeout");
+        connection_handle(server, connection, HTTP_PARSE_ERROR);
+        connection_flush(connection);
+    }
+
+    connection_close(server, connection);
+}
+
+// NOTE: sends the queued messages of a stream unless it already waits
+// for EPOLLOUT. The dead connections are not closed right here, because
+// this may happen in the middle of a batch of events that still refers
+// to them. The error shows up again on EPOLLOUT.
+static
+void connection_deliver(Server *server, Connection *connection)
+{
+    if (connection->events & EPOLLOUT) {
+        return;
+    }
+
+    if (connection_flush(connection) != 0) {
+        connection_watch(server, connection, EPOLLIN | EPOLLOUT);
+        server_timer_set(server, &connection->timer, SERVER_WRITE_TIMEOUT_MS);
+    }
+}
+
+static
+void server_on_heartbeat(Timer *timer, void *data)
+{
+    Server *server = data;
+
+    for (Connection *connection = server->subscribers; connection != NULL; connection = connection->next) {
+        // NOTE: the output buffer is kept around for the next response,
+        // so an idle subscriber is the one with nothing in it, not the
+        // one without it
+        if (connection->message == NULL && connection->output_size == 0) {
+            connection->message = sse_message_acquire(server->heartbeat_message);
+            connection->message_sent = 0;
+            connection_deliver(server, connection);
+        }
+    }
+
+    server_timer_set(server, timer, SERVER_HEARTBEAT_INTERVAL_MS);
+}
+
+static
+void server_add_connection(Server *server, int fd)
+{
+    Connection *connection = calloc(1, sizeof(Connection));
+    assert(connection);
+    connection->server = server;
+    connection->fd = fd;
+    connection->state = CONNECTION_READING;
+    connection->events = EPOLLIN;
+    connection->timer.callback = connection_on_timeout;
+    connection->timer.data = connection;
+    http_parser_init(&connection->parser);
+
+    if (server->backend == SERVER_BACKEND_IO_URING) {
+        connection_submit_recv(server, connection);
+    } else {
+        struct epoll_event event = {
+            .events = connection->events,
+            .data.ptr = connection,
+        };
+        if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            log_message(LOG_ERROR, "Could not watch the connection: %s", strerror(errno));
+            close(fd);
+            free(connection);
+            return;
+        }
+    }
+
+    server->connections_count += 1;
+    metrics_connection_opened();
+    server_timer_set(server, &connection->timer, SERVER_KEEP_ALIVE_TIMEOUT_MS);
+}
+
+static
+void server_accept(Server *server)
+{
+    for (;;) {
+        int fd = accept4(server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                log_message(LOG_ERROR, "Could not accept connection. This is unacceptable! %s", strerror(errno));
+            }
+            return;
+        }
+
+        server_add_connection(server, fd);
+    }
+}
+
+static
+void server_read_signals(Server *server)
+{
+    struct signalfd_siginfo info;
+    while (read(server->signal_fd, &info, sizeof(info)) == sizeof(info)) {
+        if (info.ssi_signo == SIGHUP && server->reload) {
+            server->reload(server);
+        }
+    }
+}
+
+static
+void server_submit_accept(Server *server)
+{
+    struct io_uring_sqe *sqe = uring_sqe(&server->uring);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->fd = server->listen_fd;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = uring_user_data(server, URING_OP_ACCEPT);
+}
+
+static
+void server_submit_signal_poll(Server *server)
+{
+    struct io_uring_sqe *sqe = uring_sqe(&server->uring);
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = server->signal_fd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = uring_user_data(server, URING_OP_SIGNAL);
+}
+
+static
+void connection_on_received(Server *server, Connection *connection, const char *data, size_t size)
+{
+    // NOTE: the client is not supposed to send anything to the stream
+    if (connection->closing || connection->state == CONNECTION_STREAMING) {
+        return;
+    }
+
+    if (connection->input == NULL) {
+        connection->input = server_input_acquire(server);
+        connection->input_size = 0;
+    }
+
+    // NOTE: the input is only ever full when the client pipelines way
+    // more than the largest request
+    if (size > CONNECTION_INPUT_CAPACITY - connection->input_size) {
+        connection_close(server, connection);
+        return;
+    }
+
+    const int starts_request = connection->input_size == 0;
+    memcpy(connection->input + connection->input_size, data, size);
+    connection->input_size += size;
+
+    if (starts_request) {
+        server_timer_set(server, &connection->timer, SERVER_REQUEST_TIMEOUT_MS);
+    }
+
+    // NOTE: the bytes that arrive while the previous response is being
+    // sent are picked up when it is over
+    if (connection->state == CONNECTION_READING) {
+        connection_process(server, connection);
+    }
+}
+
+static
+void server_on_completion(Server *server, const struct io_uring_cqe *cqe)
+{
+    const Uring_Op op = (Uring_Op) (cqe->user_data & URING_OP_MASK);
+    void *ptr = (void *) (uintptr_t) (cqe->user_data & ~(uint64_t) URING_OP_MASK);
+    const int more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+
+    switch (op) {
+    case URING_OP_ACCEPT: {
+        if (cqe->res >= 0) {
+            server_add_connection(server, cqe->res);
+        } else {
+            log_message(LOG_ERROR, "Could not accept connection. This is unacceptable! %s", strerror(-cqe->res));
+        }
+        if (!more) {
+            server_submit_accept(server);
+        }
+    } break;
+
+    case URING_OP_SIGNAL: {
+        server_read_signals(server);
+        server_submit_signal_poll(server);
+    } break;
+
+    case URING_OP_RECV: {
+        Connection *connection = ptr;
+        if (!more) {
+            connection->receiving = 0;
+        }
+
+        if (cqe->flags & IORING_CQE_F_BUFFER) {
+            const unsigned id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            if (cqe->res > 0) {
+                connection_on_received(server, connection, uring_buffer(&server->uring, id), (size_t) cqe->res);
+            }
+            uring_buffer_recycle(&server->uring, id);
+        }
+
+        if (!more && !connection->closing) {
+            // NOTE: running out of the provided buffers only stops the
+            // multishot receive, the connection itself is fine
+            if (cqe->res == 0 || (cqe->res < 0 && cqe->res != -ENOBUFS)) {
+                connection_close(server, connection);
+            } else {
+                connection_submit_recv(server, connection);
+            }
+        }
+
+        if (!more) {
+            connection_op_done(server, connection);
+        }
+    } break;
+
+    case URING_OP_SEND: {
+        Connection *connection = ptr;
+        connection->sending = 0;
+        if (cqe->res > 0) {
+            metrics_bytes_sent((size_t) cqe->res);
+        }
+
+        if (!connection->closing) {
+            if (cqe->res < 0) {
+                connection_close(server, connection);
+            } else {
+                size_t sent = (size_t) cqe->res;
+                if (connection->output_sent < connection->output_size) {
+                    connection->output_sent += sent;
+                } else {
+                    assert(connection->message);
+                    connection->message_sent += sent;
+                }
+                connection_on_writable(server, connection);
+            }
+        }
+
+        connection_op_done(server, connection);
+    } break;
+
+    case URING_OP_CLOSE: {
+        Connection *connection = ptr;
+        // NOTE: the send the close was linked to failed
+        if (cqe->res == -ECANCELED) {
+            struct io_uring_sqe *sqe = uring_sqe(&server->uring);
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->fd = connection->fd;
+            sqe->user_data = uring_user_data(connection, URING_OP_CLOSE);
+            connection->pending_ops += 1;
+        }
+        connection_op_done(server, connection);
+    } break;
+
+    case URING_OP_CANCEL: {
+        connection_op_done(server, ptr);
+    } break;
+
+    default:
+        assert(0 && "unreachable");
+    }
+}
+
+// NOTE: sets up everything io_uring needs. On failure the caller falls
+// back to epoll.
+static
+int server_init_uring(Server *server)
+{
+    if (uring_init(&server->uring, SERVER_URING_ENTRIES) < 0) {
+        return -1;
+    }
+
+    if (uring_buffers_init(&server->uring,
+                           SERVER_URING_BUFFER_GROUP,
+                           SERVER_URING_BUFFERS_COUNT,
+                           SERVER_URING_BUFFER_SIZE) < 0) {
+        uring_destroy(&server->uring);
+        return -1;
+    }
+
+    server_submit_accept(server);
+    server_submit_signal_poll(server);
+
+    return 0;
+}
+
+static
+void server_run_uring(Server *server)
+{
+    for (;;) {
+        const uint64_t now = server_now();
+        timer_wheel_advance(&server->timers, now);
+
+        int timeout = -1;
+        const uint64_t next = timer_wheel_next(&server->timers);
+        if (next != UINT64_MAX) {
+            timeout = next - now < INT_MAX ? (int) (next - now) : INT_MAX;
+        }
+
+        if (uring_submit_and_wait(&server->uring, timeout) < 0) {
+            log_message(LOG_ERROR, "Could not wait for completions: %s", strerror(errno));
+            exit(1);
+        }
+
+        http_date_update(time(NULL));
+
+        struct io_uring_cqe *cqe;
+        while ((cqe = uring_cqe_peek(&server->uring)) != NULL) {
+            const struct io_uring_cqe completion = *cqe;
+            uring_cqe_seen(&server->uring);
+            server_on_completion(server, &completion);
+        }
+    }
+}
+
+int server_init(Server *server, int listen_fd)
+{
+    assert(server);
+    assert(server->memory);
+    assert(server->handler);
+
+    server->listen_fd = listen_fd;
+    int flags = fcntl(listen_fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(listen_fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        return -1;
+    }
+
+    server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (server->epoll_fd < 0) {
+        return -1;
+    }
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGHUP);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0) {
+        return -1;
+    }
+
+    server->signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (server->signal_fd < 0) {
+        return -1;
+    }
+
+    // NOTE: the listening socket and the signals are told apart from
+    // the connections by the address of their descriptor in the Server
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = &server->listen_fd };
+    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->listen_fd, &event) < 0) {
+        return -1;
+    }
+
+    event = (struct epoll_event) { .events = EPOLLIN, .data.ptr = &server->signal_fd };
+    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->signal_fd, &event) < 0) {
+        return -1;
+    }
+
+    if (server->backend == SERVER_BACKEND_IO_URING && server_init_uring(server) < 0) {
+        log_message(LOG_WARN, "Could not set up io_uring: %s. Falling back to epoll.", strerror(errno));
+        server->backend = SERVER_BACKEND_EPOLL;
+    }
+
+    server->free_inputs = calloc(SERVER_FREE_INPUTS_CAPACITY, sizeof(server->free_inputs[0]));
+    assert(server->free_inputs);
+
+    timer_wheel_init(&server->timers, server_now());
+
+    const String heartbeat = SLT(":\n\n");
+    server->heartbeat_message = sse_message_of_parts(&heartbeat, 1);
+    server->heartbeat.callback = server_on_heartbeat;
+    server->heartbeat.data = server;
+    server_timer_set(server, &server->heartbeat, SERVER_HEARTBEAT_INTERVAL_MS);
+
+    return 0;
+}
+
+void server_run(Server *server)
+{
+    assert(server);
+
+    if (server->backend == SERVER_BACKEND_IO_URING) {
+        server_run_uring(server);
+        return;
+    }
+
+    struct epoll_event events[SERVER_EVENTS_CAPACITY];
+
+    for (;;) {
+        const uint64_t now = server_now();
+        timer_wheel_advance(&server->timers, now);
+
+        int timeout = -1;
+        const uint64_t next = timer_wheel_next(&server->timers);
+        if (next != UINT64_MAX) {
+            timeout = next - now < INT_MAX ? (int) (next - now) : INT_MAX;
+        }
+
+        int n = epoll_wait(server->epoll_fd, events, SERVER_EVENTS_CAPACITY, timeout);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            log_message(LOG_ERROR, "Could not wait for events: %s", strerror(errno));
+            exit(1);
+        }
+
+        http_date_update(time(NULL));
+
+        for (int i = 0; i < n; ++i) {
+            void *ptr = events[i].data.ptr;
+            if (ptr == &server->listen_fd) {
+                server_accept(server);
+            } else if (ptr == &server->signal_fd) {
+                server_read_signals(server);
+            } else {
+                Connection *connection = ptr;
+                if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    connection_close(server, connection);
+                } else if (events[i].events & EPOLLOUT) {
+                    connection_on_writable(server, connection);
+                } else if (events[i].events & EPOLLIN) {
+                    connection_on_readable(server, connection);
+                }
+            }
+        }
+    }
+}
+
+void server_subscribe(Server *server, Connection *connection)
+{
+    assert(server);
+    assert(connection);
+    assert(connection->state == CONNECTION_READING);
+
+    connection->state = CONNECTION_STREAMING;
+    connection->prev = NULL;
+    connection->next = server->subscribers;
+    if (server->subscribers) {
+        server->subscribers->prev = connection;
+    }
+    server->subscribers = connection;
+
+    // NOTE: goes right after the head of the response
+    connection->message = sse_message_acquire(server->message);
+    connection->message_sent = 0;
+}
+
+void server_broadcast(Server *server, String event, String data)
+{
+    assert(server);
+
+    const String parts[] = { SLT("event: "), event, SLT("\ndata: "), data, SLT("\n\n") };
+    Sse_Message *message = sse_message_of_parts(parts, sizeof(parts) / sizeof(parts[0]));
+
+    sse_message_release(server->message);
+    server->message = message;
+
+    for (Connection *connection = server->subscribers; connection != NULL; connection = connection->next) {
+        if (connection->message == NULL) {
+            connection->message = sse_message_acquire(message);
+            connection->message_sent = 0;
+        } else {
+            sse_message_release(connection->message_next);
+            connection->message_next = sse_message_acquire(message);
+        }
+
+        connection_deliver(server, connection);
+    }
+}
@@ -0,0 +1,102 @@
+#ifndef SERVER_H_
+#define SERVER_H_
+
+#include <time.h>
+
+#include "s.h"
+#include "memory.h"
+#include "request.h"
+#include "response.h"
+#include "timer.h"
+#include "uring.h"
+
+// NOTE: A single threaded event loop on top of epoll or io_uring. Every
+// connection is a small state machine: it reads and parses requests,
+// handles them synchronously once they are complete, and sends the
+// responses without ever blocking. Connections are kept alive between
+// requests unless the client asks otherwise, and pipelined requests
+// are handled one after another. Both backends drive the very same
+// state machine, they only differ in how the bytes get in and out.
+
+typedef enum {
+    SERVER_BACKEND_EPOLL = 0,
+    // NOTE: multishot accept, multishot receives into the provided
+    // buffers, and the sends and closes are queued and submitted in
+    // batches, so a request costs a fraction of a syscall
+    SERVER_BACKEND_IO_URING,
+} Server_Backend;
+
+typedef struct Server Server;
+typedef struct Connection Connection;
+
+// NOTE: handles a request that was completely parsed or failed to
+// parse (see parser->state). The response is sent right after the
+// handler returns.
+typedef void (*Server_Handler)(Server *server, Connection *connection,
+                               const Http_Parser *parser, Response *response);
+
+// NOTE: called when the process receives SIGHUP
+typedef void (*Server_Reload)(Server *server);
+
+// NOTE: A message of the Server-Sent Events stream. It is encoded once
+// and shared by all of the subscribers, so the fan out to thousands of
+// connections does not serialize anything per connection.
+typedef struct {
+    size_t refcount;
+    size_t size;
+    char data[];
+} Sse_Message;
+
+struct Server {
+    // NOTE: falls back to epoll if io_uring is not available
+    Server_Backend backend;
+    int listen_fd;
+    int epoll_fd;
+    int signal_fd;
+    Uring uring;
+
+    // NOTE: every request is handled inside of this arena. It is
+    // cleaned as soon as the response is handed over to the socket.
+    Memory *memory;
+
+    void *data;
+    Server_Handler handler;
+    Server_Reload reload;
+
+    // NOTE: connection timeouts, periodic tasks and whatever the
+    // handlers want to happen later. Ticks are milliseconds of
+    // server_now().
+    Timer_Wheel timers;
+    Timer heartbeat;
+
+    size_t connections_count;
+    Connection *subscribers;
+    // NOTE: the latest broadcasted message. New subscribers get it
+    // right away.
+    Sse_Message *message;
+    Sse_Message *heartbeat_message;
+
+    char **free_inputs;
+    size_t free_inputs_count;
+};
+
+// NOTE: listen_fd must be already bound and listening
+int server_init(Server *server, int listen_fd);
+void server_run(Server *server);
+
+// NOTE: milliseconds of the monotonic clock
+uint64_t server_now(void);
+
+// NOTE: the timer must stay alive until it fires or is cancelled
+void server_timer_set(Server *server, Timer *timer, uint64_t delay_ms);
+void server_timer_cancel(Server *server, Timer *timer);
+
+// NOTE: turns the connection into a Server-Sent Events stream. Meant
+// to be called from the handler that responds with response->streaming.
+void server_subscribe(Server *server, Connection *connection);
+
+// NOTE: sends `event: <event>\ndata: <data>\n\n` to all the
+// subscribers. data must not contain newlines.
+void server_broadcast(Server *server, String event, String data);
+
+#endif  // SERVER_H_
@@ -0,0 +1,20 @@
+#ifndef TEST_H_
+#define TEST_H_
+
+#include <stdio.h>
+
+// NOTE: The harness of the *_test.c programs. EXPECT() reports a failed
+// check and keeps going, main() returns 1 when there were failures.
+static int failures = 0;
+
+#define EXPECT(condition)                                               \
+    do {                                                                \
+        if (!(condition)) {                                             \
+            fprintf(stderr, "%s:%d: FAILED: %s\n", __FILE__, __LINE__, #condition); \
+            failures += 1;                                              \
+        }                                                               \
+    } while (0)
+
+#define ARRAY_SIZE(xs) (sizeof(xs) / sizeof((xs)[0]))
+
+#endif  // TEST_H_
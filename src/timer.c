@@ -0,0 +1,197 @@
+#include <assert.h>
+#include <string.h>
+
+#include "timer.h"
+
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+
+// NOTE: the amount of ticks a single slot of the level covers
+static inline
+uint64_t timer_wheel_span(size_t level)
+{
+    return (uint64_t) 1 << (TIMER_WHEEL_BITS * level);
+}
+
+// NOTE: the first moment after the current one when the slot of the
+// level changes
+static inline
+uint64_t timer_wheel_boundary(const Timer_Wheel *wheel, size_t level)
+{
+    const size_t shift = TIMER_WHEEL_BITS * level;
+    return ((wheel->now >> shift) + 1) << shift;
+}
+
+void timer_wheel_init(Timer_Wheel *wheel, uint64_t now)
+{
+    assert(wheel);
+    memset(wheel, 0, sizeof(*wheel));
+    wheel->now = now;
+}
+
+static
+void timer_wheel_link(Timer_Wheel *wheel, Timer *timer, uint64_t expires)
+{
+    assert(expires >= wheel->now);
+
+    uint64_t delta = expires - wheel->now;
+
+    // NOTE: the timers beyond the reach of the top level are parked in
+    // its furthest slot. They are put back into the right place when
+    // they cascade.
+    const uint64_t reach = timer_wheel_span(TIMER_WHEEL_LEVELS) - 1;
+    if (delta > reach) {
+        delta = reach;
+        expires = wheel->now + reach;
+    }
+
+    size_t level = 0;
+    while (level + 1 < TIMER_WHEEL_LEVELS && delta >= timer_wheel_span(level + 1)) {
+        level += 1;
+    }
+
+    const size_t slot = (expires >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+    Timer **head = &wheel->slots[level][slot];
+
+    timer->next = *head;
+    if (*head) {
+        (*head)->pprev = &timer->next;
+    }
+    timer->pprev = head;
+    *head = timer;
+
+    timer->level = level;
+    wheel->counts[level] += 1;
+}
+
+static
+void timer_wheel_unlink(Timer_Wheel *wheel, Timer *timer)
+{
+    assert(timer_pending(timer));
+
+    *timer->pprev = timer->next;
+    if (timer->next) {
+        timer->next->pprev = timer->pprev;
+    }
+    timer->next = NULL;
+    timer->pprev = NULL;
+
+    assert(wheel->counts[timer->level] > 0);
+    wheel->counts[timer->level] -= 1;
+}
+
+void timer_wheel_add(Timer_Wheel *wheel, Timer *timer, uint64_t expires)
+{
+    assert(wheel);
+    assert(timer);
+    assert(timer->callback);
+
+    if (timer_pending(timer)) {
+        timer_wheel_unlink(wheel, timer);
+    }
+
+    timer->expires = expires;
+
+    // NOTE: the slot of the current tick was already processed
+    timer_wheel_link(wheel, timer, expires > wheel->now ? expires : wheel->now + 1);
+}
+
+void timer_wheel_cancel(Timer_Wheel *wheel, Timer *timer)
+{
+    assert(wheel);
+    assert(timer);
+
+    if (timer_pending(timer)) {
+        timer_wheel_unlink(wheel, timer);
+    }
+}
+
+static
+void timer_wheel_tick(Timer_Wheel *wheel)
+{
+    wheel->now += 1;
+
+    // NOTE: the higher levels cascade first, because their timers may
+    // land into the slots of the lower levels that cascade right now
+    size_t top = 0;
+    while (top + 1 < TIMER_WHEEL_LEVELS
+           && (wheel->now & (timer_wheel_span(top + 1) - 1)) == 0) {
+        top += 1;
+    }
+
+    for (size_t level = top; level > 0; --level) {
+        const size_t slot = (wheel->now >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+        Timer *timer = wheel->slots[level][slot];
+        while (timer) {
+            Timer *next = timer->next;
+            timer_wheel_unlink(wheel, timer);
+            timer_wheel_link(wheel, timer, timer->expires > wheel->now ? timer->expires : wheel->now);
+            timer = next;
+        }
+    }
+
+    Timer **head = &wheel->slots[0][wheel->now & TIMER_WHEEL_MASK];
+    while (*head) {
+        Timer *timer = *head;
+        timer_wheel_unlink(wheel, timer);
+        timer->callback(timer, timer->data);
+    }
+}
+
+void timer_wheel_advance(Timer_Wheel *wheel, uint64_t now)
+{
+    assert(wheel);
+
+    while (wheel->now < now) {
+        size_t level = 0;
+        while (level < TIMER_WHEEL_LEVELS && wheel->counts[level] == 0) {
+            level += 1;
+        }
+
+        if (level == TIMER_WHEEL_LEVELS) {
+            wheel->now = now;
+            return;
+        }
+
+        // NOTE: when the lowest levels are empty nothing happens until
+        // the next cascade of the first non empty one, so the ticks in
+        // between are skipped all at once
+        if (level > 0) {
+            const uint64_t boundary = timer_wheel_boundary(wheel, level);
+            if (boundary > now) {
+                wheel->now = now;
+                return;
+            }
+            wheel->now = boundary - 1;
+        }
+
+        timer_wheel_tick(wheel);
+    }
+}
+
+uint64_t timer_wheel_next(const Timer_Wheel *wheel)
+{
+    assert(wheel);
+
+    uint64_t result = UINT64_MAX;
+
+    if (wheel->counts[0] > 0) {
+        for (uint64_t i = 1; i <= TIMER_WHEEL_SLOTS; ++i) {
+            if (wheel->slots[0][(wheel->now + i) & TIMER_WHEEL_MASK]) {
+                result = wheel->now + i;
+                break;
+            }
+        }
+    }
+
+    for (size_t level = 1; level < TIMER_WHEEL_LEVELS; ++level) {
+        if (wheel->counts[level] > 0) {
+            const uint64_t boundary = timer_wheel_boundary(wheel, level);
+            if (boundary < result) {
+                result = boundary;
+            }
+            break;
+        }
+    }
+
+    return result;
+}
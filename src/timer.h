@@ -0,0 +1,64 @@
+#ifndef TIMER_H_
+#define TIMER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// NOTE: Hierarchical timing wheel with millisecond ticks. Every level
+// has 64 slots and every slot of a level covers a whole rotation of
+// the level below it: 64ms, ~4s, ~4.4min, ~4.6h, ~12.4days. A timer is
+// put into the slot of the lowest level that can reach its expiration
+// and moves down ("cascades") when the wheel gets to that slot. Adding
+// and cancelling a timer are O(1): timers are intrusive doubly linked
+// lists and nothing is ever sorted.
+
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 5
+
+typedef struct Timer Timer;
+typedef void (*Timer_Callback)(Timer *timer, void *data);
+
+struct Timer {
+    Timer *next;
+    // NOTE: the pointer that points to this timer. NULL when the timer
+    // is not in the wheel.
+    Timer **pprev;
+    uint64_t expires;
+    size_t level;
+
+    Timer_Callback callback;
+    void *data;
+};
+
+typedef struct {
+    uint64_t now;
+    size_t counts[TIMER_WHEEL_LEVELS];
+    Timer *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+} Timer_Wheel;
+
+static inline
+int timer_pending(const Timer *timer)
+{
+    return timer->pprev != NULL;
+}
+
+void timer_wheel_init(Timer_Wheel *wheel, uint64_t now);
+
+// NOTE: (re)schedules the timer. The timers that are already due fire
+// on the next advance.
+void timer_wheel_add(Timer_Wheel *wheel, Timer *timer, uint64_t expires);
+void timer_wheel_cancel(Timer_Wheel *wheel, Timer *timer);
+
+// NOTE: fires all the timers that expire up to now inclusively. The
+// timer is removed from the wheel before its callback is called, so
+// the callback may add it back or free it.
+void timer_wheel_advance(Timer_Wheel *wheel, uint64_t now);
+
+// NOTE: the earliest time advance may have something to do. It is
+// never later than the earliest expiration, but may be earlier when
+// the earliest timer has to cascade first. UINT64_MAX when the wheel
+// is empty.
+uint64_t timer_wheel_next(const Timer_Wheel *wheel);
+
+#endif  // TIMER_H_
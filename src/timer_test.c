@@ -0,0 +1,267 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "timer.h"
+#include "test.h"
+
+typedef struct {
+    Timer timer;
+    Timer_Wheel *wheel;
+    uint64_t fired_at;
+    size_t fired_count;
+    // NOTE: the callback adds the timer back that many times
+    size_t rearm_count;
+    uint64_t rearm_delay;
+} Probe;
+
+static
+void probe_fire(Timer *timer, void *data)
+{
+    Probe *probe = data;
+    assert(&probe->timer == timer);
+    assert(!timer_pending(timer));
+
+    probe->fired_at = probe->wheel->now;
+    probe->fired_count += 1;
+
+    if (probe->rearm_count > 0) {
+        probe->rearm_count -= 1;
+        timer_wheel_add(probe->wheel, timer, probe->wheel->now + probe->rearm_delay);
+    }
+}
+
+static
+void probe_init(Probe *probe, Timer_Wheel *wheel)
+{
+    *probe = (Probe) {
+        .timer = {
+            .callback = probe_fire,
+        },
+        .wheel = wheel,
+    };
+    probe->timer.data = probe;
+}
+
+static
+int wheel_is_empty(const Timer_Wheel *wheel)
+{
+    for (size_t level = 0; level < TIMER_WHEEL_LEVELS; ++level) {
+        if (wheel->counts[level] != 0) {
+            return 0;
+        }
+    }
+    return timer_wheel_next(wheel) == UINT64_MAX;
+}
+
+// NOTE: advances the way the server does: sleeps until
+// timer_wheel_next() and then advances to it
+static
+void advance_by_next(Timer_Wheel *wheel, uint64_t now)
+{
+    for (;;) {
+        const uint64_t next = timer_wheel_next(wheel);
+        EXPECT(next > wheel->now);
+        if (next > now) {
+            break;
+        }
+        timer_wheel_advance(wheel, next);
+    }
+    timer_wheel_advance(wheel, now);
+}
+
+static
+void test_level_boundaries(void)
+{
+    const uint64_t reach = ((uint64_t) 1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1;
+    const uint64_t delays[] = {
+        1, 2, 62, 63, 64, 65, 127, 128,
+        4095, 4096, 4097,
+        262143, 262144, 262145,
+        16777215, 16777216, 16777217,
+        reach - 1, reach, reach + 1, reach * 3 + 7,
+    };
+    const uint64_t starts[] = {0, 1, 63, 64, 4095, 4096, 1000003, 1700000000000};
+
+    for (size_t i = 0; i < ARRAY_SIZE(starts); ++i) {
+        for (size_t j = 0; j < ARRAY_SIZE(delays); ++j) {
+            const uint64_t expires = starts[i] + delays[j];
+
+            Timer_Wheel wheel;
+            Probe probe;
+
+            timer_wheel_init(&wheel, starts[i]);
+            probe_init(&probe, &wheel);
+            timer_wheel_add(&wheel, &probe.timer, expires);
+            EXPECT(timer_wheel_next(&wheel) <= expires);
+
+            timer_wheel_advance(&wheel, expires - 1);
+            EXPECT(probe.fired_count == 0);
+            EXPECT(timer_pending(&probe.timer));
+            timer_wheel_advance(&wheel, expires);
+            EXPECT(probe.fired_count == 1);
+            EXPECT(probe.fired_at == expires);
+            EXPECT(wheel_is_empty(&wheel));
+
+            timer_wheel_init(&wheel, starts[i]);
+            probe_init(&probe, &wheel);
+            timer_wheel_add(&wheel, &probe.timer, expires);
+
+            advance_by_next(&wheel, expires - 1);
+            EXPECT(probe.fired_count == 0);
+            advance_by_next(&wheel, expires + 1);
+            EXPECT(probe.fired_count == 1);
+            EXPECT(probe.fired_at == expires);
+            EXPECT(wheel_is_empty(&wheel));
+        }
+    }
+
+    // NOTE: the timers that are already due fire on the next tick
+    Timer_Wheel wheel;
+    Probe probe;
+    timer_wheel_init(&wheel, 100);
+    probe_init(&probe, &wheel);
+    timer_wheel_add(&wheel, &probe.timer, 50);
+    EXPECT(timer_wheel_next(&wheel) == 101);
+    timer_wheel_advance(&wheel, 101);
+    EXPECT(probe.fired_count == 1);
+    EXPECT(probe.fired_at == 101);
+}
+
+static
+void test_cancel_after_cascade(void)
+{
+    const uint64_t delays[] = {64, 100, 4096, 5000, 262144, 300000, 16777216};
+
+    for (size_t i = 0; i < ARRAY_SIZE(delays); ++i) {
+        Timer_Wheel wheel;
+        Probe probe;
+
+        timer_wheel_init(&wheel, 10);
+        probe_init(&probe, &wheel);
+        timer_wheel_add(&wheel, &probe.timer, 10 + delays[i]);
+
+        const size_t level = probe.timer.level;
+        EXPECT(level > 0);
+
+        timer_wheel_advance(&wheel, 10 + delays[i] - 1);
+        EXPECT(timer_pending(&probe.timer));
+        EXPECT(probe.timer.level < level);
+
+        timer_wheel_cancel(&wheel, &probe.timer);
+        EXPECT(!timer_pending(&probe.timer));
+        EXPECT(wheel_is_empty(&wheel));
+
+        // NOTE: cancelling twice is fine
+        timer_wheel_cancel(&wheel, &probe.timer);
+
+        timer_wheel_advance(&wheel, 10 + delays[i] * 2);
+        EXPECT(probe.fired_count == 0);
+    }
+
+    // NOTE: rescheduling a timer that has cascaded moves it, not copies it
+    Timer_Wheel wheel;
+    Probe probe;
+    timer_wheel_init(&wheel, 0);
+    probe_init(&probe, &wheel);
+    timer_wheel_add(&wheel, &probe.timer, 5000);
+    timer_wheel_advance(&wheel, 4990);
+    timer_wheel_add(&wheel, &probe.timer, 9000);
+    timer_wheel_advance(&wheel, 8999);
+    EXPECT(probe.fired_count == 0);
+    timer_wheel_advance(&wheel, 20000);
+    EXPECT(probe.fired_count == 1);
+    EXPECT(probe.fired_at == 9000);
+}
+
+static
+void test_rearm_from_callback(void)
+{
+    const uint64_t delays[] = {0, 1, 63, 64, 1000, 4096};
+
+    for (size_t i = 0; i < ARRAY_SIZE(delays); ++i) {
+        Timer_Wheel wheel;
+        Probe probe;
+
+        timer_wheel_init(&wheel, 7);
+        probe_init(&probe, &wheel);
+        probe.rearm_count = 10;
+        probe.rearm_delay = delays[i];
+        timer_wheel_add(&wheel, &probe.timer, 7 + delays[i]);
+
+        // NOTE: the timer added back with no delay fires on the next
+        // tick, not again within the same one
+        const uint64_t period = delays[i] > 0 ? delays[i] : 1;
+        uint64_t expected_at = 7 + period;
+        for (size_t k = 0; k < 11; ++k) {
+            timer_wheel_advance(&wheel, expected_at);
+            EXPECT(probe.fired_count == k + 1);
+            EXPECT(probe.fired_at == expected_at);
+            expected_at += period;
+        }
+
+        EXPECT(!timer_pending(&probe.timer));
+        EXPECT(wheel_is_empty(&wheel));
+    }
+}
+
+static
+uint64_t random_below(uint64_t n)
+{
+    return (((uint64_t) rand() << 31) ^ (uint64_t) rand()) % n;
+}
+
+// NOTE: every timer fires exactly at its expiration, whatever the
+// steps the wheel is advanced with
+static
+void test_random_timers(void)
+{
+    enum { PROBES_COUNT = 1000 };
+    static Probe probes[PROBES_COUNT];
+    static uint64_t expires[PROBES_COUNT];
+
+    srand(69);
+
+    Timer_Wheel wheel;
+    timer_wheel_init(&wheel, 12345);
+
+    for (size_t i = 0; i < PROBES_COUNT; ++i) {
+        probe_init(&probes[i], &wheel);
+        const uint64_t bits = random_below(TIMER_WHEEL_BITS * 3) + 1;
+        expires[i] = wheel.now + random_below((uint64_t) 1 << bits) + 1;
+        timer_wheel_add(&wheel, &probes[i].timer, expires[i]);
+    }
+
+    for (size_t i = 0; i < PROBES_COUNT; i += 7) {
+        timer_wheel_cancel(&wheel, &probes[i].timer);
+    }
+
+    while (!wheel_is_empty(&wheel)) {
+        timer_wheel_advance(&wheel, wheel.now + random_below(3000) + 1);
+    }
+
+    for (size_t i = 0; i < PROBES_COUNT; ++i) {
+        if (i % 7 == 0) {
+            EXPECT(probes[i].fired_count == 0);
+        } else {
+            EXPECT(probes[i].fired_count == 1);
+            EXPECT(probes[i].fired_at == expires[i]);
+        }
+    }
+}
+
+int main(void)
+{
+    test_level_boundaries();
+    test_cancel_after_cascade();
+    test_rearm_from_callback();
+    test_random_timers();
+
+    if (failures > 0) {
+        fprintf(stderr, "%d checks FAILED\n", failures);
+        return 1;
+    }
+
+    printf("OK\n");
+    return 0;
+}
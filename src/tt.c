@@ -4,6 +4,44 @@
 #include <stdint.h>
 #include <string.h>
 #include "s.h"
+#include "tt.h"
+
+// NOTE: Template syntax
+//
+// Everything outside of %...% is a literal segment that is copied to
+// the output as is. Everything inside of %...% is C code, except for
+// the typed insertions:
+//
+// - %INT(x)%    - integer x in decimal
+// - %STRING(x)% - String x escaped for HTML
+// - %RAW(x)%    - String x as is
+//
+// The generated code is supposed to be included into the body of a
+// function that has `Buffer *OUT` in scope (see src/tt.h). All the
+// literal segments and insertions between two pieces of C code are
+// appended after a single buffer_reserve() of their upper bound. The
+// arguments of %STRING% and %RAW% take part in the bound too, so they
+// are evaluated once into locals (tt_arg_<n>) before anything of the
+// run is appended, and the expressions may have side effects.
+
+typedef enum {
+    TOKEN_LITERAL = 0,
+    TOKEN_INT,
+    TOKEN_STRING,
+    TOKEN_RAW,
+    TOKEN_C_CODE,
+} Token_Kind;
+
+typedef struct {
+    Token_Kind kind;
+    String text;
+    size_t literal_index;
+} Token;
+
+#define TOKENS_CAPACITY 4096
+
+Token tokens[TOKENS_CAPACITY];
+size_t tokens_count = 0;
 
 String file_as_content(const char *filepath) {
     assert(filepath);
@@ -25,16 +63,121 @@ String file_as_content(const char *filepath) {
     return string(n, buffer);
 }
 
-void compile_c_code(String s) {
-    printf("%.*s\n", (int) s.len, s.data);
+int parse_insertion(String code, const char *name, String *argument)
+{
+    String prefix = cstr_as_string(name);
+    if (!prefix_of(prefix, code)) {
+        return 0;
+    }
+
+    code = drop(code, prefix.len);
+    if (code.len < 2 || code.data[0] != '(' || code.data[code.len - 1] != ')') {
+        return 0;
+    }
+
+    *argument = trim(string(code.len - 2, code.data + 1));
+    return 1;
+}
+
+void push_token(Token token)
+{
+    assert(tokens_count < TOKENS_CAPACITY);
+    tokens[tokens_count++] = token;
+}
+
+void tokenize_c_code(String code)
+{
+    String argument = {0};
+    String trimmed = trim(code);
+
+    if (parse_insertion(trimmed, "INT", &argument)) {
+        push_token((Token) { .kind = TOKEN_INT, .text = argument });
+    } else if (parse_insertion(trimmed, "STRING", &argument)) {
+        push_token((Token) { .kind = TOKEN_STRING, .text = argument });
+    } else if (parse_insertion(trimmed, "RAW", &argument)) {
+        push_token((Token) { .kind = TOKEN_RAW, .text = argument });
+    } else {
+        push_token((Token) { .kind = TOKEN_C_CODE, .text = code });
+    }
 }
 
-void compile_byte_array(String s) {
-    printf("write(OUT, \"");
-    for (uint64_t i = 0; i < s.len; ++i) {
-        printf("\\x%02x", s.data[i]);
+void compile_byte_array(size_t index, String s) {
+    printf("static const uint8_t tt_literal_%zu[] = {", index);
+    for (size_t i = 0; i < s.len; ++i) {
+        if (i % 16 == 0) {
+            printf("\n   ");
+        }
+        printf(" 0x%02x,", (uint8_t) s.data[i]);
+    }
+    printf("\n};\n");
+}
+
+// NOTE: opens the scope of the run tokens[begin..end), evaluates the
+// String arguments into it and reserves the upper bound of the output.
+// Returns 1 if the scope has to be closed after the run.
+int compile_reserve(size_t begin, size_t end)
+{
+    size_t constant = 0;
+    int has_dynamic = 0;
+
+    for (size_t i = begin; i < end; ++i) {
+        switch (tokens[i].kind) {
+        case TOKEN_LITERAL: constant += tokens[i].text.len; break;
+        case TOKEN_INT:     constant += TT_INT_BOUND; break;
+        case TOKEN_STRING:
+        case TOKEN_RAW:     has_dynamic = 1; break;
+        case TOKEN_C_CODE:  assert(0 && "unreachable"); break;
+        }
+    }
+
+    if (constant == 0 && !has_dynamic) {
+        return 0;
+    }
+
+    if (has_dynamic) {
+        printf("{\n");
+        for (size_t i = begin; i < end; ++i) {
+            if (tokens[i].kind == TOKEN_STRING || tokens[i].kind == TOKEN_RAW) {
+                printf("const String tt_arg_%zu = (%.*s);\n",
+                       i, (int) tokens[i].text.len, tokens[i].text.data);
+            }
+        }
+    }
+
+    printf("buffer_reserve(OUT, %zu", constant);
+    for (size_t i = begin; i < end; ++i) {
+        if (tokens[i].kind == TOKEN_STRING) {
+            printf(" + TT_HTML_BOUND(tt_arg_%zu)", i);
+        } else if (tokens[i].kind == TOKEN_RAW) {
+            printf(" + tt_arg_%zu.len", i);
+        }
+    }
+    printf(");\n");
+
+    return has_dynamic;
+}
+
+void compile_token(size_t i)
+{
+    const Token token = tokens[i];
+    switch (token.kind) {
+    case TOKEN_LITERAL:
+        printf("buffer_append(OUT, tt_literal_%zu, sizeof(tt_literal_%zu));\n",
+               token.literal_index, token.literal_index);
+        break;
+    case TOKEN_INT:
+        printf("tt_int(OUT, %.*s);\n", (int) token.text.len, token.text.data);
+        break;
+    case TOKEN_STRING:
+        printf("tt_html(OUT, tt_arg_%zu);\n", i);
+        break;
+    case TOKEN_RAW:
+        printf("buffer_append_string(OUT, tt_arg_%zu);\n", i);
+        break;
+    case TOKEN_C_CODE:
+        printf("%.*s\n", (int) token.text.len, token.text.data);
+        break;
     }
-    printf("\", %lu);\n", s.len);
 }
 
 int main(int argc, char *argv[])
@@ -46,15 +189,51 @@ int main(int argc, char *argv[])
     const char *filepath = argv[1];
     String template = file_as_content(filepath);
     int c_code_mode = 0;
+    size_t literals_count = 0;
     while (template.len) {
         String token = chop_until_char(&template, '%');
         if (c_code_mode) {
-            compile_c_code(token);
-        } else {
-            compile_byte_array(token);
+            tokenize_c_code(token);
+        } else if (token.len > 0) {
+            push_token((Token) {
+                .kind = TOKEN_LITERAL,
+                .text = token,
+                .literal_index = literals_count++,
+            });
         }
         c_code_mode = !c_code_mode;
     }
 
+    printf("// Generated by ./tt %s. DO NOT EDIT!\n", filepath);
+
+    for (size_t i = 0; i < tokens_count; ++i) {
+        if (tokens[i].kind == TOKEN_LITERAL) {
+            compile_byte_array(tokens[i].literal_index, tokens[i].text);
+        }
+    }
+
+    size_t begin = 0;
+    while (begin < tokens_count) {
+        if (tokens[begin].kind == TOKEN_C_CODE) {
+            compile_token(begin++);
+            continue;
+        }
+
+        size_t end = begin;
+        while (end < tokens_count && tokens[end].kind != TOKEN_C_CODE) {
+            end++;
+        }
+
+        const int scoped = compile_reserve(begin, end);
+        for (size_t i = begin; i < end; ++i) {
+            compile_token(i);
+        }
+        if (scoped) {
+            printf("}\n");
+        }
+
+        begin = end;
+    }
+
     return 0;
 }
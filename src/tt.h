@@ -0,0 +1,47 @@
+#ifndef TT_H_
+#define TT_H_
+
+#include <stdint.h>
+
+#include "s.h"
+#include "buffer.h"
+
+// NOTE: Runtime support of the code generated by ./tt (see src/tt.c)
+
+// NOTE: the longest int64_t is "-9223372036854775808"
+#define TT_INT_BOUND 20
+// NOTE: the longest HTML escape is "&quot;"
+#define TT_HTML_BOUND(s) (6 * (s).len)
+
+static inline
+void tt_int(Buffer *out, int64_t x)
+{
+    buffer_append_i64(out, x);
+}
+
+static inline
+void tt_html(Buffer *out, String s)
+{
+    buffer_reserve(out, TT_HTML_BOUND(s));
+
+    while (s.len > 0) {
+        size_t n = string_find_any(s, SLT("&<>\"'"));
+        buffer_append(out, s.data, n);
+        chop(&s, n);
+
+        if (s.len == 0) {
+            break;
+        }
+
+        switch (*s.data) {
+        case '&':  buffer_append_string(out, SLT("&amp;"));  break;
+        case '<':  buffer_append_string(out, SLT("&lt;"));   break;
+        case '>':  buffer_append_string(out, SLT("&gt;"));   break;
+        case '"':  buffer_append_string(out, SLT("&quot;")); break;
+        case '\'': buffer_append_string(out, SLT("&#39;"));  break;
+        }
+        chop(&s, 1);
+    }
+}
+
+#endif  // TT_H_
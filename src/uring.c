@@ -0,0 +1,259 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <linux/time_types.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "uring.h"
+
+static
+int uring_setup(unsigned entries, struct io_uring_params *params)
+{
+    return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+static
+int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags,
+                void *arg, size_t arg_size)
+{
+    return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size);
+}
+
+static
+int uring_register(int fd, unsigned opcode, void *arg, unsigned args_count)
+{
+    return (int) syscall(__NR_io_uring_register, fd, opcode, arg, args_count);
+}
+
+int uring_init(Uring *uring, unsigned entries)
+{
+    assert(uring);
+    memset(uring, 0, sizeof(*uring));
+    uring->fd = -1;
+
+    // NOTE: the ring is only ever touched by the thread of the event
+    // loop, so the kernel does not have to interrupt it to run the
+    // completions. Older kernels do not know these flags.
+    struct io_uring_params params = {0};
+    params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+    int fd = uring_setup(entries, &params);
+    if (fd < 0 && errno == EINVAL) {
+        memset(&params, 0, sizeof(params));
+        fd = uring_setup(entries, &params);
+    }
+    if (fd < 0) {
+        return -1;
+    }
+    uring->fd = fd;
+
+    const unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if ((params.features & required) != required) {
+        uring_destroy(uring);
+        errno = ENOSYS;
+        return -1;
+    }
+
+    uring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    uring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (uring->cq_ring_size > uring->sq_ring_size) {
+        uring->sq_ring_size = uring->cq_ring_size;
+    }
+    uring->cq_ring_size = uring->sq_ring_size;
+
+    uring->sq_ring = mmap(NULL, uring->sq_ring_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (uring->sq_ring == MAP_FAILED) {
+        uring->sq_ring = NULL;
+        uring_destroy(uring);
+        return -1;
+    }
+    uring->cq_ring = uring->sq_ring;
+
+    uring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    uring->sqes = mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (uring->sqes == MAP_FAILED) {
+        uring->sqes = NULL;
+        uring_destroy(uring);
+        return -1;
+    }
+
+    char *sq = uring->sq_ring;
+    uring->sq_head = (unsigned *) (sq + params.sq_off.head);
+    uring->sq_tail = (unsigned *) (sq + params.sq_off.tail);
+    uring->sq_mask = *(unsigned *) (sq + params.sq_off.ring_mask);
+    uring->sq_entries = *(unsigned *) (sq + params.sq_off.ring_entries);
+    uring->sq_local_tail = *uring->sq_tail;
+    uring->sq_submitted = uring->sq_local_tail;
+
+    // NOTE: the entries are always used in order, so the indirection
+    // array maps every slot to itself once and for all
+    unsigned *array = (unsigned *) (sq + params.sq_off.array);
+    for (unsigned i = 0; i < uring->sq_entries; ++i) {
+        array[i] = i;
+    }
+
+    char *cq = uring->cq_ring;
+    uring->cq_head = (unsigned *) (cq + params.cq_off.head);
+    uring->cq_tail = (unsigned *) (cq + params.cq_off.tail);
+    uring->cq_mask = *(unsigned *) (cq + params.cq_off.ring_mask);
+    uring->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+
+    return 0;
+}
+
+void uring_destroy(Uring *uring)
+{
+    assert(uring);
+
+    if (uring->buf_ring) munmap(uring->buf_ring, uring->buf_ring_size);
+    free(uring->buffers);
+    if (uring->sqes) munmap(uring->sqes, uring->sqes_size);
+    if (uring->sq_ring) munmap(uring->sq_ring, uring->sq_ring_size);
+    if (uring->fd >= 0) close(uring->fd);
+
+    memset(uring, 0, sizeof(*uring));
+    uring->fd = -1;
+}
+
+static
+int uring_submit(Uring *uring, unsigned min_complete, unsigned flags, void *arg, size_t arg_size)
+{
+    __atomic_store_n(uring->sq_tail, uring->sq_local_tail, __ATOMIC_RELEASE);
+
+    const unsigned to_submit = uring->sq_local_tail - uring->sq_submitted;
+    int n = uring_enter(uring->fd, to_submit, min_complete, flags, arg, arg_size);
+    if (n < 0) {
+        return -1;
+    }
+
+    uring->sq_submitted += (unsigned) n;
+    return n;
+}
+
+struct io_uring_sqe *uring_sqe(Uring *uring)
+{
+    assert(uring);
+
+    unsigned head = __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+    while (uring->sq_local_tail - head >= uring->sq_entries) {
+        if (uring_submit(uring, 0, 0, NULL, 0) < 0 && errno != EINTR && errno != EBUSY) {
+            // NOTE: nothing sane can be done about a broken ring
+            abort();
+        }
+        head = __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+    }
+
+    struct io_uring_sqe *sqe = &uring->sqes[uring->sq_local_tail & uring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    uring->sq_local_tail += 1;
+    return sqe;
+}
+
+int uring_submit_and_wait(Uring *uring, int timeout_ms)
+{
+    assert(uring);
+
+    // NOTE: there is no point to wait when something is already there
+    unsigned min_complete = 1;
+    if (*uring->cq_head != __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE)) {
+        min_complete = 0;
+    }
+
+    struct __kernel_timespec ts = {0};
+    struct io_uring_getevents_arg arg = {0};
+    if (timeout_ms >= 0) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (long long) (timeout_ms % 1000) * 1000000;
+        arg.ts = (uint64_t) (uintptr_t) &ts;
+    }
+
+    int n = uring_submit(uring, min_complete, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                         &arg, sizeof(arg));
+    if (n < 0 && (errno == ETIME || errno == EINTR || errno == EBUSY)) {
+        return 0;
+    }
+
+    return n;
+}
+
+struct io_uring_cqe *uring_cqe_peek(Uring *uring)
+{
+    assert(uring);
+
+    const unsigned head = *uring->cq_head;
+    if (head == __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+
+    return &uring->cqes[head & uring->cq_mask];
+}
+
+void uring_cqe_seen(Uring *uring)
+{
+    assert(uring);
+    __atomic_store_n(uring->cq_head, *uring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+int uring_buffers_init(Uring *uring, unsigned group, unsigned count, size_t size)
+{
+    assert(uring);
+    assert((count & (count - 1)) == 0);
+
+    uring->buf_ring_size = count * sizeof(struct io_uring_buf);
+    uring->buf_ring = mmap(NULL, uring->buf_ring_size, PROT_READ | PROT_WRITE,
+                           MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (uring->buf_ring == MAP_FAILED) {
+        uring->buf_ring = NULL;
+        return -1;
+    }
+
+    struct io_uring_buf_reg reg = {
+        .ring_addr = (uint64_t) (uintptr_t) uring->buf_ring,
+        .ring_entries = count,
+        .bgid = (uint16_t) group,
+    };
+    if (uring_register(uring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        return -1;
+    }
+
+    uring->buffers = malloc(count * size);
+    if (uring->buffers == NULL) {
+        return -1;
+    }
+    uring->buffers_count = count;
+    uring->buffer_size = size;
+    uring->buffer_group = group;
+
+    for (unsigned id = 0; id < count; ++id) {
+        uring_buffer_recycle(uring, id);
+    }
+
+    return 0;
+}
+
+char *uring_buffer(Uring *uring, unsigned id)
+{
+    assert(uring);
+    assert(id < uring->buffers_count);
+    return uring->buffers + (size_t) id * uring->buffer_size;
+}
+
+void uring_buffer_recycle(Uring *uring, unsigned id)
+{
+    assert(uring);
+
+    // NOTE: the tail shares the memory with the first entry of the ring
+    struct io_uring_buf_ring *ring = uring->buf_ring;
+    const uint16_t tail = ring->tail;
+    struct io_uring_buf *buf = &ring->bufs[tail & (uring->buffers_count - 1)];
+    buf->addr = (uint64_t) (uintptr_t) uring_buffer(uring, id);
+    buf->len = (uint32_t) uring->buffer_size;
+    buf->bid = (uint16_t) id;
+    __atomic_store_n(&ring->tail, (uint16_t) (tail + 1), __ATOMIC_RELEASE);
+}
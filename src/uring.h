@@ -0,0 +1,71 @@
+#ifndef URING_H_
+#define URING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <linux/io_uring.h>
+
+// NOTE: A minimal io_uring wrapper on top of the raw syscalls. No
+// liburing, just the rings mapped into memory, the submission of the
+// queued entries together with the waiting for the completions in a
+// single io_uring_enter(), and a ring of provided buffers for the
+// multishot receives.
+
+typedef struct {
+    int fd;
+
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    struct io_uring_sqe *sqes;
+    // NOTE: the entries up to sq_local_tail are queued, but not handed
+    // over to the kernel yet
+    unsigned sq_local_tail;
+    unsigned sq_submitted;
+
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+
+    struct io_uring_buf_ring *buf_ring;
+    size_t buf_ring_size;
+    char *buffers;
+    unsigned buffers_count;
+    size_t buffer_size;
+    unsigned buffer_group;
+} Uring;
+
+int uring_init(Uring *uring, unsigned entries);
+void uring_destroy(Uring *uring);
+
+// NOTE: the returned entry is zeroed. When the submission queue is full
+// the queued entries are submitted first, so it never fails.
+struct io_uring_sqe *uring_sqe(Uring *uring);
+
+// NOTE: submits the queued entries and waits for at least one
+// completion, but no longer than timeout_ms (negative is forever)
+int uring_submit_and_wait(Uring *uring, int timeout_ms);
+
+// NOTE: NULL when there are no more completions. Every returned
+// completion must be consumed with uring_cqe_seen() before the next one.
+struct io_uring_cqe *uring_cqe_peek(Uring *uring);
+void uring_cqe_seen(Uring *uring);
+
+// NOTE: registers count buffers of the given size as the buffer group
+// the receives with IOSQE_BUFFER_SELECT pick from. count must be a
+// power of 2.
+int uring_buffers_init(Uring *uring, unsigned group, unsigned count, size_t size);
+char *uring_buffer(Uring *uring, unsigned id);
+// NOTE: gives the buffer back to the kernel
+void uring_buffer_recycle(Uring *uring, unsigned id);
+
+#endif  // URING_H_
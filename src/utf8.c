@@ -1,7 +1,17 @@
 #include <assert.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "utf8.h"
 
+// NOTE: the vector paths are built for their instruction sets whatever
+// the compiler flags and one of them is picked at startup, see
+// utf8_validate_select()
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define UTF8_DISPATCH
+#endif
+
 Utf8_Chunk utf8_encode_rune(uint32_t rune)
 {
     const uint8_t b00000111 = (1 << 3) - 1;
@@ -43,3 +53,281 @@ Utf8_Chunk utf8_encode_rune(uint32_t rune)
         return (Utf8_Chunk){0};
     }
 }
+
+Utf8_Rune utf8_decode(const char *data, size_t size)
+{
+    const uint8_t *bytes = (const uint8_t *) data;
+    const Utf8_Rune invalid = {0};
+
+    if (size == 0) {
+        return invalid;
+    }
+
+    const uint8_t lead = bytes[0];
+    if (lead < 0x80) {
+        return (Utf8_Rune) {
+            .rune = lead,
+            .size = 1
+        };
+    }
+
+    // NOTE: the range of the second byte is narrower after some of the
+    // leads: that is what rules out the overlong forms, the surrogates
+    // and everything above U+10FFFF
+    size_t n = 0;
+    uint32_t rune = 0;
+    uint8_t lo = 0x80;
+    uint8_t hi = 0xBF;
+    if (0xC2 <= lead && lead <= 0xDF) {
+        n = 2;
+        rune = lead & 0x1F;
+    } else if (0xE0 <= lead && lead <= 0xEF) {
+        n = 3;
+        rune = lead & 0x0F;
+        if (lead == 0xE0) lo = 0xA0;
+        if (lead == 0xED) hi = 0x9F;
+    } else if (0xF0 <= lead && lead <= 0xF4) {
+        n = 4;
+        rune = lead & 0x07;
+        if (lead == 0xF0) lo = 0x90;
+        if (lead == 0xF4) hi = 0x8F;
+    } else {
+        return invalid;
+    }
+
+    if (size < n) {
+        return invalid;
+    }
+
+    for (size_t i = 1; i < n; ++i) {
+        if (bytes[i] < lo || bytes[i] > hi) {
+            return invalid;
+        }
+        rune = (rune << 6) | (bytes[i] & 0x3F);
+        lo = 0x80;
+        hi = 0xBF;
+    }
+
+    return (Utf8_Rune) {
+        .rune = rune,
+        .size = n
+    };
+}
+
+// NOTE: the scalar validation of data from offset i on. The vector
+// paths finish with it.
+static
+size_t utf8_validate_from(const char *data, size_t size, size_t i)
+{
+    while (i < size) {
+        // NOTE: most of the strings are short and plain ASCII, so they
+        // are checked 8 bytes at a time too
+        uint64_t word;
+        if (i + sizeof(word) <= size) {
+            memcpy(&word, data + i, sizeof(word));
+            if ((word & 0x8080808080808080ull) == 0) {
+                i += sizeof(word);
+                continue;
+            }
+        }
+
+        if ((uint8_t) data[i] < 0x80) {
+            i += 1;
+            continue;
+        }
+
+        const size_t n = utf8_decode(data + i, size - i).size;
+        if (n == 0) return i;
+        i += n;
+    }
+
+    return size;
+}
+
+
+#if defined(UTF8_DISPATCH)
+// NOTE: The vectorized validator is the lookup table algorithm by John
+// Keiser and Daniel Lemire ("Validating UTF-8 In Less Than One
+// Instruction Per Byte"). Every byte is classified together with the
+// byte before it by three 16 entry tables (the high nibble of the
+// previous byte, its low nibble and the high nibble of the current
+// byte). Each table entry is a set of the errors the nibble is
+// compatible with, so a pair of bytes is an error when all three sets
+// share a bit. The sequences longer than two bytes are checked on top
+// of that by making sure the continuation bytes are where the leads
+// 2 and 3 bytes before say they should be.
+#define UTF8_TOO_SHORT      (1 << 0)
+#define UTF8_TOO_LONG       (1 << 1)
+#define UTF8_OVERLONG_3     (1 << 2)
+#define UTF8_TOO_LARGE      (1 << 3)
+#define UTF8_SURROGATE      (1 << 4)
+#define UTF8_OVERLONG_2     (1 << 5)
+#define UTF8_TOO_LARGE_1000 (1 << 6)
+#define UTF8_OVERLONG_4     (1 << 6)
+#define UTF8_TWO_CONTS      (1 << 7)
+// NOTE: the errors that do not depend on the low nibble of the lead
+#define UTF8_CARRY (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+
+static const uint8_t utf8_byte_1_high[16] = {
+    // NOTE: 0___ ASCII
+    UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+    UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+    // NOTE: 10__ continuation
+    UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,
+    // NOTE: 1100 and 1101 lead of 2
+    UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+    UTF8_TOO_SHORT,
+    // NOTE: 1110 lead of 3
+    UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+    // NOTE: 1111 lead of 4
+    UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+};
+
+static const uint8_t utf8_byte_1_low[16] = {
+    UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4,
+    UTF8_CARRY | UTF8_OVERLONG_2,
+    UTF8_CARRY,
+    UTF8_CARRY,
+    UTF8_CARRY | UTF8_TOO_LARGE,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+};
+
+static const uint8_t utf8_byte_2_high[16] = {
+    // NOTE: 0___ ASCII
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+    // NOTE: 1000
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+    // NOTE: 1001
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE,
+    // NOTE: 101_
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+    // NOTE: 11__ lead
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+};
+
+// NOTE: the block ends in the middle of a sequence when one of its last
+// 3 bytes is a lead that needs more bytes than there are left
+#define UTF8_FF4 0xFF, 0xFF, 0xFF, 0xFF
+static const uint8_t utf8_incomplete_max[32] = {
+    UTF8_FF4, UTF8_FF4, UTF8_FF4, UTF8_FF4,
+    UTF8_FF4, UTF8_FF4, UTF8_FF4, 0xFF, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1,
+};
+
+#define UTF8_BLOCK_SIZE 32
+#include "utf8_lookup.h"
+#undef UTF8_BLOCK_SIZE
+
+#define UTF8_BLOCK_SIZE 16
+#include "utf8_lookup.h"
+#undef UTF8_BLOCK_SIZE
+
+// NOTE: the runs of ASCII are skipped 16 bytes at a time, the rest is
+// decoded one rune at a time
+static __attribute__((target("sse2")))
+size_t utf8_validate_sse2(const char *data, size_t size)
+{
+    size_t i = 0;
+    while (i + 16 <= size) {
+        if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i *) (data + i))) == 0) {
+            i += 16;
+            continue;
+        }
+
+        for (const size_t end = i + 16; i < end; ) {
+            const size_t n = utf8_decode(data + i, size - i).size;
+            if (n == 0) return i;
+            i += n;
+        }
+    }
+
+    return utf8_validate_from(data, size, i);
+}
+#endif
+
+static
+size_t utf8_validate_scalar(const char *data, size_t size)
+{
+    return utf8_validate_from(data, size, 0);
+}
+
+typedef struct {
+    const char *name;
+    const char *cpu_feature;
+    size_t (*validate)(const char *data, size_t size);
+} Utf8_Validator;
+
+// NOTE: from the fastest to the slowest
+static const Utf8_Validator utf8_validators[] = {
+#if defined(UTF8_DISPATCH)
+    {"avx2", "avx2", utf8_validate_avx2},
+    {"ssse3", "ssse3", utf8_validate_ssse3},
+    {"sse2", "sse2", utf8_validate_sse2},
+#endif
+    {"scalar", NULL, utf8_validate_scalar},
+};
+
+#define UTF8_VALIDATORS_COUNT (sizeof(utf8_validators) / sizeof(utf8_validators[0]))
+
+static size_t (*utf8_validate_selected)(const char *data, size_t size) = utf8_validate_scalar;
+
+static
+int utf8_validator_is_supported(const Utf8_Validator *validator)
+{
+    if (validator->cpu_feature == NULL) return 1;
+#if defined(UTF8_DISPATCH)
+    // NOTE: __builtin_cpu_supports() only takes string literals
+    if (strcmp(validator->cpu_feature, "avx2") == 0) return __builtin_cpu_supports("avx2");
+    if (strcmp(validator->cpu_feature, "ssse3") == 0) return __builtin_cpu_supports("ssse3");
+    if (strcmp(validator->cpu_feature, "sse2") == 0) return __builtin_cpu_supports("sse2");
+#endif
+    return 0;
+}
+
+// NOTE: picks the fastest path the CPU supports before main() runs.
+// SKEDUDLE_UTF8=avx2|ssse3|sse2|scalar picks another one instead, that
+// is how `make test` checks all of them.
+__attribute__((constructor))
+static
+void utf8_validate_select(void)
+{
+#if defined(UTF8_DISPATCH)
+    __builtin_cpu_init();
+#endif
+
+    const char *name = getenv("SKEDUDLE_UTF8");
+    if (name != NULL && *name == '\0') name = NULL;
+    const Utf8_Validator *best = NULL;
+    for (size_t i = 0; i < UTF8_VALIDATORS_COUNT; ++i) {
+        const Utf8_Validator *validator = &utf8_validators[i];
+        if (!utf8_validator_is_supported(validator)) continue;
+        if (best == NULL) best = validator;
+        if (name != NULL && strcmp(name, validator->name) == 0) {
+            utf8_validate_selected = validator->validate;
+            return;
+        }
+    }
+
+    assert(best != NULL);
+    if (name != NULL) {
+        fprintf(stderr, "[WARN] SKEDUDLE_UTF8 `%s' is unknown or not supported by the CPU. Using %s.\n",
+                name, best->name);
+    }
+    utf8_validate_selected = best->validate;
+}
+
+size_t utf8_validate(const char *data, size_t size)
+{
+    return utf8_validate_selected(data, size);
+}
@@ -1,6 +1,7 @@
 #ifndef UTF8_H_
 #define UTF8_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
 #define UTF8_CHUNK_CAPACITY 4
@@ -12,4 +13,24 @@ typedef struct {
 
 Utf8_Chunk utf8_encode_rune(uint32_t rune);
 
+typedef struct {
+    uint32_t rune;
+    // NOTE: the amount of bytes the rune took, 0 when they are not valid
+    // UTF-8 (overlong forms, surrogates, runes above U+10FFFF, stray
+    // continuation bytes or a sequence cut short by the end of data)
+    size_t size;
+} Utf8_Rune;
+
+// NOTE: decodes the rune at the beginning of data. Never looks past
+// data + size.
+Utf8_Rune utf8_decode(const char *data, size_t size);
+
+// NOTE: Returns the offset of the first byte that is not a part of a
+// valid UTF-8 sequence or `size` if all of data is valid. Vectorized
+// with AVX2 or SSSE3 when the CPU has them, whatever the compiler flags,
+// on plain SSE2 only the runs of ASCII are skipped 16 bytes at a time.
+// The environment variable SKEDUDLE_UTF8=avx2|ssse3|sse2|scalar forces
+// one of the paths.
+size_t utf8_validate(const char *data, size_t size);
+
 #endif  // UTF8_H_
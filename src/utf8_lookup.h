@@ -0,0 +1,206 @@
+// NOTE: The lookup table validator of utf8.c, included there once per
+// instruction set. UTF8_BLOCK_SIZE picks it: 32 is AVX2 and 16 is
+// SSSE3. Every function gets the instruction set as a target attribute
+// and a suffix, so the program runs on the CPUs without it as long as
+// nothing calls them. No include guard on purpose.
+#if UTF8_BLOCK_SIZE == 32
+#define UTF8_ISA avx2
+#define UTF8_TARGET __attribute__((target("avx2")))
+#elif UTF8_BLOCK_SIZE == 16
+#define UTF8_ISA ssse3
+#define UTF8_TARGET __attribute__((target("ssse3")))
+#else
+#error "UTF8_BLOCK_SIZE must be 16 or 32"
+#endif
+
+#define UTF8_SUFFIX__(name, isa) name##_##isa
+#define UTF8_SUFFIX_(name, isa) UTF8_SUFFIX__(name, isa)
+#define UTF8_SUFFIX(name) UTF8_SUFFIX_(name, UTF8_ISA)
+
+#define Utf8_Block UTF8_SUFFIX(Utf8_Block)
+#define utf8_block_load UTF8_SUFFIX(utf8_block_load)
+#define utf8_block_splat UTF8_SUFFIX(utf8_block_splat)
+#define utf8_block_or UTF8_SUFFIX(utf8_block_or)
+#define utf8_block_and UTF8_SUFFIX(utf8_block_and)
+#define utf8_block_xor UTF8_SUFFIX(utf8_block_xor)
+#define utf8_block_subs UTF8_SUFFIX(utf8_block_subs)
+#define utf8_block_is_ascii UTF8_SUFFIX(utf8_block_is_ascii)
+#define utf8_block_is_zero UTF8_SUFFIX(utf8_block_is_zero)
+#define utf8_block_lookup UTF8_SUFFIX(utf8_block_lookup)
+#define utf8_block_high_nibbles UTF8_SUFFIX(utf8_block_high_nibbles)
+#define utf8_block_prev1 UTF8_SUFFIX(utf8_block_prev1)
+#define utf8_block_prev2 UTF8_SUFFIX(utf8_block_prev2)
+#define utf8_block_prev3 UTF8_SUFFIX(utf8_block_prev3)
+#define utf8_block_errors UTF8_SUFFIX(utf8_block_errors)
+#define utf8_block_incomplete UTF8_SUFFIX(utf8_block_incomplete)
+
+#if UTF8_BLOCK_SIZE == 32
+typedef __m256i Utf8_Block;
+
+static inline UTF8_TARGET Utf8_Block utf8_block_load(const char *data) { return _mm256_loadu_si256((const __m256i *) data); }
+static inline UTF8_TARGET Utf8_Block utf8_block_splat(uint8_t x) { return _mm256_set1_epi8((char) x); }
+static inline UTF8_TARGET Utf8_Block utf8_block_or(Utf8_Block a, Utf8_Block b) { return _mm256_or_si256(a, b); }
+static inline UTF8_TARGET Utf8_Block utf8_block_and(Utf8_Block a, Utf8_Block b) { return _mm256_and_si256(a, b); }
+static inline UTF8_TARGET Utf8_Block utf8_block_xor(Utf8_Block a, Utf8_Block b) { return _mm256_xor_si256(a, b); }
+static inline UTF8_TARGET Utf8_Block utf8_block_subs(Utf8_Block a, Utf8_Block b) { return _mm256_subs_epu8(a, b); }
+static inline UTF8_TARGET int utf8_block_is_ascii(Utf8_Block a) { return _mm256_movemask_epi8(a) == 0; }
+static inline UTF8_TARGET int utf8_block_is_zero(Utf8_Block a) { return _mm256_testz_si256(a, a); }
+
+static inline UTF8_TARGET
+Utf8_Block utf8_block_lookup(const uint8_t table[16], Utf8_Block nibbles)
+{
+    const Utf8_Block t = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) table));
+    return _mm256_shuffle_epi8(t, nibbles);
+}
+
+static inline UTF8_TARGET
+Utf8_Block utf8_block_high_nibbles(Utf8_Block a)
+{
+    return _mm256_and_si256(_mm256_srli_epi16(a, 4), utf8_block_splat(0x0F));
+}
+
+// NOTE: the block moved forward by 1, 2 or 3 bytes with the end of the
+// previous block moved in. The lanes of AVX2 are 16 bytes wide, so the
+// upper lane of prev and the lower lane of input are put together first.
+static inline UTF8_TARGET
+Utf8_Block utf8_block_prev1(Utf8_Block input, Utf8_Block prev)
+{
+    return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(prev, input, 0x21), 15);
+}
+
+static inline UTF8_TARGET
+Utf8_Block utf8_block_prev2(Utf8_Block input, Utf8_Block prev)
+{
+    return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(prev, input, 0x21), 14);
+}
+
+static inline UTF8_TARGET
+Utf8_Block utf8_block_prev3(Utf8_Block input, Utf8_Block prev)
+{
+    return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(prev, input, 0x21), 13);
+}
+#else
+typedef __m128i Utf8_Block;
+
+static inline UTF8_TARGET Utf8_Block utf8_block_load(const char *data) { return _mm_loadu_si128((const __m128i *) data); }
+static inline UTF8_TARGET Utf8_Block utf8_block_splat(uint8_t x) { return _mm_set1_epi8((char) x); }
+static inline UTF8_TARGET Utf8_Block utf8_block_or(Utf8_Block a, Utf8_Block b) { return _mm_or_si128(a, b); }
+static inline UTF8_TARGET Utf8_Block utf8_block_and(Utf8_Block a, Utf8_Block b) { return _mm_and_si128(a, b); }
+static inline UTF8_TARGET Utf8_Block utf8_block_xor(Utf8_Block a, Utf8_Block b) { return _mm_xor_si128(a, b); }
+static inline UTF8_TARGET Utf8_Block utf8_block_subs(Utf8_Block a, Utf8_Block b) { return _mm_subs_epu8(a, b); }
+static inline UTF8_TARGET int utf8_block_is_ascii(Utf8_Block a) { return _mm_movemask_epi8(a) == 0; }
+
+static inline UTF8_TARGET
+int utf8_block_is_zero(Utf8_Block a)
+{
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(a, _mm_setzero_si128())) == 0xFFFF;
+}
+
+static inline UTF8_TARGET
+Utf8_Block utf8_block_lookup(const uint8_t table[16], Utf8_Block nibbles)
+{
+    return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) table), nibbles);
+}
+
+static inline UTF8_TARGET
+Utf8_Block utf8_block_high_nibbles(Utf8_Block a)
+{
+    return _mm_and_si128(_mm_srli_epi16(a, 4), utf8_block_splat(0x0F));
+}
+
+static inline UTF8_TARGET Utf8_Block utf8_block_prev1(Utf8_Block input, Utf8_Block prev) { return _mm_alignr_epi8(input, prev, 15); }
+static inline UTF8_TARGET Utf8_Block utf8_block_prev2(Utf8_Block input, Utf8_Block prev) { return _mm_alignr_epi8(input, prev, 14); }
+static inline UTF8_TARGET Utf8_Block utf8_block_prev3(Utf8_Block input, Utf8_Block prev) { return _mm_alignr_epi8(input, prev, 13); }
+#endif
+
+static inline UTF8_TARGET
+Utf8_Block utf8_block_errors(Utf8_Block input, Utf8_Block prev_input)
+{
+    const Utf8_Block low_nibble = utf8_block_splat(0x0F);
+    const Utf8_Block prev1 = utf8_block_prev1(input, prev_input);
+
+    const Utf8_Block special_cases = utf8_block_and(
+        utf8_block_and(utf8_block_lookup(utf8_byte_1_high, utf8_block_high_nibbles(prev1)),
+                       utf8_block_lookup(utf8_byte_1_low, utf8_block_and(prev1, low_nibble))),
+        utf8_block_lookup(utf8_byte_2_high, utf8_block_high_nibbles(input)));
+
+    // NOTE: only 111_____ 2 bytes back and 1111____ 3 bytes back end up
+    // with the high bit set. That is where a continuation must be, which
+    // is exactly what the TWO_CONTS bit of special_cases says, so the
+    // two cancel out and anything left is an error.
+    const Utf8_Block is_third_byte = utf8_block_subs(utf8_block_prev2(input, prev_input),
+                                                     utf8_block_splat(0xE0 - 0x80));
+    const Utf8_Block is_fourth_byte = utf8_block_subs(utf8_block_prev3(input, prev_input),
+                                                      utf8_block_splat(0xF0 - 0x80));
+    const Utf8_Block must_be_continuation = utf8_block_and(utf8_block_or(is_third_byte, is_fourth_byte),
+                                                           utf8_block_splat(0x80));
+
+    return utf8_block_xor(must_be_continuation, special_cases);
+}
+
+// NOTE: the 16 bytes version of the table is the end of the 32 bytes one
+static inline UTF8_TARGET
+Utf8_Block utf8_block_incomplete(Utf8_Block input)
+{
+    const char *max = (const char *) utf8_incomplete_max + sizeof(utf8_incomplete_max) - UTF8_BLOCK_SIZE;
+    return utf8_block_subs(input, utf8_block_load(max));
+}
+
+static UTF8_TARGET
+size_t UTF8_SUFFIX(utf8_validate)(const char *data, size_t size)
+{
+    size_t i = 0;
+
+    if (size >= UTF8_BLOCK_SIZE) {
+        Utf8_Block prev_input = utf8_block_splat(0);
+        int prev_incomplete = 0;
+        for (; i + UTF8_BLOCK_SIZE <= size; i += UTF8_BLOCK_SIZE) {
+            const Utf8_Block input = utf8_block_load(data + i);
+            if (utf8_block_is_ascii(input)) {
+                if (prev_incomplete) break;
+            } else {
+                if (!utf8_block_is_zero(utf8_block_errors(input, prev_input))) break;
+                prev_incomplete = !utf8_block_is_zero(utf8_block_incomplete(input));
+            }
+            prev_input = input;
+        }
+
+        // NOTE: the blocks before i are valid, except that the last one
+        // may end in the middle of a sequence. Either the tail or the
+        // block with the error is rechecked by the scalar loop from the
+        // start of that sequence, which also finds the exact offset of
+        // the error.
+        for (size_t back = 1; back <= 3 && back <= i; ++back) {
+            const uint8_t byte = (uint8_t) data[i - back];
+            if (byte < 0x80) break;
+            if (byte >= 0xC0) {
+                i -= back;
+                break;
+            }
+        }
+    }
+
+    return utf8_validate_from(data, size, i);
+}
+
+#undef Utf8_Block
+#undef utf8_block_load
+#undef utf8_block_splat
+#undef utf8_block_or
+#undef utf8_block_and
+#undef utf8_block_xor
+#undef utf8_block_subs
+#undef utf8_block_is_ascii
+#undef utf8_block_is_zero
+#undef utf8_block_lookup
+#undef utf8_block_high_nibbles
+#undef utf8_block_prev1
+#undef utf8_block_prev2
+#undef utf8_block_prev3
+#undef utf8_block_errors
+#undef utf8_block_incomplete
+#undef UTF8_SUFFIX
+#undef UTF8_SUFFIX_
+#undef UTF8_SUFFIX__
+#undef UTF8_TARGET
+#undef UTF8_ISA